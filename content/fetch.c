@@ -29,8 +29,16 @@
  * be at most nsoption max_fetchers_per_host active requests per Host: header.
  * There may be at most nsoption max_fetchers active requests overall. Inactive
  * fetches are stored in the ::queue_ring waiting for use.
+ *
+ * Fetchers are either polled or, where the fetcher provides the
+ * socket_action operation and epoll is available, driven by events on
+ * the sockets and timers they register. Frontends which wait on the
+ * fdset from fetch_fdset() are handed a single epoll descriptor for
+ * all event driven fetchers instead of each of their sockets.
  */
 
+#include "utils/config.h"
+
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
@@ -38,9 +46,12 @@
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#ifdef HAVE_EPOLL
+#include <unistd.h>
+#include <sys/epoll.h>
+#endif
 #include <libwapcaplet/libwapcaplet.h>
 
-#include "utils/config.h"
 #include "utils/corestrings.h"
 #include "utils/nsoption.h"
 #include "utils/log.h"
@@ -73,6 +84,9 @@
 /** The fdset timeout in ms */
 #define FDSET_TIMEOUT 1000
 
+/** The maximum number of socket events processed per epoll_wait() */
+#define MAX_SOCKET_EVENTS 64
+
 /**
  * Information about a fetcher for a given scheme.
  */
@@ -105,10 +119,33 @@ struct fetch {
 static struct fetch *fetch_ring = NULL;	/**< Ring of active fetches. */
 static struct fetch *queue_ring = NULL;	/**< Ring of queued fetches */
 
+#ifdef HAVE_EPOLL
+/** epoll set of event driven fetcher sockets or -1 if unavailable */
+static int fetch_epoll_fd = -1;
+#endif
+
 /******************************************************************************
  * fetch internals							      *
  ******************************************************************************/
 
+static void fetcher_timer_expired(void *p);
+
+/**
+ * Check if a fetcher is being driven by socket events.
+ *
+ * \param fetcherd The fetcher descriptor.
+ * \return true if the fetcher need not be polled else false.
+ */
+static inline bool fetcher_is_event_driven(int fetcherd)
+{
+#ifdef HAVE_EPOLL
+	return (fetch_epoll_fd != -1) &&
+		(fetchers[fetcherd].ops.socket_action != NULL);
+#else
+	return false;
+#endif
+}
+
 static inline void fetch_ref_fetcher(int fetcherd)
 {
 	fetchers[fetcherd].refcount++;
@@ -118,6 +155,10 @@ static inline void fetch_unref_fetcher(int fetcherd)
 {
 	fetchers[fetcherd].refcount--;
 	if (fetchers[fetcherd].refcount == 0) {
+		if (fetchers[fetcherd].ops.socket_action != NULL) {
+			guit->misc->schedule(-1, fetcher_timer_expired,
+					     &fetchers[fetcherd]);
+		}
 		fetchers[fetcherd].ops.finalise(fetchers[fetcherd].scheme);
 		lwc_string_unref(fetchers[fetcherd].scheme);
 	}
@@ -259,24 +300,140 @@ static bool fetch_dispatch_jobs(void)
 	return (all_active > 0);
 }
 
-static void fetcher_poll(void *unused)
+/**
+ * Check if any active fetch belongs to a fetcher which must be polled.
+ *
+ * Fetchers which are event driven or supply an fdset are woken by
+ * the frontend and do not need frequent polling.
+ *
+ * @return true if there are active fetches which require polling.
+ */
+static bool fetch_active_polled(void)
+{
+	struct fetch *f;
+
+	f = fetch_ring;
+	if (f) {
+		do {
+			if ((fetchers[f->fetcherd].ops.fdset == NULL) &&
+			    !fetcher_is_event_driven(f->fetcherd)) {
+				return true;
+			}
+			f = f->r_next;
+		} while (f != fetch_ring);
+	}
+	return false;
+}
+
+/**
+ * Poll every fetcher which is not driven by socket events.
+ */
+static void fetcher_poll_fetchers(void)
 {
 	int fetcherd;
 
-	if (fetch_dispatch_jobs()) {
-		NSLOG(fetch, DEBUG, "Polling fetchers");
-		for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
-			if (fetchers[fetcherd].refcount > 0) {
-				/* fetcher present */
-				fetchers[fetcherd].ops.poll(fetchers[fetcherd].scheme);
+	NSLOG(fetch, DEBUG, "Polling fetchers");
+	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
+		if ((fetchers[fetcherd].refcount > 0) &&
+		    !fetcher_is_event_driven(fetcherd)) {
+			/* fetcher present */
+			fetchers[fetcherd].ops.poll(fetchers[fetcherd].scheme);
+		}
+	}
+}
+
+/**
+ * Dispatch any pending socket events to event driven fetchers.
+ *
+ * Does not block, only events which are already pending are processed.
+ */
+static void fetcher_dispatch_socket_events(void)
+{
+#ifdef HAVE_EPOLL
+	struct epoll_event events[MAX_SOCKET_EVENTS];
+	int nevents;
+	int evidx;
+
+	if (fetch_epoll_fd == -1) {
+		return;
+	}
+
+	do {
+		nevents = epoll_wait(fetch_epoll_fd,
+				     events, MAX_SOCKET_EVENTS, 0);
+		if (nevents < 0) {
+			if (errno != EINTR) {
+				NSLOG(fetch, WARNING, "epoll_wait failed: %s",
+				      strerror(errno));
+			}
+			return;
+		}
+
+		for (evidx = 0; evidx < nevents; evidx++) {
+			int fetcherd = events[evidx].data.u64 >> 32;
+			int fd = events[evidx].data.u64 & 0xffffffff;
+			unsigned int ready = FETCHER_SOCKET_NONE;
+
+			if (fetchers[fetcherd].refcount == 0) {
+				continue;
+			}
+
+			if (events[evidx].events & EPOLLIN) {
+				ready |= FETCHER_SOCKET_IN;
+			}
+			if (events[evidx].events & EPOLLOUT) {
+				ready |= FETCHER_SOCKET_OUT;
 			}
+			if (events[evidx].events & (EPOLLERR | EPOLLHUP)) {
+				ready |= FETCHER_SOCKET_ERR;
+			}
+
+			fetchers[fetcherd].ops.socket_action(
+				fetchers[fetcherd].scheme, fd, ready);
 		}
+	} while (nevents == MAX_SOCKET_EVENTS);
+#endif
+}
+
+/**
+ * Scheduled poll of the fetchers.
+ *
+ * Event driven fetchers have their pending socket events processed
+ * here as a fallback for frontends which do not wait on the fdset
+ * from fetch_fdset(); for those that do this is pushed back to
+ * FDSET_TIMEOUT.
+ */
+static void fetcher_poll(void *unused)
+{
+	if (fetch_dispatch_jobs()) {
+		fetcher_dispatch_socket_events();
+
+		fetcher_poll_fetchers();
 
 		/* schedule active fetchers to run again in 10ms */
 		guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
 	}
 }
 
+/**
+ * Event driven fetcher timer callback.
+ *
+ * \param p The fetcher whose timer expired.
+ */
+static void fetcher_timer_expired(void *p)
+{
+	scheme_fetcher *fetcher = p;
+
+	if (fetcher->refcount > 0) {
+		fetcher->ops.socket_action(fetcher->scheme,
+					   FETCHER_SOCKET_TIMEOUT,
+					   FETCHER_SOCKET_NONE);
+	}
+
+	/* completed fetches may have made room for queued ones */
+	fetch_dispatch_jobs();
+}
+
 /******************************************************************************
  * Public API								      *
  ******************************************************************************/
@@ -286,6 +443,15 @@ nserror fetcher_init(void)
 {
 	nserror ret;
 
+#ifdef HAVE_EPOLL
+	fetch_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (fetch_epoll_fd == -1) {
+		NSLOG(fetch, INFO,
+		      "epoll unavailable (%s), polling all fetchers",
+		      strerror(errno));
+	}
+#endif
+
 #ifdef WITH_CURL
 	ret = fetch_curl_register();
 	if (ret != NSERROR_OK) {
@@ -350,6 +516,13 @@ void fetcher_quit(void)
 			fetch_unref_fetcher(fetcherd);
 		}
 	}
+
+#ifdef HAVE_EPOLL
+	if (fetch_epoll_fd != -1) {
+		close(fetch_epoll_fd);
+		fetch_epoll_fd = -1;
+	}
+#endif
 }
 
 /* exported interface documented in content/fetchers.h */
@@ -380,6 +553,77 @@ fetcher_add(lwc_string *scheme, const struct fetcher_operation_table *ops)
 	return NSERROR_OK;
 }
 
+/* exported interface documented in content/fetchers.h */
+nserror
+fetcher_socket_update(lwc_string *scheme, int fd, unsigned int events)
+{
+#ifdef HAVE_EPOLL
+	struct epoll_event event;
+	int fetcherd;
+
+	if (fetch_epoll_fd == -1) {
+		return NSERROR_NOT_IMPLEMENTED;
+	}
+
+	if (events & FETCHER_SOCKET_REMOVE) {
+		/* the socket may already have been closed which
+		 * removes it from the set so errors are ignored.
+		 */
+		epoll_ctl(fetch_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		return NSERROR_OK;
+	}
+
+	fetcherd = get_fetcher_for_scheme(scheme);
+	if (fetcherd == -1) {
+		return NSERROR_NO_FETCH_HANDLER;
+	}
+
+	event.events = 0;
+	if (events & FETCHER_SOCKET_IN) {
+		event.events |= EPOLLIN;
+	}
+	if (events & FETCHER_SOCKET_OUT) {
+		event.events |= EPOLLOUT;
+	}
+	event.data.u64 = ((uint64_t)fetcherd << 32) | (uint32_t)fd;
+
+	if (epoll_ctl(fetch_epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0) {
+		return NSERROR_OK;
+	}
+	if ((errno == ENOENT) &&
+	    (epoll_ctl(fetch_epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)) {
+		return NSERROR_OK;
+	}
+
+	NSLOG(fetch, WARNING, "Unable to wait on fd %d: %s",
+	      fd, strerror(errno));
+
+	return NSERROR_INVALID;
+#else
+	return NSERROR_NOT_IMPLEMENTED;
+#endif
+}
+
+/* exported interface documented in content/fetchers.h */
+nserror fetcher_timer_update(lwc_string *scheme, int timeout)
+{
+	int fetcherd;
+
+	fetcherd = get_fetcher_for_scheme(scheme);
+	if (fetcherd == -1) {
+		return NSERROR_NO_FETCH_HANDLER;
+	}
+
+	if (!fetcher_is_event_driven(fetcherd)) {
+		return NSERROR_NOT_IMPLEMENTED;
+	}
+
+	/* a negative timeout removes the scheduled callback */
+	return guit->misc->schedule(timeout,
+				    fetcher_timer_expired,
+				    &fetchers[fetcherd]);
+}
+
 /* exported interface documented in content/fetch.h */
 nserror
 fetch_fdset(fd_set *read_fd_set,
@@ -396,22 +640,28 @@ fetch_fdset(fd_set *read_fd_set,
 		return NSERROR_OK;
 	}
 
-	NSLOG(fetch, DEBUG, "Polling fetchers");
+	fetcher_dispatch_socket_events();
 
-	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
-		if (fetchers[fetcherd].refcount > 0) {
-			/* fetcher present */
-			fetchers[fetcherd].ops.poll(fetchers[fetcherd].scheme);
-		}
-	}
+	fetcher_poll_fetchers();
 
 	FD_ZERO(read_fd_set);
 	FD_ZERO(write_fd_set);
 	FD_ZERO(except_fd_set);
 
+#ifdef HAVE_EPOLL
+	if (fetch_epoll_fd != -1) {
+		/* all event driven fetchers are waited on through the
+		 * epoll descriptor becoming readable.
+		 */
+		FD_SET(fetch_epoll_fd, read_fd_set);
+		maxfd = fetch_epoll_fd;
+	}
+#endif
+
 	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
 		if ((fetchers[fetcherd].refcount > 0) &&
-		    (fetchers[fetcherd].ops.fdset != NULL)) {
+		    (fetchers[fetcherd].ops.fdset != NULL) &&
+		    !fetcher_is_event_driven(fetcherd)) {
 			/* fetcher present */
 			int fetcher_maxfd;
 			fetcher_maxfd = fetchers[fetcherd].ops.fdset(
@@ -436,7 +686,11 @@ fetch_fdset(fd_set *read_fd_set,
 		 * select on. All the other fetchers continue to need
 		 * polling frequently.
 		 */
-		guit->misc->schedule(FDSET_TIMEOUT, fetcher_poll, NULL);
+		if (fetch_active_polled()) {
+			guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
+		} else {
+			guit->misc->schedule(FDSET_TIMEOUT, fetcher_poll, NULL);
+		}
 	}
 
 	*maxfd_out = maxfd;
@@ -32,6 +32,22 @@ struct nsurl;
 struct fetch_multipart_data;
 struct fetch;
 
+/**
+ * Socket readiness flags used by event driven fetchers.
+ */
+enum fetcher_socket_event {
+	FETCHER_SOCKET_NONE = 0, /**< No interest, keep registration */
+	FETCHER_SOCKET_IN = 1, /**< Socket readable */
+	FETCHER_SOCKET_OUT = 2, /**< Socket writable */
+	FETCHER_SOCKET_ERR = 4, /**< Socket in error */
+	FETCHER_SOCKET_REMOVE = 8, /**< Socket no longer of interest */
+};
+
+/**
+ * Socket descriptor passed to socket_action on timer expiry.
+ */
+#define FETCHER_SOCKET_TIMEOUT (-1)
+
 /**
  * Fetcher operations API
  *
@@ -39,6 +55,14 @@ struct fetch;
  *
  * Each fetcher is called once for initialisaion and finalisation.
  * The poll entry point will be called to allow all active fetches to progress.
+ *
+ * Fetchers which provide the optional socket_action entry point may
+ * instead be driven by events. Such fetchers register their sockets
+ * with fetcher_socket_update() and their timeouts with
+ * fetcher_timer_update() and are then only called when a socket is
+ * ready or the timer expires. If the core is unable to wait on
+ * events they are polled like any other fetcher.
+ *
  * The flow of a fetch operation is:
  *   URL is checked for aceptability.
  *   setup with all applicable data.
@@ -96,6 +120,18 @@ struct fetcher_operation_table {
 	int (*fdset)(lwc_string *scheme, fd_set *read_set, fd_set *write_set,
 		     fd_set *error_set);
 
+	/**
+	 * Drive an event driven fetcher.
+	 *
+	 * Optional, may be NULL if the fetcher only supports polling.
+	 *
+	 * \param scheme The scheme the socket was registered with.
+	 * \param fd The ready socket or FETCHER_SOCKET_TIMEOUT if the
+	 *           fetchers timer expired.
+	 * \param events The fetcher_socket_event flags which are ready.
+	 */
+	void (*socket_action)(lwc_string *scheme, int fd, unsigned int events);
+
 	/**
 	 * Finalise the fetcher.
 	 */
@@ -113,6 +149,33 @@ struct fetcher_operation_table {
 nserror fetcher_add(lwc_string *scheme, const struct fetcher_operation_table *ops);
 
 
+/**
+ * Update the events an event driven fetcher is waiting for on a socket.
+ *
+ * \param scheme The scheme of the fetcher the socket belongs to.
+ * \param fd The socket to update.
+ * \param events The fetcher_socket_event flags to wait for, or
+ *               FETCHER_SOCKET_REMOVE to stop waiting on the socket.
+ * \return NSERROR_OK on success, NSERROR_NOT_IMPLEMENTED if the core
+ *         is not waiting on events or appropriate error code.
+ */
+nserror fetcher_socket_update(lwc_string *scheme, int fd, unsigned int events);
+
+
+/**
+ * Update the timeout of an event driven fetcher.
+ *
+ * When the timeout expires the fetchers socket_action is called with
+ * FETCHER_SOCKET_TIMEOUT.
+ *
+ * \param scheme The scheme of the fetcher.
+ * \param timeout The timeout in ms or a negative value to remove it.
+ * \return NSERROR_OK on success, NSERROR_NOT_IMPLEMENTED if the core
+ *         is not waiting on events or appropriate error code.
+ */
+nserror fetcher_timer_update(lwc_string *scheme, int timeout);
+
+
 /**
  * Initialise all registered fetchers.
  *
@@ -24,6 +24,11 @@
  *
  * This implementation uses libcurl's 'multi' interface.
  *
+ * When the fetch core is able to wait on socket events the multi
+ * handle is driven with curl_multi_socket_action() from the sockets
+ * and timeout curl reports, otherwise it is polled with
+ * curl_multi_perform().
+ *
  * The CURL handles are cached in the curl_handle_ring.
  */
 
@@ -274,6 +279,9 @@ static char fetch_proxy_userpwd[100];
 /** Interlock to prevent initiation during callbacks */
 static bool inside_curl = false;
 
+/** Scheme used to identify the fetcher to the core for socket events */
+static lwc_string *curl_event_scheme = NULL;
+
 
 /**
  * Initialise a cURL fetcher.
@@ -283,6 +291,12 @@ static bool fetch_curl_initialise(lwc_string *scheme)
 	NSLOG(netsurf, INFO, "Initialise cURL fetcher for %s",
 	      lwc_string_data(scheme));
 	curl_fetchers_registered++;
+	if (curl_event_scheme == NULL) {
+		/* all schemes share the multi handle so any of them
+		 * identifies the fetcher for socket events.
+		 */
+		curl_event_scheme = lwc_string_ref(scheme);
+	}
 	return true; /* Always succeeds */
 }
 
@@ -317,6 +331,9 @@ static void fetch_curl_finalise(lwc_string *scheme)
 		NSLOG(netsurf, DEBUG, "Cleaning up SSL cert chain hashmap");
 		hashmap_destroy(curl_fetch_ssl_hashmap);
 		curl_fetch_ssl_hashmap = NULL;
+
+		lwc_string_unref(curl_event_scheme);
+		curl_event_scheme = NULL;
 	}
 
 	/* Free anything remaining in the cached curl handle ring */
@@ -1349,6 +1366,29 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
 }
 
 
+/**
+ * Process completion messages from the cURL multi handle.
+ */
+static void fetch_curl_process_messages(void)
+{
+	int queue;
+	CURLMsg *curl_msg;
+
+	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	while (curl_msg) {
+		switch (curl_msg->msg) {
+			case CURLMSG_DONE:
+				fetch_curl_done(curl_msg->easy_handle,
+						curl_msg->data.result);
+				break;
+			default:
+				break;
+		}
+		curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	}
+}
+
+
 /**
  * Do some work on current fetches.
  *
@@ -1356,9 +1396,8 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
  */
 static void fetch_curl_poll(lwc_string *scheme_ignored)
 {
-	int running, queue;
+	int running;
 	CURLMcode codem;
-	CURLMsg *curl_msg;
 
 	if (nsoption_bool(suppress_curl_debug) == false) {
 		fd_set read_fd_set, write_fd_set, exc_fd_set;
@@ -1411,23 +1450,113 @@ static void fetch_curl_poll(lwc_string *scheme_ignored)
 		}
 	} while (codem == CURLM_CALL_MULTI_PERFORM);
 
-	/* process curl results */
-	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
-	while (curl_msg) {
-		switch (curl_msg->msg) {
-			case CURLMSG_DONE:
-				fetch_curl_done(curl_msg->easy_handle,
-						curl_msg->data.result);
-				break;
-			default:
-				break;
-		}
-		curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	fetch_curl_process_messages();
+	inside_curl = false;
+}
+
+
+/**
+ * Make progress on fetches using a ready socket or expired timeout.
+ *
+ * \param scheme_ignored The scheme the socket was registered with.
+ * \param fd The ready socket or FETCHER_SOCKET_TIMEOUT
+ * \param events The fetcher_socket_event flags which are ready.
+ */
+static void
+fetch_curl_socket_action(lwc_string *scheme_ignored,
+			 int fd,
+			 unsigned int events)
+{
+	int running;
+	int ev_bitmask = 0;
+	curl_socket_t sockfd = fd;
+	CURLMcode codem;
+
+	if (fd == FETCHER_SOCKET_TIMEOUT) {
+		sockfd = CURL_SOCKET_TIMEOUT;
 	}
+	if (events & FETCHER_SOCKET_IN) {
+		ev_bitmask |= CURL_CSELECT_IN;
+	}
+	if (events & FETCHER_SOCKET_OUT) {
+		ev_bitmask |= CURL_CSELECT_OUT;
+	}
+	if (events & FETCHER_SOCKET_ERR) {
+		ev_bitmask |= CURL_CSELECT_ERR;
+	}
+
+	inside_curl = true;
+	codem = curl_multi_socket_action(fetch_curl_multi,
+					 sockfd,
+					 ev_bitmask,
+					 &running);
+	if (codem != CURLM_OK) {
+		NSLOG(netsurf, WARNING,
+		      "curl_multi_socket_action: %i %s",
+		      codem, curl_multi_strerror(codem));
+	}
+
+	fetch_curl_process_messages();
 	inside_curl = false;
 }
 
 
+/**
+ * cURL callback to update the events waited for on a socket.
+ */
+static int
+fetch_curl_socket_callback(CURL *easy,
+			   curl_socket_t s,
+			   int what,
+			   void *userp,
+			   void *socketp)
+{
+	unsigned int events;
+
+	switch (what) {
+	case CURL_POLL_IN:
+		events = FETCHER_SOCKET_IN;
+		break;
+
+	case CURL_POLL_OUT:
+		events = FETCHER_SOCKET_OUT;
+		break;
+
+	case CURL_POLL_INOUT:
+		events = FETCHER_SOCKET_IN | FETCHER_SOCKET_OUT;
+		break;
+
+	case CURL_POLL_REMOVE:
+		events = FETCHER_SOCKET_REMOVE;
+		break;
+
+	default:
+		events = FETCHER_SOCKET_NONE;
+		break;
+	}
+
+	/* if the core is not waiting on events the fetcher is polled */
+	fetcher_socket_update(curl_event_scheme, s, events);
+
+	return 0;
+}
+
+
+/**
+ * cURL callback to update the timeout for socket action.
+ */
+static int
+fetch_curl_timer_callback(CURLM *multi, long timeout_ms, void *userp)
+{
+	/* the timeout is scheduled rather than acted on here as
+	 * socket action must not be called from within this callback.
+	 */
+	fetcher_timer_update(curl_event_scheme, timeout_ms);
+
+	return 0;
+}
+
+
 
 
 /**
@@ -1672,6 +1801,7 @@ nserror fetch_curl_register(void)
 		.free = fetch_curl_free,
 		.poll = fetch_curl_poll,
 		.fdset = fetch_curl_fdset,
+		.socket_action = fetch_curl_socket_action,
 		.finalise = fetch_curl_finalise
 	};
 
@@ -1701,12 +1831,12 @@ nserror fetch_curl_register(void)
 		return NSERROR_INIT_FAILED;
 	}
 
-#if LIBCURL_VERSION_NUM >= 0x071e00
-	/* built against 7.30.0 or later: configure caching */
 	{
 		CURLMcode mcode;
+#if LIBCURL_VERSION_NUM >= 0x071e00
 		int maxconnects = nsoption_int(max_fetchers) +
 				nsoption_int(max_cached_fetch_handles);
+#endif
 
 #undef SETOPT
 #define SETOPT(option, value) \
@@ -1714,12 +1844,18 @@ nserror fetch_curl_register(void)
 	if (mcode != CURLM_OK)						\
 		goto curl_multi_setopt_failed;
 
+#if LIBCURL_VERSION_NUM >= 0x071e00
+		/* built against 7.30.0 or later: configure caching */
 		SETOPT(CURLMOPT_MAXCONNECTS, maxconnects);
 		SETOPT(CURLMOPT_MAX_TOTAL_CONNECTIONS, maxconnects);
 		SETOPT(CURLMOPT_MAX_HOST_CONNECTIONS, nsoption_int(max_fetchers_per_host));
-	}
 #endif
 
+		/* sockets and timeouts for event driven operation */
+		SETOPT(CURLMOPT_SOCKETFUNCTION, fetch_curl_socket_callback);
+		SETOPT(CURLMOPT_TIMERFUNCTION, fetch_curl_timer_callback);
+	}
+
 	/* Create a curl easy handle with the options that are common to all
 	 *  fetches.
 	 */
@@ -1826,9 +1962,7 @@ curl_easy_setopt_failed:
 	NSLOG(netsurf, INFO, "curl_easy_setopt failed.");
 	return NSERROR_INIT_FAILED;
 
-#if LIBCURL_VERSION_NUM >= 0x071e00
 curl_multi_setopt_failed:
 	NSLOG(netsurf, INFO, "curl_multi_setopt failed.");
 	return NSERROR_INIT_FAILED;
-#endif
 }
@@ -25,14 +25,33 @@
  * \todo Consider improving eviction sorting to include objects size
  *         and remaining lifetime and other cost metrics.
  *
- * \todo Implement mmap retrieval where supported.
- *
  * \todo Implement static retrieval for metadata objects as their heap
  *         lifetime is typically very short, though this may be obsoleted
  *         by a small object storage strategy.
  *
+ * When built with thread support the writes to disc are performed by
+ * a writer thread. All entry and block bookkeeping remains on the
+ * main thread, the writer is handed a reference to the element data
+ * through a bounded queue and the reference is released on the main
+ * thread once the write has completed.
+ *
+ * Data elements which need a digest or compressing are first queued
+ * to the writer to be prepared. The entry holds no storage while the
+ * preparation is outstanding, it is allocated (or shared) on the main
+ * thread when the preparation is retired and the write then queued.
+ *
+ * Data elements the cache indicates are compressible are stored
+ * deflated when that makes them usefully smaller. Element data held
+ * in memory is always the decoded data.
+ *
+ * When deduplication is enabled the data element of an entry is
+ * content addressed. Entries whose data has an identical digest
+ * reference a single shared copy on disc which is only removed once
+ * no entries reference it.
  */
 
+#include "utils/config.h"
+
 #include <unistd.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -41,7 +60,15 @@
 #include <errno.h>
 #include <time.h>
 #include <stdlib.h>
+#include <zlib.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
 #include <nsutils/unistd.h>
+#include <nsutils/time.h>
 
 #include "netsurf/inttypes.h"
 #include "utils/filepath.h"
@@ -50,13 +77,18 @@
 #include "utils/log.h"
 #include "utils/messages.h"
 #include "utils/hashmap.h"
+#include "utils/sha256.h"
 #include "desktop/gui_internal.h"
 #include "netsurf/misc.h"
 
 #include "content/backing_store.h"
 
 /** Backing store file format version */
-#define CONTROL_VERSION 202
+#define CONTROL_VERSION 204
+
+/** Earlier backing store file format versions whose entries are migrated */
+#define CONTROL_VERSION_V203 203
+#define CONTROL_VERSION_V202 202
 
 /**
  * Number of milliseconds after a update before control data
@@ -88,6 +120,18 @@
 /** length in bytes of a block files use map */
 #define BLOCK_USE_MAP_SIZE (1 << (BLOCK_ENTRY_COUNT - 3))
 
+/** number of writes which may be queued for the writer (power of 2) */
+#define WRITE_QUEUE_LENGTH 64
+
+/** time in ms between checks for completed writes */
+#define WRITE_RETIRE_TIME 100
+
+/** smallest element data size considered for compression */
+#define COMPRESS_MIN_SIZE 1024
+
+/** zlib compression level, favouring speed as stores may be on the main thread */
+#define COMPRESS_LEVEL Z_BEST_SPEED
+
 /**
  * The type used to store index values referring to store entries. Care
  * must be taken with this type as it is used to build address to
@@ -133,8 +177,15 @@ enum store_entry_elem_flags {
 	ENTRY_ELEM_FLAG_MMAP = 0x2,
 	/** entry data allocation is in small object pool */
 	ENTRY_ELEM_FLAG_SMALL = 0x4,
+	/** entry data is content addressed and may be shared */
+	ENTRY_ELEM_FLAG_SHARED = 0x8,
+	/** entry data is stored on disc deflated with zlib */
+	ENTRY_ELEM_FLAG_DEFLATE = 0x10,
 };
 
+/** element index used to name content addressed data files */
+#define SHARED_ELEM_IDX (ENTRY_ELEM_COUNT * 2)
+
 
 enum store_entry_flags {
 	/** entry is normal */
@@ -179,6 +230,53 @@ struct store_entry {
 	uint8_t flags; /**< entry flags */
 	/** Entry element (data or meta) specific information */
 	struct store_entry_element elem[ENTRY_ELEM_COUNT];
+	/** digest of the data element if it is shared */
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	/** decoded size of the data element if it is compressed */
+	uint32_t length;
+};
+
+/**
+ * Backing store object index entry as serialised by control version 203.
+ */
+struct store_entry_v203 {
+	nsurl *url; /**< The URL for this entry */
+	int64_t last_used; /**< UNIX time the entry was last used */
+	uint16_t use_count; /**< number of times this entry has been accessed */
+	uint8_t flags; /**< entry flags */
+	/** Entry element (data or meta) specific information */
+	struct store_entry_element elem[ENTRY_ELEM_COUNT];
+	/** digest of the data element if it is shared */
+	uint8_t digest[SHA256_DIGEST_SIZE];
+};
+
+/**
+ * Backing store object index entry as serialised by control version 202.
+ */
+struct store_entry_v202 {
+	nsurl *url; /**< The URL for this entry */
+	int64_t last_used; /**< UNIX time the entry was last used */
+	uint16_t use_count; /**< number of times this entry has been accessed */
+	uint8_t flags; /**< entry flags */
+	/** Entry element (data or meta) specific information */
+	struct store_entry_element elem[ENTRY_ELEM_COUNT];
+};
+
+/**
+ * Content addressed data shared between entries.
+ *
+ * The size and block are duplicated in the data element of every
+ * entry referencing the shared data so the element may be read in
+ * the same way as unshared data.
+ */
+struct store_data {
+	uint8_t digest[SHA256_DIGEST_SIZE]; /**< digest of the data */
+	uint32_t size; /**< size of data on disc */
+	uint32_t length; /**< decoded size of data if it is compressed */
+	uint32_t refs; /**< number of entries referencing the data */
+	block_index_t block; /**< small object data block */
+	uint8_t codec; /**< element flags recording how the data is encoded */
+	bool pending; /**< data is not yet completely written to disc */
 };
 
 /**
@@ -187,10 +285,65 @@ struct store_entry {
 struct block_file {
 	/** file descriptor of the block file */
 	int fd;
+	/** read only mapping of the whole block file or NULL */
+	uint8_t *map;
 	/** map of used and unused entries within the block file */
 	uint8_t use_map[BLOCK_USE_MAP_SIZE];
 };
 
+/**
+ * Write of an entry element to disc.
+ *
+ * A job may instead prepare the data element of an entry, computing
+ * its digest and compressed form off the main thread. Storage for the
+ * element is allocated and its write queued when that job retires.
+ */
+struct store_write_job {
+	struct store_entry *bse; /**< entry being written (main thread only) */
+	int elem_idx; /**< element of the entry being written */
+	bool prepare; /**< prepare the element rather than write it */
+	bool digest; /**< preparation computes the digest of the data */
+	bool compress; /**< preparation compresses the data */
+	uint8_t digest_out[SHA256_DIGEST_SIZE]; /**< prepared digest */
+	int fd; /**< block file descriptor or -1 to write fname */
+	char *fname; /**< name of file to write if not in a block file */
+	const uint8_t *data; /**< data to write */
+	uint8_t *encoded; /**< encoded data owned by the job or NULL */
+	size_t size; /**< size of data to write */
+	off_t offset; /**< offset within block file */
+	nserror res; /**< result of the write */
+	int err; /**< errno if the write failed */
+	uint64_t elapsed; /**< time in ms the write took */
+};
+
+/**
+ * Writer thread state.
+ *
+ * Jobs are added at tail by the main thread, written in order by the
+ * writer thread which advances done and then retired on the main
+ * thread which advances retire. The indexes increase monotonically and
+ * are reduced modulo the queue length to index the job array.
+ */
+struct store_writer {
+#ifdef WITH_PTHREAD
+	pthread_t thread; /**< the writer thread */
+	pthread_mutex_t lock; /**< protects done, tail and quit */
+	pthread_cond_t cond; /**< signalled when jobs are added or on quit */
+#endif
+	bool running; /**< the writer thread has been started */
+	bool quit; /**< writer thread should exit once the queue is empty */
+	unsigned int retire; /**< next job to retire */
+	unsigned int done; /**< next job to write */
+	unsigned int tail; /**< next free job */
+	struct store_write_job job[WRITE_QUEUE_LENGTH]; /**< job queue */
+
+	uint64_t written; /**< total bytes written by the writer */
+	uint64_t elapsed; /**< total ms spent writing */
+	size_t failed; /**< number of failed writes */
+	size_t prepared; /**< number of elements prepared by the writer */
+	uint64_t prepare_elapsed; /**< total ms spent preparing elements */
+};
+
 /**
  * log2 of block size.
  */
@@ -207,12 +360,21 @@ struct store_state {
 	char *path; /**< The path to the backing store */
 	size_t limit; /**< The backing store upper bound target size */
 	size_t hysteresis; /**< The hysteresis around the target size */
+	bool dedup; /**< Store data content addressed */
+
+	/** control file version the store was read from */
+	unsigned int control_version;
 
 	/**
 	 * The cache object hash
 	 */
 	hashmap_t *entries;
 
+	/**
+	 * The shared data hash
+	 */
+	hashmap_t *shared;
+
 	/** flag indicating if the entries have been made persistent
 	 * since they were last changed.
 	 */
@@ -231,6 +393,9 @@ struct store_state {
 	 */
 	bool blocks_opened;
 
+	/** writer performing disc writes */
+	struct store_writer writer;
+
 
 	/* stats */
 	uint64_t total_alloc; /**< total size of all allocated storage. */
@@ -238,6 +403,11 @@ struct store_state {
 	size_t hit_count; /**< number of cache hits */
 	uint64_t hit_size; /**< size of storage served */
 	size_t miss_count; /**< number of cache misses */
+	size_t map_count; /**< number of hits served from a mapping */
+	size_t dedup_count; /**< number of stores satisfied by shared data */
+	uint64_t dedup_size; /**< size of stores satisfied by shared data */
+	uint64_t deflate_in; /**< decoded size of data stored compressed */
+	uint64_t deflate_out; /**< size on disc of data stored compressed */
 
 };
 
@@ -288,6 +458,69 @@ static hashmap_parameters_t entries_hashmap_parameters = {
 	.value_destroy = entries_hashmap_value_destroy,
 };
 
+/* Shared data hashmap parameters
+ *
+ * Our hashmap has digest keys and store_data values
+ */
+
+/**
+ * Extract an identifier from a digest.
+ *
+ * \param digest The digest to use.
+ * \param word The index of the 32 bit word within the digest.
+ * \return The identifier.
+ */
+static inline entry_ident_t digest_ident(const uint8_t *digest, int word)
+{
+	digest += word * 4;
+	return ((entry_ident_t)digest[0] << 24) |
+		((entry_ident_t)digest[1] << 16) |
+		((entry_ident_t)digest[2] << 8) |
+		((entry_ident_t)digest[3]);
+}
+
+static void *
+shared_hashmap_key_clone(void *key)
+{
+	uint8_t *digest = malloc(SHA256_DIGEST_SIZE);
+	if (digest != NULL) {
+		memcpy(digest, key, SHA256_DIGEST_SIZE);
+	}
+	return digest;
+}
+
+static uint32_t
+shared_hashmap_key_hash(void *key)
+{
+	/* the digest is already uniformly distributed */
+	return digest_ident(key, 0);
+}
+
+static bool
+shared_hashmap_key_eq(void *key1, void *key2)
+{
+	return memcmp(key1, key2, SHA256_DIGEST_SIZE) == 0;
+}
+
+static void *
+shared_hashmap_value_alloc(void *key)
+{
+	struct store_data *sd = calloc(1, sizeof(struct store_data));
+	if (sd != NULL) {
+		memcpy(sd->digest, key, SHA256_DIGEST_SIZE);
+	}
+	return sd;
+}
+
+static hashmap_parameters_t shared_hashmap_parameters = {
+	.key_clone = shared_hashmap_key_clone,
+	.key_destroy = free,
+	.key_hash = shared_hashmap_key_hash,
+	.key_eq = shared_hashmap_key_eq,
+	.value_alloc = shared_hashmap_value_alloc,
+	.value_destroy = free,
+};
+
 /**
  * Generate a filename for an object.
  *
@@ -319,15 +552,21 @@ static hashmap_parameters_t entries_hashmap_parameters = {
  * but resulted in requiring an extra level of directory which is less
  * desirable than the three extra characters using six bits.
  *
+ * Content addressed data files use separate identifiers for the
+ * directories and the leaf name so 62 bits of the digest are
+ * represented in the path.
+ *
  * @param state The store state to use.
- * @param ident The identifier to use.
+ * @param dident The identifier to use for the directories.
+ * @param ident The identifier to use for the leaf name.
  * @param elem_idx The element index.
  * @return The filename string or NULL on allocation error.
  */
 static char *
-store_fname(struct store_state *state,
-	    entry_ident_t ident,
-	    int elem_idx)
+store_mkfname(struct store_state *state,
+	      entry_ident_t dident,
+	      entry_ident_t ident,
+	      int elem_idx)
 {
 	char *fname = NULL;
 	uint8_t b32u_i[8]; /* base32 encoded ident */
@@ -335,7 +574,7 @@ store_fname(struct store_state *state,
 
 	/* directories used to separate elements */
 	const char *base_dir_table[] = {
-		"d", "m", "dblk", "mblk"
+		"d", "m", "dblk", "mblk", "s"
 	};
 
 	/* RFC4648 base32 encoding table (six bits) */
@@ -386,15 +625,16 @@ store_fname(struct store_state *state,
 
 	/* base32 encode directory separators */
 	b32u_d[0] = (uint8_t*)base_dir_table[elem_idx];
-	b32u_d[1] = &encoding_table[(ident      ) & 0x3f][0];
-	b32u_d[2] = &encoding_table[(ident >>  6) & 0x3f][0];
-	b32u_d[3] = &encoding_table[(ident >> 12) & 0x3f][0];
-	b32u_d[4] = &encoding_table[(ident >> 18) & 0x3f][0];
-	b32u_d[5] = &encoding_table[(ident >> 24) & 0x3f][0];
+	b32u_d[1] = &encoding_table[(dident      ) & 0x3f][0];
+	b32u_d[2] = &encoding_table[(dident >>  6) & 0x3f][0];
+	b32u_d[3] = &encoding_table[(dident >> 12) & 0x3f][0];
+	b32u_d[4] = &encoding_table[(dident >> 18) & 0x3f][0];
+	b32u_d[5] = &encoding_table[(dident >> 24) & 0x3f][0];
 
 	switch (elem_idx) {
 	case ENTRY_ELEM_DATA:
 	case ENTRY_ELEM_META:
+	case SHARED_ELEM_IDX:
 		netsurf_mkpath(&fname, NULL, 8,
 			       state->path, b32u_d[0], b32u_d[1], b32u_d[2],
 			       b32u_d[3], b32u_d[4], b32u_d[5], b32u_i);
@@ -414,6 +654,113 @@ store_fname(struct store_state *state,
 	return fname;
 }
 
+/**
+ * Generate a filename for an object from a single identifier.
+ *
+ * @param state The store state to use.
+ * @param ident The identifier to use.
+ * @param elem_idx The element index.
+ * @return The filename string or NULL on allocation error.
+ */
+static inline char *
+store_fname(struct store_state *state,
+	    entry_ident_t ident,
+	    int elem_idx)
+{
+	return store_mkfname(state, ident, ident, elem_idx);
+}
+
+/**
+ * Generate the filename for an element of an entry.
+ *
+ * @param state The store state to use.
+ * @param bse The entry to generate the filename for.
+ * @param elem_idx The element index.
+ * @return The filename string or NULL on allocation error.
+ */
+static char *
+store_elem_fname(struct store_state *state,
+		 struct store_entry *bse,
+		 int elem_idx)
+{
+	if ((bse->elem[elem_idx].flags & ENTRY_ELEM_FLAG_SHARED) != 0) {
+		return store_mkfname(state,
+				     digest_ident(bse->digest, 0),
+				     digest_ident(bse->digest, 1),
+				     SHARED_ELEM_IDX);
+	}
+	return store_fname(state, nsurl_hash(bse->url), elem_idx);
+}
+
+/**
+ * Release a small block.
+ *
+ * @param state The store state to use.
+ * @param elem_idx The element index of the block.
+ * @param block The block to release.
+ */
+static void
+release_block(struct store_state *state, int elem_idx, block_index_t block)
+{
+	block_index_t bf;
+	block_index_t bi;
+
+	/* block file block resides in */
+	bf = (block >> BLOCK_ENTRY_COUNT) & ((1 << BLOCK_FILE_COUNT) - 1);
+
+	/* block index in file */
+	bi = block & ((1U << BLOCK_ENTRY_COUNT) -1);
+
+	/* clear bit in use map */
+	state->blocks[elem_idx][bf].use_map[bi >> 3] &= ~(1U << (bi & 7));
+	state->blocks_dirty = true;
+}
+
+/**
+ * Drop the reference an entry holds on its shared data.
+ *
+ * The shared data storage is released once no entries reference it.
+ *
+ * @param state The store state to use.
+ * @param bse The entry referencing shared data.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror
+release_shared(struct store_state *state, struct store_entry *bse)
+{
+	struct store_data *sd;
+	char *fname;
+
+	sd = hashmap_lookup(state->shared, bse->digest);
+	if (sd == NULL) {
+		NSLOG(netsurf, ERROR, "shared data for %s missing",
+		      nsurl_access(bse->url));
+		return NSERROR_NOT_FOUND;
+	}
+
+	sd->refs--;
+	if (sd->refs > 0) {
+		return NSERROR_OK;
+	}
+
+	if (sd->block != 0) {
+		release_block(state, ENTRY_ELEM_DATA, sd->block);
+	} else {
+		fname = store_elem_fname(state, bse, ENTRY_ELEM_DATA);
+		if (fname == NULL) {
+			return NSERROR_NOMEM;
+		}
+		unlink(fname);
+		free(fname);
+	}
+
+	state->total_alloc -= sd->size;
+
+	hashmap_remove(state->shared, bse->digest);
+
+	return NSERROR_OK;
+}
+
 /**
  * invalidate an element of an entry
  *
@@ -427,19 +774,17 @@ invalidate_element(struct store_state *state,
 		   struct store_entry *bse,
 		   int elem_idx)
 {
-	if (bse->elem[elem_idx].block != 0) {
-		block_index_t bf;
-		block_index_t bi;
-
-		/* block file block resides in */
-		bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
-			((1 << BLOCK_FILE_COUNT) - 1);
+	nserror ret;
 
-		/* block index in file */
-		bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1);
+	if ((bse->elem[elem_idx].flags & ENTRY_ELEM_FLAG_SHARED) != 0) {
+		/* shared data accounts for its own storage */
+		ret = release_shared(state, bse);
+		bse->elem[elem_idx].flags &= ~ENTRY_ELEM_FLAG_SHARED;
+		return ret;
+	}
 
-		/* clear bit in use map */
-		state->blocks[elem_idx][bf].use_map[bi >> 3] &= ~(1U << (bi & 7));
+	if (bse->elem[elem_idx].block != 0) {
+		release_block(state, elem_idx, bse->elem[elem_idx].block);
 	} else {
 		char *fname;
 
@@ -506,6 +851,9 @@ invalidate_entry(struct store_state *state, struct store_entry *bse)
 }
 
 
+/** element flags indicating the store is managing an allocation */
+#define ENTRY_ELEM_FLAG_ALLOC (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)
+
 /**
  * Quick sort comparison.
  */
@@ -513,24 +861,30 @@ static int compar(const void *va, const void *vb)
 {
 	const struct store_entry *a = *(const struct store_entry **)va;
 	const struct store_entry *b = *(const struct store_entry **)vb;
+	uint8_t aflags;
+	uint8_t bflags;
 
 	/* consider the allocation flags - if an entry has an
 	 * allocation it is considered more valuable as it cannot be
 	 * freed.
 	 */
-	if ((a->elem[ENTRY_ELEM_DATA].flags == ENTRY_ELEM_FLAG_NONE) &&
-	    (b->elem[ENTRY_ELEM_DATA].flags != ENTRY_ELEM_FLAG_NONE)) {
+	aflags = a->elem[ENTRY_ELEM_DATA].flags & ENTRY_ELEM_FLAG_ALLOC;
+	bflags = b->elem[ENTRY_ELEM_DATA].flags & ENTRY_ELEM_FLAG_ALLOC;
+	if ((aflags == ENTRY_ELEM_FLAG_NONE) &&
+	    (bflags != ENTRY_ELEM_FLAG_NONE)) {
 		return -1;
-	} else if ((a->elem[ENTRY_ELEM_DATA].flags != ENTRY_ELEM_FLAG_NONE) &&
-		   (b->elem[ENTRY_ELEM_DATA].flags == ENTRY_ELEM_FLAG_NONE)) {
+	} else if ((aflags != ENTRY_ELEM_FLAG_NONE) &&
+		   (bflags == ENTRY_ELEM_FLAG_NONE)) {
 		return 1;
 	}
 
-	if ((a->elem[ENTRY_ELEM_META].flags == ENTRY_ELEM_FLAG_NONE) &&
-	    (b->elem[ENTRY_ELEM_META].flags != ENTRY_ELEM_FLAG_NONE)) {
+	aflags = a->elem[ENTRY_ELEM_META].flags & ENTRY_ELEM_FLAG_ALLOC;
+	bflags = b->elem[ENTRY_ELEM_META].flags & ENTRY_ELEM_FLAG_ALLOC;
+	if ((aflags == ENTRY_ELEM_FLAG_NONE) &&
+	    (bflags != ENTRY_ELEM_FLAG_NONE)) {
 		return -1;
-	} else if ((a->elem[ENTRY_ELEM_META].flags != ENTRY_ELEM_FLAG_NONE) &&
-		   (b->elem[ENTRY_ELEM_META].flags == ENTRY_ELEM_FLAG_NONE)) {
+	} else if ((aflags != ENTRY_ELEM_FLAG_NONE) &&
+		   (bflags == ENTRY_ELEM_FLAG_NONE)) {
 		return 1;
 	}
 
@@ -551,6 +905,35 @@ static int compar(const void *va, const void *vb)
 	return 0;
 }
 
+/**
+ * Size of storage released by invalidating an entry.
+ *
+ * Shared data is only released when the last entry referencing it
+ * is invalidated.
+ *
+ * @param state The store state to use.
+ * @param bse The entry to size.
+ * @return The number of bytes which would be released.
+ */
+static size_t entry_release_size(struct store_state *state, struct store_entry *bse)
+{
+	struct store_data *sd;
+	size_t size;
+
+	size = bse->elem[ENTRY_ELEM_META].size;
+
+	if ((bse->elem[ENTRY_ELEM_DATA].flags & ENTRY_ELEM_FLAG_SHARED) != 0) {
+		sd = hashmap_lookup(state->shared, bse->digest);
+		if ((sd != NULL) && (sd->refs == 1)) {
+			size += sd->size;
+		}
+	} else {
+		size += bse->elem[ENTRY_ELEM_DATA].size;
+	}
+
+	return size;
+}
+
 typedef struct {
 	struct store_entry **elist;
 	size_t ent_count;
@@ -628,8 +1011,7 @@ static nserror store_evict(struct store_state *state)
 	for (ent = 0; ent < estate.ent_count; ent++) {
 		struct store_entry *bse = estate.elist[ent];
 
-		removed += bse->elem[ENTRY_ELEM_DATA].size;
-		removed += bse->elem[ENTRY_ELEM_META].size;
+		removed += entry_release_size(state, bse);
 
 		ret = invalidate_entry(state, bse);
 		if (ret != NSERROR_OK) {
@@ -966,103 +1348,403 @@ static block_index_t alloc_block(struct store_state *state, int elem_idx)
 }
 
 /**
- * Set a backing store entry in the entry table from a url.
+ * Compress element data for storage on disc.
  *
- * This creates a backing store entry in the entry table for a url.
+ * Does not touch the store state so may be called on the writer thread.
  *
- * @param state The store state to use.
- * @param url The value used as the unique key to search entries for.
- * @param elem_idx The index of the entry element to use.
- * @param data The data to store
- * @param datalen The length of data in \a data
- * @param bse Pointer used to return value.
- * @return NSERROR_OK and \a bse updated on success or NSERROR_NOT_FOUND
- *         if no entry corresponds to the url.
+ * @param data The data to compress.
+ * @param size The size of the data.
+ * @param enclen Updated with the size of the compressed data.
+ * @return The compressed data or NULL if compression is not usefully
+ *         smaller or fails.
  */
-static nserror
-set_store_entry(struct store_state *state,
-		nsurl *url,
-		int elem_idx,
-		uint8_t *data,
-		const size_t datalen,
-		struct store_entry **bse)
+static uint8_t *
+deflate_data(const uint8_t *data, uint32_t size, uLongf *enclen)
 {
-	struct store_entry *se;
-	nserror ret;
-	struct store_entry_element *elem;
-
-	NSLOG(netsurf, DEBUG, "url:%s", nsurl_access(url));
+	uint8_t *enc;
 
-	/* evict entries as required and ensure there is at least one
-	 * new entry available.
-	 */
-	ret = store_evict(state);
-	if (ret != NSERROR_OK) {
-		return ret;
-	}
-
-	se = hashmap_lookup(state->entries, url);
-	if (se == NULL) {
-		se = hashmap_insert(state->entries, url);
-	}
-	if (se == NULL) {
-		return NSERROR_NOMEM;
+	/* compression must save at least an eighth to be worthwhile */
+	*enclen = size - (size / 8);
+	enc = malloc(*enclen);
+	if (enc == NULL) {
+		return NULL;
 	}
 
-	/* the entry element */
-	elem = &se->elem[elem_idx];
-
-	/* check if the element has storage already allocated */
-	if ((elem->flags & (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) {
-		/* this entry cannot be removed as it has associated
-		 * allocation.
-		 */
-		NSLOG(netsurf, ERROR,
-		      "attempt to overwrite entry with in use data");
-		return NSERROR_PERMISSION;
+	if (compress2(enc, enclen, data, size, COMPRESS_LEVEL) != Z_OK) {
+		/* the compressed data does not fit */
+		free(enc);
+		return NULL;
 	}
 
-	/* set the common entry data */
-	se->use_count = 1;
-	se->last_used = time(NULL);
-
-	/* store the data in the element */
-	elem->flags |= ENTRY_ELEM_FLAG_HEAP;
-	elem->data = data;
-	elem->ref = 1;
+	return enc;
+}
 
-	/* account for size of entry element */
-	state->total_alloc -= elem->size;
-	elem->size = datalen;
-	state->total_alloc += elem->size;
+/**
+ * Record that the data element of an entry is stored compressed.
+ *
+ * The element data in memory remains decoded.
+ *
+ * @param state The store state to use.
+ * @param bse The entry with the data element.
+ * @param enc The compressed data or NULL if it is stored decoded.
+ * @param enclen The size of the compressed data.
+ */
+static void
+deflate_element(struct store_state *state,
+		struct store_entry *bse,
+		uint8_t *enc,
+		uLongf enclen)
+{
+	struct store_entry_element *elem = &bse->elem[ENTRY_ELEM_DATA];
 
-	/* if the element will fit in a small block attempt to allocate one */
-	if (elem->size <= (1U << log2_block_size[elem_idx])) {
-		elem->block = alloc_block(state, elem_idx);
+	if (enc == NULL) {
+		return;
 	}
 
-	/* ensure control maintenance scheduled. */
-	state->entries_dirty = true;
-	guit->misc->schedule(CONTROL_MAINT_TIME, control_maintenance, state);
+	NSLOG(netsurf, DEBUG, "Compressed %"PRIu32" bytes to %lu",
+	      elem->size, (unsigned long)enclen);
 
-	*bse = se;
+	state->deflate_in += elem->size;
+	state->deflate_out += enclen;
 
-	return NSERROR_OK;
+	bse->length = elem->size;
+	elem->size = enclen;
+	elem->flags |= ENTRY_ELEM_FLAG_DEFLATE;
 }
 
-
 /**
- * Open a file using a store ident.
+ * Share the data element of an entry with entries of identical content.
+ *
+ * The digest of the element data, which must already be in the entry,
+ * is used to find identical data already in the store which is
+ * referenced instead of being stored again. If there is no identical
+ * data new shared data is created for the element.
+ *
+ * Identical data whose write has not yet completed is not shared so
+ * a failed write cannot affect other entries.
  *
  * @param state The store state to use.
- * @param ident The identifier to open file for.
- * @param elem_idx The element within the store entry to open. The
- *                 value should be be one of the values in the
- *                 store_entry_elem_idx enum. Additionally it may have
- *                 ENTRY_ELEM_COUNT added to it to indicate block file
- *                 names.
- * @param openflags The flags used with the open call.
- * @return An fd from the open call or -1 on error.
+ * @param bse The entry with the data element to share.
+ * @param compress true if new shared data should be compressed here.
+ * @param encoded The compressed data if that has already been made,
+ *                updated with the compressed data if new shared data
+ *                is stored compressed. Freed if the data is present.
+ * @param enclen The size of the compressed data.
+ * @param present Updated to true if identical data is already on disc.
+ * @return true if the element is shared or false if it must be
+ *         stored separately.
+ */
+static bool
+share_store_data(struct store_state *state,
+		 struct store_entry *bse,
+		 bool compress,
+		 uint8_t **encoded,
+		 uLongf *enclen,
+		 bool *present)
+{
+	struct store_entry_element *elem = &bse->elem[ENTRY_ELEM_DATA];
+	struct store_data *sd;
+	uint32_t length;
+
+	sd = hashmap_lookup(state->shared, bse->digest);
+	if (sd != NULL) {
+		if (sd->codec != ENTRY_ELEM_FLAG_NONE) {
+			length = sd->length;
+		} else {
+			length = sd->size;
+		}
+		if ((sd->pending) || (length != elem->size)) {
+			return false;
+		}
+
+		NSLOG(netsurf, DEBUG, "%s shares %"PRIu32" bytes with %"PRIu32" entries",
+		      nsurl_access(bse->url), sd->size, sd->refs);
+
+		sd->refs++;
+		elem->size = sd->size;
+		elem->block = sd->block;
+		elem->flags |= ENTRY_ELEM_FLAG_SHARED | sd->codec;
+		bse->length = sd->length;
+
+		state->dedup_count++;
+		state->dedup_size += sd->size;
+
+		free(*encoded);
+		*encoded = NULL;
+		*present = true;
+		return true;
+	}
+
+	sd = hashmap_insert(state->shared, bse->digest);
+	if (sd == NULL) {
+		return false;
+	}
+
+	if (compress) {
+		*encoded = deflate_data(elem->data, elem->size, enclen);
+	}
+	deflate_element(state, bse, *encoded, *enclen);
+
+	sd->size = elem->size;
+	sd->length = bse->length;
+	sd->codec = elem->flags & ENTRY_ELEM_FLAG_DEFLATE;
+	sd->refs = 1;
+	sd->pending = true;
+
+	/* if the data will fit in a small block attempt to allocate one */
+	if (sd->size <= (1U << log2_block_size[ENTRY_ELEM_DATA])) {
+		sd->block = alloc_block(state, ENTRY_ELEM_DATA);
+	}
+
+	state->total_alloc += sd->size;
+
+	elem->block = sd->block;
+	elem->flags |= ENTRY_ELEM_FLAG_SHARED;
+
+	return true;
+}
+
+/**
+ * Mark the shared data of an entry as completely written to disc.
+ *
+ * @param state The store state to use.
+ * @param bse The entry which was written.
+ * @param elem_idx The element index which was written.
+ */
+static void
+shared_store_data_written(struct store_state *state,
+			  struct store_entry *bse,
+			  int elem_idx)
+{
+	struct store_data *sd;
+
+	if ((bse->elem[elem_idx].flags & ENTRY_ELEM_FLAG_SHARED) == 0) {
+		return;
+	}
+
+	sd = hashmap_lookup(state->shared, bse->digest);
+	if (sd != NULL) {
+		sd->pending = false;
+	}
+}
+
+/**
+ * Allocate storage for an element of an entry.
+ *
+ * The data element is shared with identical data when deduplication
+ * is enabled, which needs the digest of the data in the entry.
+ *
+ * @param state The store state to use.
+ * @param bse The entry with the element.
+ * @param elem_idx The element index within the entry.
+ * @param compress true if the data should be compressed here.
+ * @param encoded The compressed data if that has already been made,
+ *                updated with the compressed data to write or NULL if
+ *                the data is written unencoded.
+ * @param enclen The size of the data in \a encoded.
+ * @param present Updated to true if the data is already on disc.
+ */
+static void
+alloc_store_element(struct store_state *state,
+		    struct store_entry *bse,
+		    int elem_idx,
+		    bool compress,
+		    uint8_t **encoded,
+		    uLongf enclen,
+		    bool *present)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+
+	*present = false;
+	if ((elem_idx == ENTRY_ELEM_DATA) &&
+	    (state->dedup) &&
+	    (share_store_data(state, bse, compress,
+			      encoded, &enclen, present))) {
+		return;
+	}
+
+	if (compress) {
+		*encoded = deflate_data(elem->data, elem->size, &enclen);
+	}
+	if (elem_idx == ENTRY_ELEM_DATA) {
+		deflate_element(state, bse, *encoded, enclen);
+	}
+
+	/* account for size of entry element */
+	state->total_alloc += elem->size;
+
+	/* if the element will fit in a small block attempt to
+	 * allocate one
+	 */
+	if (elem->size <= (1U << log2_block_size[elem_idx])) {
+		elem->block = alloc_block(state, elem_idx);
+	}
+}
+
+/**
+ * Set a backing store entry in the entry table from a url.
+ *
+ * This creates a backing store entry in the entry table for a url.
+ *
+ * @param state The store state to use.
+ * @param url The value used as the unique key to search entries for.
+ * @param elem_idx The index of the entry element to use.
+ * @param data The data to store
+ * @param datalen The length of data in \a data
+ * @param compress true if the data should be compressed on disc.
+ * @param prepare true to leave digesting, compressing and allocating
+ *                storage for the element to store_element_prepared().
+ * @param bse Pointer used to return value.
+ * @param encoded Updated with the compressed data to write or NULL if
+ *                the data is written unencoded.
+ * @param present Updated to true if the data is already on disc.
+ * @return NSERROR_OK and \a bse updated on success or NSERROR_NOT_FOUND
+ *         if no entry corresponds to the url.
+ */
+static nserror
+set_store_entry(struct store_state *state,
+		nsurl *url,
+		int elem_idx,
+		uint8_t *data,
+		const size_t datalen,
+		bool compress,
+		bool prepare,
+		struct store_entry **bse,
+		uint8_t **encoded,
+		bool *present)
+{
+	struct store_entry *se;
+	nserror ret;
+	struct store_entry_element *elem;
+
+	NSLOG(netsurf, DEBUG, "url:%s", nsurl_access(url));
+
+	/* evict entries as required and ensure there is at least one
+	 * new entry available.
+	 */
+	ret = store_evict(state);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
+
+	se = hashmap_lookup(state->entries, url);
+	if (se == NULL) {
+		se = hashmap_insert(state->entries, url);
+	}
+	if (se == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	/* the entry element */
+	elem = &se->elem[elem_idx];
+
+	/* check if the element has storage already allocated */
+	if ((elem->flags & (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) {
+		/* this entry cannot be removed as it has associated
+		 * allocation.
+		 */
+		NSLOG(netsurf, ERROR,
+		      "attempt to overwrite entry with in use data");
+		return NSERROR_PERMISSION;
+	}
+
+	/* release the storage of any previous element */
+	if ((elem->size != 0) ||
+	    (elem->block != 0) ||
+	    ((elem->flags & ENTRY_ELEM_FLAG_SHARED) != 0)) {
+		invalidate_element(state, se, elem_idx);
+		elem->size = 0;
+		elem->block = 0;
+	}
+	elem->flags &= ~ENTRY_ELEM_FLAG_DEFLATE;
+
+	/* set the common entry data */
+	se->use_count = 1;
+	se->last_used = time(NULL);
+
+	/* store the data in the element */
+	elem->flags |= ENTRY_ELEM_FLAG_HEAP;
+	elem->data = data;
+	elem->ref = 1;
+	elem->size = datalen;
+	if (elem_idx == ENTRY_ELEM_DATA) {
+		se->length = datalen;
+	}
+
+	*present = false;
+	*encoded = NULL;
+	if (prepare) {
+		/* account for the decoded size until the element is
+		 * prepared and its storage allocated
+		 */
+		state->total_alloc += elem->size;
+	} else {
+		if ((elem_idx == ENTRY_ELEM_DATA) && (state->dedup)) {
+			sha256(elem->data, elem->size, se->digest);
+		}
+		alloc_store_element(state, se, elem_idx, compress,
+				    encoded, 0, present);
+	}
+
+	/* ensure control maintenance scheduled. */
+	state->entries_dirty = true;
+	guit->misc->schedule(CONTROL_MAINT_TIME, control_maintenance, state);
+
+	*bse = se;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Open a store file.
+ *
+ * @param fname The filename to open, this is freed.
+ * @param openflags The flags used with the open call.
+ * @return An fd from the open call or -1 on error.
+ */
+static int
+store_open_fname(char *fname, int openflags)
+{
+	nserror ret;
+	int fd;
+
+	if (fname == NULL) {
+		NSLOG(netsurf, ERROR, "filename error");
+		return -1;
+	}
+
+	/* ensure all path elements to file exist if creating file */
+	if (openflags & O_CREAT) {
+		ret = netsurf_mkdir_all(fname);
+		if (ret != NSERROR_OK) {
+			NSLOG(netsurf, WARNING,
+			      "file path \"%s\" could not be created", fname);
+			free(fname);
+			return -1;
+		}
+	}
+
+	NSLOG(netsurf, DEBUG, "opening %s", fname);
+	fd = open(fname, openflags, S_IRUSR | S_IWUSR);
+
+	free(fname);
+
+	return fd;
+}
+
+/**
+ * Open a file using a store ident.
+ *
+ * @param state The store state to use.
+ * @param ident The identifier to open file for.
+ * @param elem_idx The element within the store entry to open. The
+ *                 value should be be one of the values in the
+ *                 store_entry_elem_idx enum. Additionally it may have
+ *                 ENTRY_ELEM_COUNT added to it to indicate block file
+ *                 names.
+ * @param openflags The flags used with the open call.
+ * @return An fd from the open call or -1 on error.
  */
 static int
 store_open(struct store_state *state,
@@ -1070,33 +1752,661 @@ store_open(struct store_state *state,
 	   int elem_idx,
 	   int openflags)
 {
-	char *fname;
-	nserror ret;
-	int fd;
+	return store_open_fname(store_fname(state, ident, elem_idx), openflags);
+}
+
+/**
+ * Open the file of an element of an entry.
+ *
+ * @param state The store state to use.
+ * @param bse The entry to open the file for.
+ * @param elem_idx The element within the store entry to open.
+ * @param openflags The flags used with the open call.
+ * @return An fd from the open call or -1 on error.
+ */
+static int
+store_open_elem(struct store_state *state,
+		struct store_entry *bse,
+		int elem_idx,
+		int openflags)
+{
+	return store_open_fname(store_elem_fname(state, bse, elem_idx),
+				openflags);
+}
+
+
+/**
+ * Ensure a block file is open.
+ *
+ * \param state The backing store state to use.
+ * \param elem_idx The element index of the block file.
+ * \param bf The block file index.
+ * \return The block file descriptor or -1 on error.
+ */
+static int
+open_block_file(struct store_state *state, int elem_idx, block_index_t bf)
+{
+	if (state->blocks[elem_idx][bf].fd == -1) {
+		state->blocks[elem_idx][bf].fd = store_open(state, bf,
+				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
+		if (state->blocks[elem_idx][bf].fd == -1) {
+			NSLOG(netsurf, ERROR, "Open failed errno %d", errno);
+			return -1;
+		}
+
+		/* flag that a block file has been opened */
+		state->blocks_opened = true;
+	}
+
+	return state->blocks[elem_idx][bf].fd;
+}
+
+
+/**
+ * Map a block file into memory.
+ *
+ * The whole extent of the block file is mapped read only once and
+ * remains mapped until the store is finalised. Writes to the block
+ * file through its descriptor are visible through the mapping.
+ *
+ * \param state The backing store state to use.
+ * \param elem_idx The element index of the block file.
+ * \param bf The block file index.
+ * \return The mapping or NULL if the block file could not be mapped.
+ */
+static uint8_t *
+map_block_file(struct store_state *state, int elem_idx, block_index_t bf)
+{
+#ifdef HAVE_MMAP
+	size_t extent = 1U << (log2_block_size[elem_idx] + BLOCK_ENTRY_COUNT);
+	void *map;
+	int fd;
+
+	if (state->blocks[elem_idx][bf].map != NULL) {
+		return state->blocks[elem_idx][bf].map;
+	}
+
+	fd = open_block_file(state, elem_idx, bf);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	/* the file must cover the whole mapping as accessing a
+	 * mapping beyond the end of the file faults.
+	 */
+	if (ftruncate(fd, extent) == -1) {
+		NSLOG(netsurf, ERROR, "Truncate failed errno:%d", errno);
+		return NULL;
+	}
+
+	map = mmap(NULL, extent, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		NSLOG(netsurf, WARNING, "Mapping block file %d:%d failed errno %d",
+		      elem_idx, bf, errno);
+		return NULL;
+	}
+
+	NSLOG(netsurf, DEBUG, "Mapped block file %d:%d at %p",
+	      elem_idx, bf, map);
+
+	state->blocks[elem_idx][bf].map = map;
+
+	return map;
+#else
+	return NULL;
+#endif
+}
+
+
+/**
+ * Remove a block file mapping.
+ *
+ * \param state The backing store state to use.
+ * \param elem_idx The element index of the block file.
+ * \param bf The block file index.
+ */
+static void
+unmap_block_file(struct store_state *state, int elem_idx, block_index_t bf)
+{
+#ifdef HAVE_MMAP
+	if (state->blocks[elem_idx][bf].map != NULL) {
+		munmap(state->blocks[elem_idx][bf].map,
+		       1U << (log2_block_size[elem_idx] + BLOCK_ENTRY_COUNT));
+		state->blocks[elem_idx][bf].map = NULL;
+	}
+#endif
+}
+
+
+/**
+ * release any allocation for an entry
+ */
+static nserror entry_release_alloc(struct store_entry_element *elem)
+{
+	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			NSLOG(netsurf, DEEPDEBUG, "freeing %p", elem->data);
+			free(elem->data);
+			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
+		}
+	} else if ((elem->flags & ENTRY_ELEM_FLAG_MMAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			/* the block file mapping is shared and persists */
+			NSLOG(netsurf, DEEPDEBUG, "releasing mapping %p",
+			      elem->data);
+			elem->data = NULL;
+			elem->flags &= ~ENTRY_ELEM_FLAG_MMAP;
+		}
+	}
+	return NSERROR_OK;
+}
+
+
+#ifdef WITH_PTHREAD
+/**
+ * Perform a queued preparation.
+ *
+ * Called on the writer thread so must not touch the store state.
+ *
+ * \param job The preparation to perform.
+ */
+static void store_prepare_job_run(struct store_write_job *job)
+{
+	uint64_t startms = 0;
+	uint64_t endms = 0;
+	uLongf enclen = 0;
+
+	nsu_getmonotonic_ms(&startms);
+
+	if (job->digest) {
+		sha256(job->data, job->size, job->digest_out);
+	}
+	if (job->compress) {
+		job->encoded = deflate_data(job->data, job->size, &enclen);
+		if (job->encoded != NULL) {
+			job->size = enclen;
+		}
+	}
+	job->res = NSERROR_OK;
+
+	nsu_getmonotonic_ms(&endms);
+	job->elapsed = endms - startms;
+}
+
+
+/**
+ * Perform a queued write.
+ *
+ * Called on the writer thread so must not touch the store state.
+ *
+ * \param job The write to perform.
+ */
+static void store_write_job_run(struct store_write_job *job)
+{
+	uint64_t startms = 0;
+	uint64_t endms = 0;
+	ssize_t wr;
+	int fd;
+
+	if (job->prepare) {
+		store_prepare_job_run(job);
+		return;
+	}
+
+	nsu_getmonotonic_ms(&startms);
+
+	if (job->fd != -1) {
+		wr = nsu_pwrite(job->fd, job->data, job->size, job->offset);
+	} else {
+		fd = open(job->fname, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+		if (fd == -1) {
+			job->err = errno;
+			job->res = NSERROR_SAVE_FAILED;
+			return;
+		}
+		wr = write(fd, job->data, job->size);
+		job->err = errno; /* close can change errno */
+		close(fd);
+	}
+
+	if (wr != (ssize_t)job->size) {
+		if (job->fd != -1) {
+			job->err = errno;
+		}
+		job->res = NSERROR_SAVE_FAILED;
+	} else {
+		job->res = NSERROR_OK;
+	}
+
+	nsu_getmonotonic_ms(&endms);
+	job->elapsed = endms - startms;
+}
+
+
+/**
+ * Writer thread.
+ *
+ * Writes queued jobs in order until asked to quit and the queue is
+ * empty.
+ *
+ * \param ctx The writer state.
+ * \return NULL
+ */
+static void *store_writer_thread(void *ctx)
+{
+	struct store_writer *writer = ctx;
+	struct store_write_job *job;
+
+	pthread_mutex_lock(&writer->lock);
+	for (;;) {
+		while ((writer->done == writer->tail) && (writer->quit == false)) {
+			pthread_cond_wait(&writer->cond, &writer->lock);
+		}
+		if (writer->done == writer->tail) {
+			/* queue is empty and quit requested */
+			break;
+		}
+		job = &writer->job[writer->done % WRITE_QUEUE_LENGTH];
+		pthread_mutex_unlock(&writer->lock);
+
+		store_write_job_run(job);
+
+		pthread_mutex_lock(&writer->lock);
+		writer->done++;
+	}
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+#endif
+
+
+/**
+ * Write an element of an entry whose storage has been allocated.
+ *
+ * Defined with store() as it falls back to the synchronous writes.
+ */
+static nserror
+store_write_element(struct store_state *state,
+		    struct store_entry *bse,
+		    int elem_idx,
+		    uint8_t *encoded);
+
+
+/**
+ * Complete the preparation of the data element of an entry.
+ *
+ * Storage is allocated for the element now that its digest and
+ * compressed size are known, and its write is queued.
+ *
+ * \param state The store state.
+ * \param bse The entry which was prepared.
+ * \param elem_idx The element index which was prepared.
+ * \param digest The digest of the element data.
+ * \param encoded The compressed element data or NULL.
+ * \param enclen The size of the compressed data.
+ */
+static void
+store_element_prepared(struct store_state *state,
+		       struct store_entry *bse,
+		       int elem_idx,
+		       const uint8_t *digest,
+		       uint8_t *encoded,
+		       uLongf enclen)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	bool present;
+
+	if ((bse->flags & ENTRY_FLAGS_INVALID) != 0) {
+		free(encoded);
+		return;
+	}
+
+	/* replace the decoded size accounted when the entry was set */
+	state->total_alloc -= elem->size;
+
+	memcpy(bse->digest, digest, SHA256_DIGEST_SIZE);
+	alloc_store_element(state, bse, elem_idx, false,
+			    &encoded, enclen, &present);
+	state->entries_dirty = true;
+
+	if (present) {
+		/* identical shared data is already on disc */
+		return;
+	}
+
+	if (store_write_element(state, bse, elem_idx, encoded) != NSERROR_OK) {
+		bse->flags |= ENTRY_FLAGS_INVALID;
+	}
+}
+
+
+/**
+ * Retire completed writes.
+ *
+ * The reference the write held on the element data is released and
+ * entries which failed to be written or were invalidated while the
+ * write was outstanding are invalidated. Completed preparations have
+ * their storage allocated and their write queued.
+ *
+ * \param s The store state.
+ */
+static void store_writer_retire(void *s)
+{
+	struct store_state *state = s;
+	struct store_writer *writer = &state->writer;
+	struct store_write_job *job;
+	struct store_entry_element *elem;
+	unsigned int done;
+
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&writer->lock);
+	done = writer->done;
+	pthread_mutex_unlock(&writer->lock);
+#else
+	done = writer->done;
+#endif
+
+	while (writer->retire != done) {
+		job = &writer->job[writer->retire % WRITE_QUEUE_LENGTH];
+		elem = &job->bse->elem[job->elem_idx];
+
+		if (job->prepare) {
+			struct store_entry *bse = job->bse;
+			int elem_idx = job->elem_idx;
+			uint8_t digest[SHA256_DIGEST_SIZE];
+			uint8_t *encoded = job->encoded;
+			uLongf enclen = job->size;
+
+			memcpy(digest, job->digest_out, sizeof(digest));
+			writer->prepared++;
+			writer->prepare_elapsed += job->elapsed;
+			job->encoded = NULL;
+
+			/* free the job before the element write is queued */
+			writer->retire++;
+
+			store_element_prepared(state, bse, elem_idx,
+					       digest, encoded, enclen);
+
+			entry_release_alloc(elem);
+			if ((bse->flags & ENTRY_FLAGS_INVALID) != 0) {
+				invalidate_entry(state, bse);
+			}
+			continue;
+		}
+
+		if (job->res == NSERROR_OK) {
+			NSLOG(netsurf, VERBOSE,
+			      "Wrote %"PRIsizet" bytes from %p in %"PRIu64"ms",
+			      job->size, job->data, job->elapsed);
+			writer->written += job->size;
+			shared_store_data_written(state, job->bse, job->elem_idx);
+		} else {
+			NSLOG(netsurf, ERROR,
+			      "Write failed of %"PRIsizet" bytes from %p block %d errno %d",
+			      job->size, job->data, elem->block, job->err);
+			writer->failed++;
+			job->bse->flags |= ENTRY_FLAGS_INVALID;
+		}
+		writer->elapsed += job->elapsed;
+
+		free(job->fname);
+		job->fname = NULL;
+		free(job->encoded);
+		job->encoded = NULL;
+
+		entry_release_alloc(elem);
+		if ((job->bse->flags & ENTRY_FLAGS_INVALID) != 0) {
+			invalidate_entry(state, job->bse);
+		}
+
+		writer->retire++;
+	}
+
+	if (writer->retire != writer->tail) {
+		/* writes still outstanding */
+		guit->misc->schedule(WRITE_RETIRE_TIME,
+				     store_writer_retire,
+				     state);
+	}
+}
+
+
+/**
+ * Queue an element of an entry to be written by the writer thread.
+ *
+ * The queued write holds a reference to the element data until it
+ * is retired.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to store
+ * \param elem_idx The element index within the entry.
+ * \param encoded The encoded element data or NULL, ownership passes
+ *                to the write if it is queued.
+ * \return true if the write was queued else false if it must be
+ *         performed synchronously.
+ */
+static bool store_writer_queue(struct store_state *state,
+			       struct store_entry *bse,
+			       int elem_idx,
+			       uint8_t *encoded)
+{
+	struct store_writer *writer = &state->writer;
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	struct store_write_job *job;
 
-	fname = store_fname(state, ident, elem_idx);
-	if (fname == NULL) {
-		NSLOG(netsurf, ERROR, "filename error");
-		return -1;
+	if (writer->running == false) {
+		return false;
 	}
 
-	/* ensure all path elements to file exist if creating file */
-	if (openflags & O_CREAT) {
-		ret = netsurf_mkdir_all(fname);
-		if (ret != NSERROR_OK) {
-			NSLOG(netsurf, WARNING,
-			      "file path \"%s\" could not be created", fname);
-			free(fname);
-			return -1;
+	if ((writer->tail - writer->retire) == WRITE_QUEUE_LENGTH) {
+		NSLOG(netsurf, INFO, "Write queue full, writing synchronously");
+		return false;
+	}
+
+	job = &writer->job[writer->tail % WRITE_QUEUE_LENGTH];
+
+	if (elem->block != 0) {
+		block_index_t bf = (elem->block >> BLOCK_ENTRY_COUNT) &
+			((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
+		block_index_t bi = elem->block & ((1U << BLOCK_ENTRY_COUNT) -1); /* block index in file */
+
+		job->fd = open_block_file(state, elem_idx, bf);
+		if (job->fd == -1) {
+			return false;
+		}
+		job->fname = NULL;
+		job->offset = (unsigned int)bi << log2_block_size[elem_idx];
+	} else {
+		job->fd = -1;
+		job->offset = 0;
+		job->fname = store_elem_fname(state, bse, elem_idx);
+		if (job->fname == NULL) {
+			return false;
+		}
+		/* directory creation is left on the main thread */
+		if (netsurf_mkdir_all(job->fname) != NSERROR_OK) {
+			free(job->fname);
+			job->fname = NULL;
+			return false;
 		}
 	}
 
-	NSLOG(netsurf, DEBUG, "opening %s", fname);
-	fd = open(fname, openflags, S_IRUSR | S_IWUSR);
+	job->bse = bse;
+	job->elem_idx = elem_idx;
+	job->prepare = false;
+	job->data = (encoded != NULL) ? encoded : elem->data;
+	job->encoded = encoded;
+	job->size = elem->size;
+	job->res = NSERROR_OK;
+	job->err = 0;
+	job->elapsed = 0;
 
-	free(fname);
+	/* hold a reference to the data until the write is retired */
+	elem->ref++;
 
-	return fd;
+	if (writer->retire == writer->tail) {
+		/* first outstanding write */
+		guit->misc->schedule(WRITE_RETIRE_TIME,
+				     store_writer_retire,
+				     state);
+	}
+
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&writer->lock);
+	writer->tail++;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+#endif
+
+	return true;
+}
+
+
+/**
+ * Check whether the writer can take another job.
+ *
+ * \param state The backing store state to use.
+ * \return true if a job can be queued.
+ */
+static bool store_writer_available(struct store_state *state)
+{
+	struct store_writer *writer = &state->writer;
+
+	return (writer->running) &&
+		((writer->tail - writer->retire) != WRITE_QUEUE_LENGTH);
+}
+
+
+/**
+ * Queue the data element of an entry to be prepared by the writer.
+ *
+ * The writer computes the digest and compressed form of the data.
+ * The element holds no storage until the preparation is retired and
+ * the queued job holds a reference to the element data until then.
+ * The caller must have checked the writer is available.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to prepare.
+ * \param compress true if the data should be compressed.
+ */
+static void store_writer_prepare(struct store_state *state,
+				 struct store_entry *bse,
+				 bool compress)
+{
+	struct store_writer *writer = &state->writer;
+	struct store_entry_element *elem = &bse->elem[ENTRY_ELEM_DATA];
+	struct store_write_job *job;
+
+	job = &writer->job[writer->tail % WRITE_QUEUE_LENGTH];
+
+	job->bse = bse;
+	job->elem_idx = ENTRY_ELEM_DATA;
+	job->prepare = true;
+	job->digest = state->dedup;
+	job->compress = compress;
+	job->fd = -1;
+	job->fname = NULL;
+	job->offset = 0;
+	job->data = elem->data;
+	job->encoded = NULL;
+	job->size = elem->size;
+	job->res = NSERROR_OK;
+	job->err = 0;
+	job->elapsed = 0;
+
+	/* hold a reference to the data until the job is retired */
+	elem->ref++;
+
+	if (writer->retire == writer->tail) {
+		/* first outstanding job */
+		guit->misc->schedule(WRITE_RETIRE_TIME,
+				     store_writer_retire,
+				     state);
+	}
+
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&writer->lock);
+	writer->tail++;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+#endif
+}
+
+
+/**
+ * Start the writer thread.
+ *
+ * If the thread cannot be started writes are performed synchronously.
+ *
+ * \param state The backing store state to use.
+ */
+static void store_writer_start(struct store_state *state)
+{
+#ifdef WITH_PTHREAD
+	struct store_writer *writer = &state->writer;
+
+	if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+		return;
+	}
+	if (pthread_cond_init(&writer->cond, NULL) != 0) {
+		pthread_mutex_destroy(&writer->lock);
+		return;
+	}
+	if (pthread_create(&writer->thread, NULL,
+			   store_writer_thread, writer) != 0) {
+		NSLOG(netsurf, WARNING,
+		      "Unable to start writer thread, writing synchronously");
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->lock);
+		return;
+	}
+
+	writer->running = true;
+#endif
+}
+
+
+/**
+ * Stop the writer thread.
+ *
+ * Outstanding writes are completed and retired before returning.
+ *
+ * \param state The backing store state to use.
+ */
+static void store_writer_stop(struct store_state *state)
+{
+#ifdef WITH_PTHREAD
+	struct store_writer *writer = &state->writer;
+
+	if (writer->running == false) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->lock);
+	writer->quit = true;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+
+	pthread_join(writer->thread, NULL);
+	writer->running = false;
+
+	guit->misc->schedule(-1, store_writer_retire, state);
+	store_writer_retire(state);
+
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->lock);
+
+	NSLOG(netsurf, INFO,
+	      "Writer wrote %"PRIu64" bytes in %"PRIu64"ms with %"PRIsizet" failures",
+	      writer->written, writer->elapsed, writer->failed);
+	NSLOG(netsurf, INFO,
+	      "Writer prepared %"PRIsizet" elements in %"PRIu64"ms",
+	      writer->prepared, writer->prepare_elapsed);
+#endif
 }
 
 
@@ -1123,6 +2433,99 @@ unlink_entries(struct store_state *state)
 	return NSERROR_OK;
 }
 
+/**
+ * Read a single serialised store entry.
+ *
+ * Entries serialised by earlier control versions are migrated to the
+ * current entry layout.
+ *
+ * @param state The backing store state being read.
+ * @param fd The file descriptor to read from.
+ * @param ent The entry to fill.
+ * @return true if the entry was read else false.
+ */
+static bool
+read_entry(struct store_state *state, int fd, struct store_entry *ent)
+{
+	struct store_entry_v203 ent203;
+	struct store_entry_v202 ent202;
+
+	switch (state->control_version) {
+	case CONTROL_VERSION:
+		return read(fd, ent, sizeof(*ent)) == sizeof(*ent);
+
+	case CONTROL_VERSION_V203:
+		if (read(fd, &ent203, sizeof(ent203)) != sizeof(ent203)) {
+			return false;
+		}
+		ent->last_used = ent203.last_used;
+		ent->use_count = ent203.use_count;
+		ent->flags = ent203.flags;
+		memcpy(ent->elem, ent203.elem, sizeof(ent->elem));
+		memcpy(ent->digest, ent203.digest, sizeof(ent->digest));
+		break;
+
+	case CONTROL_VERSION_V202:
+		if (read(fd, &ent202, sizeof(ent202)) != sizeof(ent202)) {
+			return false;
+		}
+		/* entries without a digest are stored per entry */
+		ent->last_used = ent202.last_used;
+		ent->use_count = ent202.use_count;
+		ent->flags = ent202.flags;
+		memcpy(ent->elem, ent202.elem, sizeof(ent->elem));
+		memset(ent->digest, 0, sizeof(ent->digest));
+		break;
+
+	default:
+		return false;
+	}
+
+	/* earlier versions never compressed data */
+	ent->length = ent->elem[ENTRY_ELEM_DATA].size;
+
+	return true;
+}
+
+/**
+ * Account for the data of a read entry.
+ *
+ * Shared data is accounted once however many entries reference it.
+ *
+ * @param state The backing store state being read.
+ * @param ent The entry which was read.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror
+read_entry_account(struct store_state *state, struct store_entry *ent)
+{
+	struct store_data *sd;
+
+	state->total_alloc += ent->elem[ENTRY_ELEM_META].size;
+
+	if ((ent->elem[ENTRY_ELEM_DATA].flags & ENTRY_ELEM_FLAG_SHARED) == 0) {
+		state->total_alloc += ent->elem[ENTRY_ELEM_DATA].size;
+		return NSERROR_OK;
+	}
+
+	sd = hashmap_lookup(state->shared, ent->digest);
+	if (sd == NULL) {
+		sd = hashmap_insert(state->shared, ent->digest);
+		if (sd == NULL) {
+			return NSERROR_NOMEM;
+		}
+		sd->size = ent->elem[ENTRY_ELEM_DATA].size;
+		sd->length = ent->length;
+		sd->block = ent->elem[ENTRY_ELEM_DATA].block;
+		sd->codec = ent->elem[ENTRY_ELEM_DATA].flags &
+			ENTRY_ELEM_FLAG_DEFLATE;
+		state->total_alloc += sd->size;
+	}
+	sd->refs++;
+
+	return NSERROR_OK;
+}
+
 /**
  * Read description entries into memory.
  *
@@ -1151,6 +2554,12 @@ read_entries(struct store_state *state)
 		return NSERROR_NOMEM;
 	}
 
+	state->shared = hashmap_create(&shared_hashmap_parameters);
+	if (state->shared == NULL) {
+		free(fname);
+		return NSERROR_NOMEM;
+	}
+
 	fd = open(fname, O_RDWR);
 	if (fd != -1) {
 		uint32_t urllen;
@@ -1184,7 +2593,7 @@ read_entries(struct store_state *state)
 				return NSERROR_NOMEM;
 			}
 			/* At this point, ent actually owns a ref of nsurl */
-			if (read(fd, ent, sizeof(*ent)) != sizeof(*ent)) {
+			if (read_entry(state, fd, ent) == false) {
 				/* The read failed, so reset the ptr */
 				ent->url = nsurl; /* It already had a ref */
 				nsurl_unref(nsurl);
@@ -1197,8 +2606,12 @@ read_entries(struct store_state *state)
 			NSLOG(netsurf, DEBUG, "Successfully read entry for %s", nsurl_access(ent->url));
 			read_entries++;
 			/* Note the size allocation */
-			state->total_alloc += ent->elem[ENTRY_ELEM_DATA].size;
-			state->total_alloc += ent->elem[ENTRY_ELEM_META].size;
+			ret = read_entry_account(state, ent);
+			if (ret != NSERROR_OK) {
+				close(fd);
+				free(fname);
+				return ret;
+			}
 			/* And ensure we don't pretend to have this in memory yet */
 			ent->elem[ENTRY_ELEM_DATA].flags &= ~(ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP);
 			ent->elem[ENTRY_ELEM_META].flags &= ~(ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP);
@@ -1207,7 +2620,8 @@ read_entries(struct store_state *state)
 		close(fd);
 	}
 
-	NSLOG(netsurf, INFO, "Read %"PRIsizet" entries from cache", read_entries);
+	NSLOG(netsurf, INFO, "Read %"PRIsizet" entries from cache with %"PRIsizet" shared data",
+	      read_entries, hashmap_count(state->shared));
 
 	free(fname);
 	return NSERROR_OK;
@@ -1269,6 +2683,8 @@ read_blocks(struct store_state *state)
 	for (bfidx = 0; bfidx < BLOCK_FILE_COUNT; bfidx++) {
 		state->blocks[ENTRY_ELEM_DATA][bfidx].fd = -1;
 		state->blocks[ENTRY_ELEM_META][bfidx].fd = -1;
+		state->blocks[ENTRY_ELEM_DATA][bfidx].map = NULL;
+		state->blocks[ENTRY_ELEM_META][bfidx].map = NULL;
 	}
 
 	return NSERROR_OK;
@@ -1394,9 +2810,12 @@ read_control(struct store_state *state)
 		goto control_error;
 	}
 
-	if (ctrlversion != CONTROL_VERSION) {
+	if ((ctrlversion != CONTROL_VERSION) &&
+	    (ctrlversion != CONTROL_VERSION_V203) &&
+	    (ctrlversion != CONTROL_VERSION_V202)) {
 		goto control_error;
 	}
+	state->control_version = ctrlversion;
 
 	if (fgetc(fcontrol) != 0) {
 		goto control_error;
@@ -1454,6 +2873,8 @@ initialise(const struct llcache_store_parameters *parameters)
 	newstate->path = strdup(parameters->path);
 	newstate->limit = parameters->limit;
 	newstate->hysteresis = parameters->hysteresis;
+	newstate->dedup = parameters->dedup;
+	newstate->control_version = CONTROL_VERSION;
 
 	/* read store control and create new if required */
 	ret = read_control(newstate);
@@ -1500,21 +2921,49 @@ initialise(const struct llcache_store_parameters *parameters)
 	ret = read_blocks(newstate);
 	if (ret != NSERROR_OK) {
 		/* oh dear */
+		hashmap_destroy(newstate->shared);
 		hashmap_destroy(newstate->entries);
 		free(newstate->path);
 		free(newstate);
 		return ret;
 	}
 
+	/* complete migration from an earlier format */
+	if (newstate->control_version != CONTROL_VERSION) {
+		NSLOG(netsurf, INFO, "migrating cache from control version %u",
+		      newstate->control_version);
+
+		/* the entries must be in the new format before the
+		 * control file indicates it.
+		 */
+		newstate->control_version = CONTROL_VERSION;
+		newstate->entries_dirty = true;
+		ret = write_entries(newstate);
+		if (ret == NSERROR_OK) {
+			ret = write_control(newstate);
+		}
+		if (ret != NSERROR_OK) {
+			NSLOG(netsurf, ERROR, "cache migration failed");
+			hashmap_destroy(newstate->shared);
+			hashmap_destroy(newstate->entries);
+			free(newstate->path);
+			free(newstate);
+			return ret;
+		}
+	}
+
 	storestate = newstate;
 
+	store_writer_start(newstate);
+
 	NSLOG(netsurf, INFO, "FS backing store init successful");
 
 	NSLOG(netsurf, INFO,
-	      "path:%s limit:%"PRIsizet" hyst:%"PRIsizet,
+	      "path:%s limit:%"PRIsizet" hyst:%"PRIsizet" dedup:%d",
 	      newstate->path,
 	      newstate->limit,
-	      newstate->hysteresis);
+	      newstate->hysteresis,
+	      newstate->dedup);
 	NSLOG(netsurf, INFO, "Using %"PRIu64"/%"PRIsizet,
 	      newstate->total_alloc, newstate->limit);
 
@@ -1537,12 +2986,17 @@ finalise(void)
 	unsigned int op_count;
 
 	if (storestate != NULL) {
+		/* complete outstanding writes before the entries are saved */
+		store_writer_stop(storestate);
+
 		guit->misc->schedule(-1, control_maintenance, storestate);
 		write_entries(storestate);
 		write_blocks(storestate);
 
-		/* ensure all block files are closed */
+		/* ensure all block files are unmapped and closed */
 		for (bf = 0; bf < BLOCK_FILE_COUNT; bf++) {
+			unmap_block_file(storestate, ENTRY_ELEM_DATA, bf);
+			unmap_block_file(storestate, ENTRY_ELEM_META, bf);
 			if (storestate->blocks[ENTRY_ELEM_DATA][bf].fd != -1) {
 				close(storestate->blocks[ENTRY_ELEM_DATA][bf].fd);
 			}
@@ -1555,6 +3009,17 @@ finalise(void)
 
 		/* avoid division by zero */
 		if (op_count > 0) {
+			NSLOG(netsurf, INFO,
+			      "Cache hits served from block file mappings %"PRIsizet,
+			      storestate->map_count);
+			NSLOG(netsurf, INFO,
+			      "Cache stores of shared data %"PRIsizet" avoiding %"PRIu64" bytes",
+			      storestate->dedup_count,
+			      storestate->dedup_size);
+			NSLOG(netsurf, INFO,
+			      "Cache stores compressed %"PRIu64" bytes to %"PRIu64,
+			      storestate->deflate_in,
+			      storestate->deflate_out);
 			NSLOG(netsurf, INFO,
 			      "Cache total/hit/miss/fail (counts) %d/%"PRIsizet"/%"PRIsizet"/%d (100%%/%"PRIsizet"%%/%"PRIsizet"%%/%d%%)",
 			      op_count,
@@ -1566,6 +3031,7 @@ finalise(void)
 			      0);
 		}
 
+		hashmap_destroy(storestate->shared);
 		hashmap_destroy(storestate->entries);
 		free(storestate->path);
 		free(storestate);
@@ -1581,11 +3047,13 @@ finalise(void)
  * \param state The backing store state to use.
  * \param bse The entry to store
  * \param elem_idx The element index within the entry.
+ * \param data The element data as stored on disc.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_write_block(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 const uint8_t *data)
 {
 	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
 		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
@@ -1594,22 +3062,14 @@ static nserror store_write_block(struct store_state *state,
 	off_t offst;
 
 	/* ensure the block file fd is good */
-	if (state->blocks[elem_idx][bf].fd == -1) {
-		state->blocks[elem_idx][bf].fd = store_open(state, bf,
-				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
-		if (state->blocks[elem_idx][bf].fd == -1) {
-			NSLOG(netsurf, ERROR, "Open failed errno %d", errno);
-			return NSERROR_SAVE_FAILED;
-		}
-
-		/* flag that a block file has been opened */
-		state->blocks_opened = true;
+	if (open_block_file(state, elem_idx, bf) == -1) {
+		return NSERROR_SAVE_FAILED;
 	}
 
 	offst = (unsigned int)bi << log2_block_size[elem_idx];
 
 	wr = nsu_pwrite(state->blocks[elem_idx][bf].fd,
-			bse->elem[elem_idx].data,
+			data,
 			bse->elem[elem_idx].size,
 			offst);
 	if (wr != (ssize_t)bse->elem[elem_idx].size) {
@@ -1617,7 +3077,7 @@ static nserror store_write_block(struct store_state *state,
 		      "Write failed %"PRIssizet" of %d bytes from %p at %"PRIsizet" block %d errno %d",
 		      wr,
 		      bse->elem[elem_idx].size,
-		      bse->elem[elem_idx].data,
+		      data,
 		      (size_t)offst,
 		      bse->elem[elem_idx].block,
 		      errno);
@@ -1626,7 +3086,7 @@ static nserror store_write_block(struct store_state *state,
 
 	NSLOG(netsurf, INFO,
 	      "Wrote %"PRIssizet" bytes from %p at %"PRIsizet" block %d", wr,
-	      bse->elem[elem_idx].data, (size_t)offst,
+	      data, (size_t)offst,
 	      bse->elem[elem_idx].block);
 
 	return NSERROR_OK;
@@ -1638,24 +3098,26 @@ static nserror store_write_block(struct store_state *state,
  * \param state The backing store state to use.
  * \param bse The entry to store
  * \param elem_idx The element index within the entry.
+ * \param data The element data as stored on disc.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_write_file(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 const uint8_t *data)
 {
 	ssize_t wr;
 	int fd;
 	int err;
 
-	fd = store_open(state, nsurl_hash(bse->url), elem_idx, O_CREAT | O_WRONLY);
+	fd = store_open_elem(state, bse, elem_idx, O_CREAT | O_WRONLY);
 	if (fd < 0) {
 		perror("");
 		NSLOG(netsurf, ERROR, "Open failed %d errno %d", fd, errno);
 		return NSERROR_SAVE_FAILED;
 	}
 
-	wr = write(fd, bse->elem[elem_idx].data, bse->elem[elem_idx].size);
+	wr = write(fd, data, bse->elem[elem_idx].size);
 	err = errno; /* close can change errno */
 
 	close(fd);
@@ -1664,7 +3126,7 @@ static nserror store_write_file(struct store_state *state,
 		      "Write failed %"PRIssizet" of %d bytes from %p errno %d",
 		      wr,
 		      bse->elem[elem_idx].size,
-		      bse->elem[elem_idx].data,
+		      data,
 		      err);
 
 		/** @todo Delete the file? */
@@ -1672,7 +3134,7 @@ static nserror store_write_file(struct store_state *state,
 	}
 
 	NSLOG(netsurf, VERBOSE, "Wrote %"PRIssizet" bytes from %p", wr,
-	      bse->elem[elem_idx].data);
+	      data);
 
 	return NSERROR_OK;
 }
@@ -1697,6 +3159,10 @@ store(nsurl *url,
 	nserror ret;
 	struct store_entry *bse;
 	int elem_idx;
+	bool compress = false;
+	bool prepare = false;
+	uint8_t *encoded;
+	bool present;
 
 	/* check backing store is initialised */
 	if (storestate == NULL) {
@@ -1708,54 +3174,125 @@ store(nsurl *url,
 		elem_idx = ENTRY_ELEM_META;
 	} else {
 		elem_idx = ENTRY_ELEM_DATA;
+
+		/* compress data the cache indicates will compress well
+		 * if it is large enough to gain from it.
+		 */
+		if (((bsflags & BACKING_STORE_COMPRESSIBLE) != 0) &&
+		    (datalen >= COMPRESS_MIN_SIZE)) {
+			compress = true;
+		}
+
+		/* digest and compress on the writer thread if it can */
+		if ((compress || storestate->dedup) &&
+		    store_writer_available(storestate)) {
+			prepare = true;
+		}
 	}
 
 	/* set the store entry up */
-	ret = set_store_entry(storestate, url, elem_idx, data, datalen, &bse);
+	ret = set_store_entry(storestate, url, elem_idx, data, datalen,
+			      compress, prepare, &bse, &encoded, &present);
 	if (ret != NSERROR_OK) {
 		NSLOG(netsurf, ERROR, "store entry setting failed");
 		return ret;
 	}
 
+	if (prepare) {
+		/* storage is allocated and written once prepared */
+		store_writer_prepare(storestate, bse, compress);
+		return NSERROR_OK;
+	}
+
+	if (present) {
+		/* identical shared data is already on disc */
+		return NSERROR_OK;
+	}
+
+	return store_write_element(storestate, bse, elem_idx, encoded);
+}
+
+
+/* documented with its declaration above */
+static nserror
+store_write_element(struct store_state *state,
+		    struct store_entry *bse,
+		    int elem_idx,
+		    uint8_t *encoded)
+{
+	nserror ret;
+
+	if (store_writer_queue(state, bse, elem_idx, encoded)) {
+		/* written by the writer thread and completed on retire */
+		return NSERROR_OK;
+	}
+
 	if (bse->elem[elem_idx].block != 0) {
 		/* small block storage */
-		ret = store_write_block(storestate, bse, elem_idx);
+		ret = store_write_block(state, bse, elem_idx,
+				(encoded != NULL) ? encoded : bse->elem[elem_idx].data);
 	} else {
 		/* separate file in backing store */
-		ret = store_write_file(storestate, bse, elem_idx);
+		ret = store_write_file(state, bse, elem_idx,
+				(encoded != NULL) ? encoded : bse->elem[elem_idx].data);
+	}
+	free(encoded);
+
+	if (ret == NSERROR_OK) {
+		shared_store_data_written(state, bse, elem_idx);
 	}
 
 	return ret;
 }
 
 /**
- * release any allocation for an entry
+ * Reference an element of an entry directly within its block file mapping.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to reference.
+ * \param elem_idx The element index within the entry.
+ * \param data_out Updated with the element data as stored on disc.
+ * \return NSERROR_OK on success or NSERROR_NOT_FOUND if the block
+ *         file cannot be mapped.
  */
-static nserror entry_release_alloc(struct store_entry_element *elem)
+static nserror store_map_block(struct store_state *state,
+			 struct store_entry *bse,
+			 int elem_idx,
+			 uint8_t **data_out)
 {
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
-		elem->ref--;
-		if (elem->ref == 0) {
-			NSLOG(netsurf, DEEPDEBUG, "freeing %p", elem->data);
-			free(elem->data);
-			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
-		}
+	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
+		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
+	block_index_t bi = bse->elem[elem_idx].block & ((1 << BLOCK_ENTRY_COUNT) -1); /* block index in file */
+	uint8_t *map;
+
+	map = map_block_file(state, elem_idx, bf);
+	if (map == NULL) {
+		return NSERROR_NOT_FOUND;
 	}
+
+	*data_out = map +
+		((unsigned int)bi << log2_block_size[elem_idx]);
+
+	NSLOG(netsurf, DEEPDEBUG, "Mapped %d bytes at %p block %d",
+	      bse->elem[elem_idx].size, *data_out,
+	      bse->elem[elem_idx].block);
+
 	return NSERROR_OK;
 }
 
-
 /**
  * Read an element of an entry from a small block file in the backing storage.
  *
  * \param state The backing store state to use.
  * \param bse The entry to read.
  * \param elem_idx The element index within the entry.
+ * \param data Buffer to receive the element data as stored on disc.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_read_block(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 uint8_t *data)
 {
 	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
 		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
@@ -1764,22 +3301,14 @@ static nserror store_read_block(struct store_state *state,
 	off_t offst;
 
 	/* ensure the block file fd is good */
-	if (state->blocks[elem_idx][bf].fd == -1) {
-		state->blocks[elem_idx][bf].fd = store_open(state, bf,
-				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
-		if (state->blocks[elem_idx][bf].fd == -1) {
-			NSLOG(netsurf, ERROR, "Open failed errno %d", errno);
-			return NSERROR_SAVE_FAILED;
-		}
-
-		/* flag that a block file has been opened */
-		state->blocks_opened = true;
+	if (open_block_file(state, elem_idx, bf) == -1) {
+		return NSERROR_SAVE_FAILED;
 	}
 
 	offst = (unsigned int)bi << log2_block_size[elem_idx];
 
 	rd = nsu_pread(state->blocks[elem_idx][bf].fd,
-		       bse->elem[elem_idx].data,
+		       data,
 		       bse->elem[elem_idx].size,
 		       offst);
 	if (rd != (ssize_t)bse->elem[elem_idx].size) {
@@ -1787,7 +3316,7 @@ static nserror store_read_block(struct store_state *state,
 		      "Failed reading %"PRIssizet" of %d bytes into %p from %"PRIsizet" block %d errno %d",
 		      rd,
 		      bse->elem[elem_idx].size,
-		      bse->elem[elem_idx].data,
+		      data,
 		      (size_t)offst,
 		      bse->elem[elem_idx].block,
 		      errno);
@@ -1796,7 +3325,7 @@ static nserror store_read_block(struct store_state *state,
 
 	NSLOG(netsurf, DEEPDEBUG,
 	      "Read %"PRIssizet" bytes into %p from %"PRIsizet" block %d", rd,
-	      bse->elem[elem_idx].data, (size_t)offst,
+	      data, (size_t)offst,
 	      bse->elem[elem_idx].block);
 
 	return NSERROR_OK;
@@ -1808,11 +3337,13 @@ static nserror store_read_block(struct store_state *state,
  * \param state The backing store state to use.
  * \param bse The entry to read.
  * \param elem_idx The element index within the entry.
+ * \param data Buffer to receive the element data as stored on disc.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_read_file(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 uint8_t *data)
 {
 	int fd;
 	ssize_t rd; /* return from read */
@@ -1820,7 +3351,7 @@ static nserror store_read_file(struct store_state *state,
 	size_t tot = 0; /* total size */
 
 	/* separate file in backing store */
-	fd = store_open(storestate, nsurl_hash(bse->url), elem_idx, O_RDONLY);
+	fd = store_open_elem(state, bse, elem_idx, O_RDONLY);
 	if (fd < 0) {
 		NSLOG(netsurf, ERROR, "Open failed %d errno %d", fd, errno);
 		/** @todo should this invalidate the entry? */
@@ -1829,7 +3360,7 @@ static nserror store_read_file(struct store_state *state,
 
 	while (tot < bse->elem[elem_idx].size) {
 		rd = read(fd,
-			  bse->elem[elem_idx].data + tot,
+			  data + tot,
 			  bse->elem[elem_idx].size - tot);
 		if (rd <= 0) {
 			NSLOG(netsurf, ERROR,
@@ -1845,7 +3376,58 @@ static nserror store_read_file(struct store_state *state,
 	close(fd);
 
 	NSLOG(netsurf, DEEPDEBUG, "Read %"PRIsizet" bytes into %p", tot,
-	      bse->elem[elem_idx].data);
+	      data);
+
+	return ret;
+}
+
+/**
+ * Read a compressed element of an entry from the backing storage.
+ *
+ * Small block data is decompressed directly from the block file
+ * mapping where possible.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to read.
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_read_deflate(struct store_state *state,
+			 struct store_entry *bse,
+			 int elem_idx)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	uint8_t *encoded = NULL;
+	uint8_t *src = NULL;
+	uLongf length = bse->length;
+	nserror ret = NSERROR_OK;
+	int zret;
+
+	if ((elem->block == 0) ||
+	    (store_map_block(state, bse, elem_idx, &src) != NSERROR_OK)) {
+		encoded = malloc(elem->size);
+		if (encoded == NULL) {
+			return NSERROR_NOMEM;
+		}
+		if (elem->block != 0) {
+			ret = store_read_block(state, bse, elem_idx, encoded);
+		} else {
+			ret = store_read_file(state, bse, elem_idx, encoded);
+		}
+		src = encoded;
+	}
+
+	if (ret == NSERROR_OK) {
+		zret = uncompress(elem->data, &length, src, elem->size);
+		if ((zret != Z_OK) || (length != bse->length)) {
+			NSLOG(netsurf, ERROR,
+			      "Decompressing %d bytes to %"PRIu32" failed %d",
+			      elem->size, bse->length, zret);
+			ret = NSERROR_NOT_FOUND;
+		}
+	}
+
+	free(encoded);
 
 	return ret;
 }
@@ -1869,6 +3451,7 @@ fetch(nsurl *url,
 	struct store_entry *bse;
 	struct store_entry_element *elem;
 	int elem_idx;
+	size_t length;
 
 	/* check backing store is initialised */
 	if (storestate == NULL) {
@@ -1895,8 +3478,15 @@ fetch(nsurl *url,
 	}
 	elem = &bse->elem[elem_idx];
 
+	/* length of the decoded element data */
+	if ((elem->flags & ENTRY_ELEM_FLAG_DEFLATE) != 0) {
+		length = bse->length;
+	} else {
+		length = elem->size;
+	}
+
 	/* if an allocation already exists return it */
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+	if ((elem->flags & (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) {
 		/* use the existing allocation and bump the ref count. */
 		elem->ref++;
 
@@ -1904,9 +3494,18 @@ fetch(nsurl *url,
 		      "Using existing entry (%p) allocation %p refs:%d", bse,
 		      elem->data, elem->ref);
 
+	} else if ((elem->block != 0) &&
+		   ((elem->flags & ENTRY_ELEM_FLAG_DEFLATE) == 0) &&
+		   (store_map_block(storestate, bse, elem_idx,
+				    &elem->data) == NSERROR_OK)) {
+		/* small block data is used directly from the mapping */
+		elem->flags |= ENTRY_ELEM_FLAG_MMAP;
+		elem->ref = 1;
+		storestate->map_count++;
+
 	} else {
 		/* allocate from the heap */
-		elem->data = malloc(elem->size);
+		elem->data = malloc(length);
 		if (elem->data == NULL) {
 			NSLOG(netsurf, ERROR,
 			      "Failed to create new heap allocation");
@@ -1920,10 +3519,14 @@ fetch(nsurl *url,
 		elem->ref = 1;
 
 		/* fill the new block */
-		if (elem->block != 0) {
-			ret = store_read_block(storestate, bse, elem_idx);
+		if ((elem->flags & ENTRY_ELEM_FLAG_DEFLATE) != 0) {
+			ret = store_read_deflate(storestate, bse, elem_idx);
+		} else if (elem->block != 0) {
+			ret = store_read_block(storestate, bse, elem_idx,
+					       elem->data);
 		} else {
-			ret = store_read_file(storestate, bse, elem_idx);
+			ret = store_read_file(storestate, bse, elem_idx,
+					      elem->data);
 		}
 	}
 
@@ -1932,10 +3535,10 @@ fetch(nsurl *url,
 		entry_release_alloc(elem);
 	} else {
 		/* update stats and setup return pointers */
-		storestate->hit_size += elem->size;
+		storestate->hit_size += length;
 
 		*data_out = elem->data;
-		*datalen_out = elem->size;
+		*datalen_out = length;
 	}
 
 	return ret;
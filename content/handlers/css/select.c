@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
@@ -239,6 +240,411 @@ static void nscss_dom_user_data_handler(dom_node_operation operation,
 	}
 }
 
+/** Number of hash chains in a style sharing cache */
+#define SHARE_CACHE_BUCKETS 256
+
+/** Number of entries at which a style sharing cache is flushed */
+#define SHARE_CACHE_MAX_ENTRIES 1024
+
+/** Longest element key considered for style sharing, in bytes */
+#define SHARE_KEY_MAX 512
+
+/**
+ * An element whose computed styles may be shared.
+ */
+struct nscss_share_entry {
+	struct nscss_share_entry *next;	/**< Next entry in hash chain */
+	uint32_t hash;			/**< Hash of parent and key */
+	uint32_t parent;		/**< Sharing identity of parent */
+	uint32_t id;			/**< Sharing identity of elements
+					 *   given these styles */
+	css_select_results *styles;	/**< Styles owned by the cache */
+	size_t key_len;			/**< Length of key */
+	uint8_t key[];			/**< Element name and attributes */
+};
+
+/**
+ * Style sharing cache
+ *
+ * Elements with the same name and attributes whose parents have the
+ * same sharing identity are given the same computed style without
+ * running selection again, provided selection of the first such
+ * element did not depend on anything else (siblings, children,
+ * inline style).
+ *
+ * Parents are identified by sharing identity rather than by style
+ * pointer, as libcss interns computed styles and unrelated parents
+ * may end up with the same style.  Each freshly selected element
+ * receives a new identity and an element that shares styles
+ * inherits the identity of the element it shares with, so equal
+ * identities imply identical ancestor chains as far as selection
+ * is concerned.
+ *
+ * A cache lives for the duration of one box tree construction.
+ */
+struct nscss_share_cache {
+	struct nscss_share_entry *buckets[SHARE_CACHE_BUCKETS];
+	unsigned int entries;		/**< Number of entries in cache */
+	uint32_t next_id;		/**< Next sharing identity to give */
+
+	unsigned int hits;		/**< Selections avoided */
+	unsigned int misses;		/**< Selections with no entry */
+	unsigned int unshareable;	/**< Selections not cacheable */
+};
+
+
+/**
+ * Remove all entries from a style sharing cache
+ *
+ * \param cache  Cache to flush
+ */
+static void nscss_share_cache_flush(struct nscss_share_cache *cache)
+{
+	unsigned int bucket;
+
+	for (bucket = 0; bucket < SHARE_CACHE_BUCKETS; bucket++) {
+		struct nscss_share_entry *entry = cache->buckets[bucket];
+
+		while (entry != NULL) {
+			struct nscss_share_entry *next = entry->next;
+
+			css_select_results_destroy(entry->styles);
+			free(entry);
+			entry = next;
+		}
+		cache->buckets[bucket] = NULL;
+	}
+
+	cache->entries = 0;
+}
+
+
+/* exported interface documented in css/select.h */
+nserror nscss_share_cache_create(struct nscss_share_cache **cache)
+{
+	struct nscss_share_cache *c;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	c->next_id = 1;
+
+	*cache = c;
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in css/select.h */
+void nscss_share_cache_destroy(struct nscss_share_cache *cache)
+{
+	unsigned int total;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	total = cache->hits + cache->misses + cache->unshareable;
+
+	NSLOG(netsurf, INFO,
+	      "style sharing: %u of %u selections shared (%u%%), %u misses, %u unshareable",
+	      cache->hits, total,
+	      total == 0 ? 0 : (unsigned int)
+			((uint64_t) cache->hits * 100 / total),
+	      cache->misses, cache->unshareable);
+
+	nscss_share_cache_flush(cache);
+	free(cache);
+}
+
+
+/**
+ * Append a length prefixed string to an element key
+ *
+ * \param key      Key buffer
+ * \param key_len  Current length of key, updated on exit
+ * \param data     String to append
+ * \param len      Length of string
+ * \return true on success, false if the key would be too long
+ */
+static bool
+nscss_share_key_append(uint8_t *key, size_t *key_len,
+		const char *data, size_t len)
+{
+	if (len > 0xffff || *key_len + 2 + len > SHARE_KEY_MAX) {
+		return false;
+	}
+
+	key[(*key_len)++] = len >> 8;
+	key[(*key_len)++] = len & 0xff;
+	memcpy(key + *key_len, data, len);
+	*key_len += len;
+
+	return true;
+}
+
+
+/**
+ * Append a DOM string to an element key, consuming the reference
+ *
+ * \param key      Key buffer
+ * \param key_len  Current length of key, updated on exit
+ * \param str      String to append, or NULL for an empty string
+ * \return true on success, false if the key would be too long
+ */
+static bool
+nscss_share_key_append_dom(uint8_t *key, size_t *key_len, dom_string *str)
+{
+	bool ok;
+
+	if (str == NULL) {
+		return nscss_share_key_append(key, key_len, "", 0);
+	}
+
+	ok = nscss_share_key_append(key, key_len, dom_string_data(str),
+			dom_string_byte_length(str));
+	dom_string_unref(str);
+
+	return ok;
+}
+
+
+/**
+ * Build the sharing key for an element
+ *
+ * The key holds the element's name, namespace and every attribute
+ * name and value.  It therefore also covers the id and class set,
+ * the presentational hints and any attribute selector.
+ *
+ * \param n    Element to build key for
+ * \param key  Buffer of SHARE_KEY_MAX bytes to receive key
+ * \return Length of key, or 0 if the element can't share styles
+ */
+static size_t nscss_share_key(dom_node *n, uint8_t *key)
+{
+	dom_namednodemap *attrs;
+	dom_string *str;
+	uint32_t length, i;
+	size_t key_len = 0;
+	dom_exception err;
+
+	err = dom_node_get_node_name(n, &str);
+	if (err != DOM_NO_ERR ||
+			!nscss_share_key_append_dom(key, &key_len, str)) {
+		return 0;
+	}
+
+	err = dom_node_get_namespace(n, &str);
+	if (err != DOM_NO_ERR ||
+			!nscss_share_key_append_dom(key, &key_len, str)) {
+		return 0;
+	}
+
+	err = dom_node_get_attributes(n, &attrs);
+	if (err != DOM_NO_ERR || attrs == NULL) {
+		return 0;
+	}
+
+	err = dom_namednodemap_get_length(attrs, &length);
+	if (err != DOM_NO_ERR) {
+		dom_namednodemap_unref(attrs);
+		return 0;
+	}
+
+	for (i = 0; i < length; i++) {
+		dom_attr *attr;
+		bool ok;
+
+		err = dom_namednodemap_item(attrs, i, (void *) &attr);
+		if (err != DOM_NO_ERR || attr == NULL) {
+			dom_namednodemap_unref(attrs);
+			return 0;
+		}
+
+		err = dom_attr_get_name(attr, &str);
+		ok = (err == DOM_NO_ERR) &&
+			nscss_share_key_append_dom(key, &key_len, str);
+		if (ok) {
+			err = dom_attr_get_value(attr, &str);
+			ok = (err == DOM_NO_ERR) &&
+				nscss_share_key_append_dom(key, &key_len, str);
+		}
+
+		dom_node_unref(attr);
+
+		if (ok == false) {
+			dom_namednodemap_unref(attrs);
+			return 0;
+		}
+	}
+
+	dom_namednodemap_unref(attrs);
+
+	return key_len;
+}
+
+
+/**
+ * Hash an element's parent sharing identity and key
+ *
+ * \param parent   Sharing identity of parent
+ * \param key      Element key
+ * \param key_len  Length of key
+ * \return hash value
+ */
+static uint32_t
+nscss_share_hash(uint32_t parent, const uint8_t *key, size_t key_len)
+{
+	uint32_t hash = 0x811c9dc5;
+	size_t i;
+
+	for (i = 0; i < sizeof(parent); i++) {
+		hash ^= (parent >> (i * 8)) & 0xff;
+		hash *= 0x01000193;
+	}
+
+	for (i = 0; i < key_len; i++) {
+		hash ^= key[i];
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+
+/**
+ * Find a style sharing cache entry
+ *
+ * \param cache    Cache to search
+ * \param hash     Hash of parent and key
+ * \param parent   Sharing identity of parent
+ * \param key      Element key
+ * \param key_len  Length of key
+ * \return Matching entry, or NULL if none
+ */
+static struct nscss_share_entry *
+nscss_share_find(struct nscss_share_cache *cache, uint32_t hash,
+		uint32_t parent, const uint8_t *key, size_t key_len)
+{
+	struct nscss_share_entry *entry;
+
+	for (entry = cache->buckets[hash % SHARE_CACHE_BUCKETS];
+			entry != NULL; entry = entry->next) {
+		if (entry->hash == hash &&
+				entry->parent == parent &&
+				entry->key_len == key_len &&
+				memcmp(entry->key, key, key_len) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Take new references to a set of complete computed styles
+ *
+ * libcss has no call to reference a computed style, but composing a
+ * complete style with the parent it was composed with is idempotent,
+ * and libcss interns the result, so this yields the same style objects
+ * without running selection or the cascade.
+ *
+ * \param src           Complete styles to reference
+ * \param parent_style  Parent style \a src was composed with
+ * \param unit_len_ctx  Unit length conversion context
+ * \return New selection results, or NULL on failure
+ */
+static css_select_results *
+nscss_share_ref(const css_select_results *src,
+		const css_computed_style *parent_style,
+		const css_unit_ctx *unit_len_ctx)
+{
+	css_select_results *dst;
+	int pseudo_element;
+	css_error error;
+
+	dst = calloc(1, sizeof(*dst));
+	if (dst == NULL) {
+		return NULL;
+	}
+
+	for (pseudo_element = CSS_PSEUDO_ELEMENT_NONE;
+			pseudo_element < CSS_PSEUDO_ELEMENT_COUNT;
+			pseudo_element++) {
+		const css_computed_style *base;
+
+		if (src->styles[pseudo_element] == NULL)
+			continue;
+
+		base = (pseudo_element == CSS_PSEUDO_ELEMENT_NONE) ?
+				parent_style :
+				dst->styles[CSS_PSEUDO_ELEMENT_NONE];
+
+		error = css_computed_style_compose(base,
+				src->styles[pseudo_element],
+				unit_len_ctx, &dst->styles[pseudo_element]);
+		if (error != CSS_OK) {
+			dst->styles[pseudo_element] = NULL;
+			css_select_results_destroy(dst);
+			return NULL;
+		}
+	}
+
+	return dst;
+}
+
+
+/**
+ * Add freshly selected styles to a style sharing cache
+ *
+ * \param cache         Cache to add to
+ * \param hash          Hash of parent and key
+ * \param ctx           Selection context the styles were selected with
+ * \param key           Element key
+ * \param key_len       Length of key
+ * \param styles        Complete styles selected for element
+ * \param unit_len_ctx  Unit length conversion context
+ */
+static void
+nscss_share_insert(struct nscss_share_cache *cache, uint32_t hash,
+		const nscss_select_ctx *ctx,
+		const uint8_t *key, size_t key_len,
+		const css_select_results *styles,
+		const css_unit_ctx *unit_len_ctx)
+{
+	struct nscss_share_entry *entry;
+	uint32_t bucket = hash % SHARE_CACHE_BUCKETS;
+
+	if (cache->entries >= SHARE_CACHE_MAX_ENTRIES) {
+		nscss_share_cache_flush(cache);
+	}
+
+	entry = malloc(sizeof(*entry) + key_len);
+	if (entry == NULL) {
+		return;
+	}
+
+	entry->styles = nscss_share_ref(styles, ctx->parent_style,
+			unit_len_ctx);
+	if (entry->styles == NULL) {
+		free(entry);
+		return;
+	}
+
+	entry->hash = hash;
+	entry->parent = ctx->parent_share;
+	entry->id = ctx->share_id;
+	entry->key_len = key_len;
+	memcpy(entry->key, key, key_len);
+
+	entry->next = cache->buckets[bucket];
+	cache->buckets[bucket] = entry;
+	cache->entries++;
+}
+
 /**
  * Get style selection results for an element
  *
@@ -249,17 +655,67 @@ static void nscss_dom_user_data_handler(dom_node_operation operation,
  * \param inline_style    Inline style associated with element, or NULL
  * \return Pointer to selection results (containing computed styles),
  *         or NULL on failure
+ *
+ * If \a ctx has a style sharing cache, the element may be given the
+ * styles of an earlier element instead of running selection.  On
+ * success, ctx->share_id holds the element's sharing identity.
  */
 css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 		const css_media *media,
 		const css_unit_ctx *unit_len_ctx,
 		const css_stylesheet *inline_style)
 {
+	struct nscss_share_cache *share = ctx->share;
+	uint8_t key[SHARE_KEY_MAX];
+	size_t key_len = 0;
+	uint32_t hash = 0;
 	css_computed_style *composed;
 	css_select_results *styles;
 	int pseudo_element;
 	css_error error;
 
+	/* Elements with inline style, or whose parent has no sharing
+	 * identity, can't share styles */
+	if (share != NULL && inline_style != NULL) {
+		share->unshareable++;
+		share = NULL;
+	} else if (share != NULL && ctx->parent_share == 0) {
+		share = NULL;
+	}
+
+	if (share != NULL) {
+		key_len = nscss_share_key(n, key);
+		if (key_len == 0) {
+			share->unshareable++;
+			share = NULL;
+		}
+	}
+
+	if (share != NULL) {
+		struct nscss_share_entry *entry;
+
+		hash = nscss_share_hash(ctx->parent_share, key, key_len);
+		entry = nscss_share_find(share, hash, ctx->parent_share,
+				key, key_len);
+		if (entry != NULL) {
+			styles = nscss_share_ref(entry->styles,
+					ctx->parent_style, unit_len_ctx);
+			if (styles != NULL) {
+				share->hits++;
+				ctx->share_id = entry->id;
+				return styles;
+			}
+		}
+	}
+
+	/* Give the element a sharing identity of its own */
+	if (ctx->share != NULL) {
+		ctx->share_id = ctx->share->next_id++;
+	} else {
+		ctx->share_id = 0;
+	}
+	ctx->share_taint = false;
+
 	/* Select style for node */
 	error = css_select_style(ctx->ctx, n, unit_len_ctx, media, inline_style,
 			&selection_handler, ctx, &styles);
@@ -320,6 +776,20 @@ css_select_results *nscss_get_style(nscss_select_ctx *ctx, dom_node *n,
 		styles->styles[pseudo_element] = composed;
 	}
 
+	if (share != NULL) {
+		if (ctx->share_taint ||
+				styles->styles[CSS_PSEUDO_ELEMENT_FIRST_LETTER] != NULL ||
+				styles->styles[CSS_PSEUDO_ELEMENT_FIRST_LINE] != NULL) {
+			/* Selection depended on the element's position in
+			 * the document, or left partial styles behind */
+			share->unshareable++;
+		} else {
+			share->misses++;
+			nscss_share_insert(share, hash, ctx, key, key_len,
+					styles, unit_len_ctx);
+		}
+	}
+
 	return styles;
 }
 
@@ -513,12 +983,16 @@ css_error named_parent_node(void *pw, void *node,
 css_error named_sibling_node(void *pw, void *node,
 		const css_qname *qname, void **sibling)
 {
+	nscss_select_ctx *ctx = pw;
 	dom_node *n = node;
 	dom_node *prev;
 	dom_exception err;
 
 	*sibling = NULL;
 
+	/* Result depends on the node's position */
+	ctx->share_taint = true;
+
 	/* Find sibling element */
 	err = dom_node_get_previous_sibling(n, &n);
 	if (err != DOM_NO_ERR)
@@ -581,12 +1055,16 @@ css_error named_sibling_node(void *pw, void *node,
 css_error named_generic_sibling_node(void *pw, void *node,
 		const css_qname *qname, void **sibling)
 {
+	nscss_select_ctx *ctx = pw;
 	dom_node *n = node;
 	dom_node *prev;
 	dom_exception err;
 
 	*sibling = NULL;
 
+	/* Result depends on the node's position */
+	ctx->share_taint = true;
+
 	err = dom_node_get_previous_sibling(n, &n);
 	if (err != DOM_NO_ERR)
 		return CSS_OK;
@@ -661,12 +1139,16 @@ css_error parent_node(void *pw, void *node, void **parent)
  */
 css_error sibling_node(void *pw, void *node, void **sibling)
 {
+	nscss_select_ctx *ctx = pw;
 	dom_node *n = node;
 	dom_node *prev;
 	dom_exception err;
 
 	*sibling = NULL;
 
+	/* Result depends on the node's position */
+	ctx->share_taint = true;
+
 	/* Find sibling element */
 	err = dom_node_get_previous_sibling(n, &n);
 	if (err != DOM_NO_ERR)
@@ -1319,10 +1801,14 @@ node_count_siblings_check(dom_node *node,
 css_error node_count_siblings(void *pw, void *n, bool same_name,
 		bool after, int32_t *count)
 {
+	nscss_select_ctx *ctx = pw;
 	int32_t cnt = 0;
 	dom_exception exc;
 	dom_string *node_name = NULL;
 
+	/* Result depends on the node's position */
+	ctx->share_taint = true;
+
 	if (same_name) {
 		dom_node *node = n;
 		exc = dom_node_get_node_name(node, &node_name);
@@ -1382,9 +1868,13 @@ css_error node_count_siblings(void *pw, void *n, bool same_name,
  */
 css_error node_is_empty(void *pw, void *node, bool *match)
 {
+	nscss_select_ctx *ctx = pw;
 	dom_node *n = node, *next;
 	dom_exception err;
 
+	/* Result depends on the node's children */
+	ctx->share_taint = true;
+
 	*match = true;
 
 	err = dom_node_get_first_child(n, &n);
@@ -25,8 +25,11 @@
 
 #include <libcss/libcss.h>
 
+#include "utils/errors.h"
+
 struct content;
 struct nsurl;
+struct nscss_share_cache;
 
 /**
  * Selection context
@@ -39,8 +42,20 @@ typedef struct nscss_select_ctx
 	lwc_string *universal;
 	const css_computed_style *root_style;
 	const css_computed_style *parent_style;
+	/** Style sharing cache, or NULL to select without sharing */
+	struct nscss_share_cache *share;
+	/** Sharing identity of the parent element, or 0 if none */
+	uint32_t parent_share;
+	/** Sharing identity given to the selected element (out) */
+	uint32_t share_id;
+	/** Selection looked at more than the element's sharing key */
+	bool share_taint;
 } nscss_select_ctx;
 
+nserror nscss_share_cache_create(struct nscss_share_cache **cache);
+
+void nscss_share_cache_destroy(struct nscss_share_cache *cache);
+
 css_stylesheet *nscss_create_inline_style(const uint8_t *data, size_t len,
 		const char *charset, const char *url, bool allow_quirks);
 
@@ -29,6 +29,7 @@
 
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <libcss/libcss.h>
 
 #include "content/handlers/css/utils.h"
@@ -41,12 +42,16 @@ struct nsurl;
 struct dom_node;
 struct dom_string;
 struct rect;
+struct box_layout_cache;
+struct box_arena;
+struct box_index;
 
 #define UNKNOWN_WIDTH INT_MAX
 #define UNKNOWN_MAX_WIDTH INT_MAX
 
 
 typedef void (*box_construct_complete_cb)(struct html_content *c, bool success);
+typedef bool (*box_construct_progress_cb)(struct html_content *c);
 
 
 /**
@@ -86,7 +91,10 @@ typedef enum {
 	REPLACE_DIM = 1 << 9,	/* replaced element has given dimensions */
 	IFRAME      = 1 << 10,	/* box contains an iframe */
 	CONVERT_CHILDREN = 1 << 11,  /* wanted children converting */
-	IS_REPLACED = 1 << 12	/* box is a replaced element */
+	IS_REPLACED = 1 << 12,	/* box is a replaced element */
+	LAYOUT_DIRTY = 1 << 13,	/* box or a descendant changed since layout */
+	LAYOUT_REUSED = 1 << 14, /* previous layout of subtree was reused */
+	ARENA_FREE  = 1 << 15	/* box is unused in its arena */
 } box_flags;
 
 
@@ -183,6 +191,11 @@ struct box {
 	 */
 	box_flags flags;
 
+	/**
+	 * Arena the box was allocated from.
+	 */
+	struct box_arena *arena;
+
 	/**
 	 * DOM node that generated this box or NULL
 	 */
@@ -258,6 +271,12 @@ struct box {
 	 */
 	struct box *float_container;
 
+	/**
+	 * Spatial index of the in-flow children, or NULL if the box has
+	 * too few children or has not been laid out.
+	 */
+	struct box_index *index;
+
 	/**
 	 * Level below which subsequent floats must be cleared.  This
 	 * is used only for boxes with float_children
@@ -269,6 +288,12 @@ struct box {
 	 */
 	int cached_place_below_level;
 
+	/**
+	 * Inputs and results of the previous layout of this box, or NULL.
+	 * Only kept for block formatting contexts and inline containers.
+	 */
+	struct box_layout_cache *layout_cache;
+
 
 	/**
 	 * Coordinate of left padding edge relative to parent box, or
@@ -409,6 +434,11 @@ struct box {
 	 */
 	int list_value;
 
+	/**
+	 * Style sharing identity of the element's styles, or 0 if none.
+	 */
+	uint32_t style_share;
+
 	/**
 	 * List marker box if this is a list-item, or NULL.
 	 */
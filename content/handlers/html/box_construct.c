@@ -27,6 +27,7 @@
 
 #include <string.h>
 #include <dom/dom.h>
+#include <nsutils/time.h>
 
 #include "utils/errors.h"
 #include "utils/nsoption.h"
@@ -48,6 +49,15 @@
 #include "html/box_normalise.h"
 #include "html/form_internal.h"
 
+/**
+ * Time box construction may run for before yielding, in milliseconds.
+ *
+ * Kept below a frame interval so the frontend stays responsive while
+ * large documents are converted.  With progressive rendering, the
+ * partial box tree is also laid out and displayed at the end of a slice.
+ */
+#define BOX_CONSTRUCT_SLICE_MS 10
+
 /**
  * Context for box tree construction
  */
@@ -60,7 +70,14 @@ struct box_construct_ctx {
 
 	box_construct_complete_cb cb;	/**< Callback to invoke on completion */
 
-	int *bctx;			/**< talloc context */
+	/** Callback to display the partial box tree, or NULL if not wanted */
+	box_construct_progress_cb progress;
+	bool shown;			/**< Partial box tree is displayed */
+	uint64_t slice_ms;		/**< Length of a time slice */
+
+	struct box_arena *bctx;		/**< box arena and talloc context */
+
+	struct nscss_share_cache *share; /**< Style sharing cache */
 };
 
 /**
@@ -69,6 +86,8 @@ struct box_construct_ctx {
 struct box_construct_props {
 	/** Style from which to inherit, or NULL if none */
 	const css_computed_style *parent_style;
+	/** Style sharing identity of the parent element, or 0 if none */
+	uint32_t parent_share;
 	/** Current link target, or NULL if none */
 	struct nsurl *href;
 	/** Current frame target, or NULL if none */
@@ -174,6 +193,11 @@ box_extract_properties(dom_node *n, struct box_construct_props *props)
 
 			if (parent_box != NULL) {
 				props->parent_style = parent_box->style;
+				/* Only share styles between elements whose
+				 * DOM parent generated the parent box */
+				if (current_node == n)
+					props->parent_share =
+						parent_box->style_share;
 				props->href = parent_box->href;
 				props->target = parent_box->target;
 				props->title = parent_box->title;
@@ -237,16 +261,28 @@ box_extract_properties(dom_node *n, struct box_construct_props *props)
  * Get the style for an element.
  *
  * \param  c               content of type CONTENT_HTML that is being processed
- * \param  parent_style    style at this point in xml tree, or NULL for root
+ * \param  share           style sharing cache, or NULL
+ * \param  props           construction properties of the node
  * \param  root_style      root node's style, or NULL for root
  * \param  n               node in xml tree
+ * \param  share_id        updated to the style sharing identity of the node
  * \return  the new style, or NULL on memory exhaustion
+ *
+ * \note Selection must stay on the thread running the core, unlike the
+ *       minimum and maximum width pass in layout.  libwapcaplet interns
+ *       strings in one global table, libcss interns computed styles in
+ *       one global arena and libdom reference counts are not atomic,
+ *       so selecting styles for subtrees concurrently would corrupt
+ *       them.  Repeated selection is instead avoided by the style
+ *       sharing cache.
  */
 static css_select_results *
 box_get_style(html_content *c,
-	      const css_computed_style *parent_style,
+	      struct nscss_share_cache *share,
+	      const struct box_construct_props *props,
 	      const css_computed_style *root_style,
-	      dom_node *n)
+	      dom_node *n,
+	      uint32_t *share_id)
 {
 	dom_string *s;
 	dom_exception err;
@@ -279,12 +315,18 @@ box_get_style(html_content *c,
 	ctx.base_url = c->base_url;
 	ctx.universal = c->universal;
 	ctx.root_style = root_style;
-	ctx.parent_style = parent_style;
+	ctx.parent_style = props->parent_style;
+	ctx.share = share;
+	ctx.parent_share = props->parent_share;
+	ctx.share_id = 0;
+	ctx.share_taint = false;
 
 	/* Select style for element */
 	styles = nscss_get_style(&ctx, n, &c->media, &c->unit_len_ctx,
 			inline_style);
 
+	*share_id = ctx.share_id;
+
 	/* No longer need inline style */
 	if (inline_style != NULL)
 		css_stylesheet_destroy(inline_style);
@@ -457,6 +499,7 @@ box_construct_element(struct box_construct_ctx *ctx, bool *convert_children)
 	dom_exception err;
 	struct box_construct_props props;
 	const css_computed_style *root_style = NULL;
+	uint32_t share_id = 0;
 
 	assert(ctx->n != NULL);
 
@@ -473,8 +516,8 @@ box_construct_element(struct box_construct_ctx *ctx, bool *convert_children)
 		root_style = ctx->root_box->style;
 	}
 
-	styles = box_get_style(ctx->content, props.parent_style, root_style,
-			ctx->n);
+	styles = box_get_style(ctx->content, ctx->share, &props, root_style,
+			ctx->n, &share_id);
 	if (styles == NULL)
 		return false;
 
@@ -518,6 +561,8 @@ box_construct_element(struct box_construct_ctx *ctx, bool *convert_children)
 	if (box == NULL)
 		return false;
 
+	box->style_share = share_id;
+
 	/* If this is the root box, add it to the context */
 	if (props.node_is_root)
 		ctx->root_box = box;
@@ -1023,7 +1068,7 @@ static bool box_construct_text(struct box_construct_ctx *ctx)
 
 		box->type = BOX_TEXT;
 
-		box->text = talloc_strdup(ctx->bctx, text);
+		box->text = box_arena_strdup(ctx->bctx, text);
 		free(text);
 		if (box->text == NULL)
 			return false;
@@ -1142,7 +1187,7 @@ static bool box_construct_text(struct box_construct_ctx *ctx)
 
 			box->type = BOX_TEXT;
 
-			box->text = talloc_strdup(ctx->bctx, current);
+			box->text = box_arena_strdup(ctx->bctx, current);
 			if (box->text == NULL) {
 				free(text);
 				return false;
@@ -1187,15 +1232,165 @@ static bool box_construct_text(struct box_construct_ctx *ctx)
 
 
 /**
- * Convert an ELEMENT node to a box tree fragment,
- * then schedule conversion of the next ELEMENT node
+ * Free a box tree construction context
+ *
+ * \param ctx  Context to free
+ */
+static void box_construct_ctx_free(struct box_construct_ctx *ctx)
+{
+	nscss_share_cache_destroy(ctx->share);
+	free(ctx);
+}
+
+
+/**
+ * Check whether the partial box tree may be normalised and laid out
+ *
+ * Every box which will receive further children must be a block, so no
+ * inline is left without its INLINE_END and no table is incomplete.
+ * The last child of each such block must not be a table part, as later
+ * siblings would have to join the anonymous table normalisation creates.
+ *
+ * \param ctx  Tree construction context
+ * \return true if the tree is complete enough to display
+ */
+static bool box_construct_partial_tree_safe(struct box_construct_ctx *ctx)
+{
+	dom_node *node, *parent;
+	dom_exception err;
+
+	if (ctx->root_box == NULL)
+		return false;
+
+	parent = NULL;
+	err = dom_node_get_parent_node(ctx->n, &parent);
+	while (err == DOM_NO_ERR && parent != NULL) {
+		dom_node_type type;
+		struct box *box;
+
+		err = dom_node_get_node_type(parent, &type);
+		if (err != DOM_NO_ERR || type != DOM_ELEMENT_NODE)
+			break;
+
+		box = box_for_node(parent);
+		if (box == NULL || box->type != BOX_BLOCK ||
+				(box->last != NULL &&
+				 (box->last->type == BOX_TABLE_ROW_GROUP ||
+				  box->last->type == BOX_TABLE_ROW ||
+				  box->last->type == BOX_TABLE_CELL))) {
+			dom_node_unref(parent);
+			return false;
+		}
+
+		node = parent;
+		parent = NULL;
+		err = dom_node_get_parent_node(node, &parent);
+		dom_node_unref(node);
+	}
+
+	if (parent != NULL)
+		dom_node_unref(parent);
+
+	return err == DOM_NO_ERR;
+}
+
+
+/**
+ * Normalise the partial box tree and have it laid out and displayed
+ *
+ * The next slice is made three times as long as this took, so the
+ * checkpoints take at most a quarter of the conversion time.
+ *
+ * \param ctx  Tree construction context
+ * \return true on success, false on memory exhaustion
+ */
+static bool box_construct_checkpoint(struct box_construct_ctx *ctx)
+{
+	struct box root;
+	uint64_t start_ms, end_ms;
+	bool ok;
+
+	nsu_getmonotonic_ms(&start_ms);
+
+	memset(&root, 0, sizeof(root));
+
+	root.type = BOX_BLOCK;
+	root.children = root.last = ctx->root_box;
+	ctx->root_box->parent = &root;
+
+	ok = box_normalise_block(&root, ctx->root_box, ctx->content);
+
+	ctx->root_box->parent = NULL;
+
+	if (ok == false)
+		return false;
+
+	ctx->content->layout = ctx->root_box;
+	ctx->content->unsettled = false;
+
+	if (ctx->progress(ctx->content)) {
+		ctx->shown = true;
+	} else {
+		/* Not displayed; wait for the whole tree */
+		ctx->content->layout = NULL;
+		ctx->progress = NULL;
+	}
+
+	nsu_getmonotonic_ms(&end_ms);
+
+	ctx->slice_ms = 3 * (end_ms - start_ms);
+	if (ctx->slice_ms < BOX_CONSTRUCT_SLICE_MS)
+		ctx->slice_ms = BOX_CONSTRUCT_SLICE_MS;
+
+	return true;
+}
+
+
+/**
+ * Check whether a document contains frames or iframes
+ *
+ * Browser windows for these are only created when the content becomes
+ * ready, so such documents are not displayed until construction ends.
+ *
+ * \param c  Content to check
+ * \return true if the document has frames, or on error
+ */
+static bool box_construct_has_frames(html_content *c)
+{
+	dom_string *names[] = { corestring_dom_frameset, corestring_dom_iframe };
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		dom_nodelist *nlist;
+		dom_exception exc;
+		uint32_t length;
+
+		exc = dom_document_get_elements_by_tag_name(c->document,
+				names[i], &nlist);
+		if (exc != DOM_NO_ERR)
+			return true;
+
+		exc = dom_nodelist_get_length(nlist, &length);
+		dom_nodelist_unref(nlist);
+		if (exc != DOM_NO_ERR || length != 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Convert ELEMENT nodes to box tree fragments until the time slice
+ * is used up, then schedule conversion of the next ELEMENT node
  */
 static void convert_xml_to_box(struct box_construct_ctx *ctx)
 {
 	dom_node *next;
 	bool convert_children;
-	uint32_t num_processed = 0;
-	const uint32_t max_processed_before_yield = 10;
+	uint64_t start_ms, now_ms;
+
+	nsu_getmonotonic_ms(&start_ms);
 
 	do {
 		convert_children = true;
@@ -1205,7 +1400,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 		if (box_construct_element(ctx, &convert_children) == false) {
 			ctx->cb(ctx->content, false);
 			dom_node_unref(ctx->n);
-			free(ctx);
+			box_construct_ctx_free(ctx);
 			return;
 		}
 
@@ -1219,7 +1414,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 			if (err != DOM_NO_ERR) {
 				ctx->cb(ctx->content, false);
 				dom_node_unref(next);
-				free(ctx);
+				box_construct_ctx_free(ctx);
 				return;
 			}
 
@@ -1231,7 +1426,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 				if (box_construct_text(ctx) == false) {
 					ctx->cb(ctx->content, false);
 					dom_node_unref(ctx->n);
-					free(ctx);
+					box_construct_ctx_free(ctx);
 					return;
 				}
 			}
@@ -1258,16 +1453,34 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 			} else {
 				ctx->content->layout = root.children;
 				ctx->content->layout->parent = NULL;
+				ctx->content->unsettled = false;
 
 				ctx->cb(ctx->content, true);
 			}
 
 			assert(ctx->n == NULL);
 
-			free(ctx);
+			box_construct_ctx_free(ctx);
 			return;
 		}
-	} while (++num_processed < max_processed_before_yield);
+		nsu_getmonotonic_ms(&now_ms);
+	} while (now_ms - start_ms < ctx->slice_ms);
+
+	if (ctx->progress != NULL) {
+		if (box_construct_partial_tree_safe(ctx)) {
+			if (box_construct_checkpoint(ctx) == false) {
+				ctx->cb(ctx->content, false);
+				dom_node_unref(ctx->n);
+				box_construct_ctx_free(ctx);
+				return;
+			}
+		} else if (ctx->shown) {
+			/* The displayed tree has changed but can not be
+			 * laid out; keep it from the rest of the browser
+			 * until a later slice ends at a checkpoint */
+			ctx->content->unsettled = true;
+		}
+	}
 
 	/* More work to do: schedule a continuation */
 	guit->misc->schedule(0, (void *)convert_xml_to_box, ctx);
@@ -1279,6 +1492,7 @@ nserror
 dom_to_box(dom_node *n,
 	   html_content *c,
 	   box_construct_complete_cb cb,
+	   box_construct_progress_cb progress,
 	   void **box_conversion_context)
 {
 	struct box_construct_ctx *ctx;
@@ -1286,8 +1500,8 @@ dom_to_box(dom_node *n,
 	assert(box_conversion_context != NULL);
 
 	if (c->bctx == NULL) {
-		/* create a context allocation for this box tree */
-		c->bctx = talloc_zero(0, int);
+		/* create an arena for this box tree */
+		c->bctx = box_arena_create();
 		if (c->bctx == NULL) {
 			return NSERROR_NOMEM;
 		}
@@ -1302,7 +1516,21 @@ dom_to_box(dom_node *n,
 	ctx->n = dom_node_ref(n);
 	ctx->root_box = NULL;
 	ctx->cb = cb;
+	ctx->progress = NULL;
+	ctx->shown = false;
+	ctx->slice_ms = BOX_CONSTRUCT_SLICE_MS;
 	ctx->bctx = c->bctx;
+	ctx->share = NULL;
+
+	if (nscss_share_cache_create(&ctx->share) != NSERROR_OK) {
+		/* Construct without sharing styles */
+		ctx->share = NULL;
+	}
+
+	if (nsoption_bool(progressive_render) &&
+			box_construct_has_frames(c) == false) {
+		ctx->progress = progress;
+	}
 
 	*box_conversion_context = ctx;
 
@@ -1322,7 +1550,7 @@ nserror cancel_dom_to_box(void *box_conversion_context)
 	}
 
 	dom_node_unref(ctx->n);
-	free(ctx);
+	box_construct_ctx_free(ctx);
 
 	return NSERROR_OK;
 }
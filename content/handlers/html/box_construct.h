@@ -78,10 +78,13 @@
  * \param n dom document
  * \param c content of type CONTENT_HTML to construct box tree in
  * \param cb callback to report conversion completion
+ * \param progress callback to display a partial box tree, when the
+ *                 progressive_render option is set; it returns false
+ *                 to leave the tree undisplayed until completion
  * \param box_conversion_context pointer that recives the conversion context
  * \return netsurf error code indicating status of call
  */
-nserror dom_to_box(struct dom_node *n, struct html_content *c, box_construct_complete_cb cb, void **box_conversion_context);
+nserror dom_to_box(struct dom_node *n, struct html_content *c, box_construct_complete_cb cb, box_construct_progress_cb progress, void **box_conversion_context);
 
 
 /**
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2026 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * implementation of the spatial index of the children of boxes.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <dom/dom.h>
+
+#include "css/utils.h"
+
+#include "html/box.h"
+#include "html/box_index.h"
+
+/** Number of in-flow children a box needs before it is indexed */
+#define BOX_INDEX_MIN_CHILDREN 32
+
+
+/**
+ * Check whether a child is walked as part of the normal flow.
+ */
+static inline bool box_index_in_flow(const struct box *box)
+{
+	return box->type != BOX_FLOAT_LEFT && box->type != BOX_FLOAT_RIGHT;
+}
+
+
+/**
+ * Find the vertical extent of a box and its descendants.
+ *
+ * The extent covers everything hit testing and redraw consider part of
+ * the box: its border box, its descendant box and its list marker.
+ *
+ * \param box box to measure
+ * \param top updated with the top edge, relative to the parent
+ * \param bottom updated with the bottom edge, relative to the parent
+ */
+static void box_index_extent(const struct box *box, int *top, int *bottom)
+{
+	const struct box *marker = box->list_marker;
+	css_computed_clip_rect css_rect;
+	int y0, y1;
+
+	if (box->style != NULL &&
+	    css_computed_position(box->style) == CSS_POSITION_ABSOLUTE &&
+	    css_computed_clip(box->style, &css_rect) == CSS_CLIP_RECT) {
+		/* the clip rectangle may lie anywhere */
+		*top = INT_MIN;
+		*bottom = INT_MAX;
+		return;
+	}
+
+	y0 = -box->border[TOP].width;
+	y1 = box->padding[TOP] + box->height + box->padding[BOTTOM] +
+			box->border[BOTTOM].width;
+	if (box->descendant_y0 < y0)
+		y0 = box->descendant_y0;
+	if (box->descendant_y1 + 1 > y1)
+		y1 = box->descendant_y1 + 1;
+	y0 += box->y;
+	y1 += box->y;
+
+	if (marker != NULL) {
+		/* list markers are positioned in the same space as the box */
+		if (marker->y - marker->border[TOP].width < y0)
+			y0 = marker->y - marker->border[TOP].width;
+		if (marker->y + marker->padding[TOP] + marker->height +
+				marker->padding[BOTTOM] +
+				marker->border[BOTTOM].width > y1)
+			y1 = marker->y + marker->padding[TOP] +
+					marker->height +
+					marker->padding[BOTTOM] +
+					marker->border[BOTTOM].width;
+	}
+
+	*top = y0;
+	*bottom = y1;
+}
+
+
+/**
+ * Build the index of the children of a box.
+ *
+ * \param box box to index
+ * \param count number of in-flow children of box
+ */
+static void box_index_build(struct box *box, unsigned int count)
+{
+	struct box_index *index = box->index;
+	struct box *child;
+	unsigned int i;
+	int top, bottom;
+
+	if (index != NULL && index->count != count) {
+		box_index_invalidate(box);
+		index = NULL;
+	}
+
+	if (index == NULL) {
+		index = malloc(sizeof(*index) +
+				count * (sizeof(*index->child) +
+					 sizeof(*index->top) +
+					 sizeof(*index->bottom)));
+		if (index == NULL) {
+			/* Not fatal; the children are walked instead */
+			return;
+		}
+		index->count = count;
+		index->child = (struct box **)(index + 1);
+		index->top = (int *)(index->child + count);
+		index->bottom = index->top + count;
+		box->index = index;
+	}
+
+	i = 0;
+	for (child = box->children; child != NULL; child = child->next) {
+		if (!box_index_in_flow(child))
+			continue;
+
+		box_index_extent(child, &top, &bottom);
+
+		index->child[i] = child;
+		index->top[i] = top;
+		index->bottom[i] = bottom;
+		if (i > 0 && index->bottom[i - 1] > bottom)
+			index->bottom[i] = index->bottom[i - 1];
+		i++;
+	}
+
+	/* make top the lowest top edge of each child and those after it */
+	for (i = count - 1; i > 0; i--) {
+		if (index->top[i] < index->top[i - 1])
+			index->top[i - 1] = index->top[i];
+	}
+}
+
+
+/* exported function documented in html/box_index.h */
+void box_index_update(struct box *box)
+{
+	struct box *child;
+	unsigned int count = 0;
+
+	for (child = box->children; child != NULL; child = child->next) {
+		if (box_index_in_flow(child))
+			count++;
+
+		box_index_update(child);
+	}
+
+	if (count < BOX_INDEX_MIN_CHILDREN) {
+		box_index_invalidate(box);
+	} else {
+		box_index_build(box, count);
+	}
+}
+
+
+/* exported function documented in html/box_index.h */
+void box_index_invalidate(struct box *box)
+{
+	free(box->index);
+	box->index = NULL;
+}
+
+
+/* exported function documented in html/box_index.h */
+void box_index_range(const struct box_index *index, int y0, int y1,
+		unsigned int *first, unsigned int *last)
+{
+	unsigned int lo, hi, mid;
+
+	/* first child whose bottom, or any before it, reaches below y0 */
+	lo = 0;
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->bottom[mid] <= y0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*first = lo;
+
+	/* first child from which every top edge is below y1 */
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->top[mid] <= y1)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*last = lo;
+}
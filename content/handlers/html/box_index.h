@@ -0,0 +1,95 @@
+/*
+ * Copyright 2026 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Spatial index of the children of boxes interface.
+ *
+ * Boxes with many in-flow children keep an index of the vertical extent
+ * of each child, including its descendants. This lets hit testing and
+ * redraw find the children which may intersect a range of y
+ * coordinates without visiting every child above that range.
+ *
+ * The index is rebuilt after every layout and dropped whenever the
+ * children of a box change.
+ */
+
+#ifndef NETSURF_HTML_BOX_INDEX_H
+#define NETSURF_HTML_BOX_INDEX_H
+
+struct box;
+
+/**
+ * Index of the in-flow children of a box, in tree order.
+ */
+struct box_index {
+	/** Number of in-flow children */
+	unsigned int count;
+
+	/** In-flow children in tree order */
+	struct box **child;
+
+	/**
+	 * Lowest top edge of each child and all children after it,
+	 * relative to the parent's content origin.
+	 */
+	int *top;
+
+	/**
+	 * Highest bottom edge of each child and all children before it,
+	 * relative to the parent's content origin.
+	 */
+	int *bottom;
+};
+
+
+/**
+ * Rebuild the child indexes of a laid out box tree.
+ *
+ * Failure to allocate an index is not fatal; boxes without an index are
+ * searched by walking all their children.
+ *
+ * \param box root of the tree to index
+ */
+void box_index_update(struct box *box);
+
+
+/**
+ * Discard the child index of a box.
+ *
+ * \param box box whose children have changed
+ */
+void box_index_invalidate(struct box *box);
+
+
+/**
+ * Find the children of an indexed box which may intersect a y range.
+ *
+ * Children outside the range [first, last) are guaranteed not to extend
+ * into the range y0 to y1 inclusive.
+ *
+ * \param index index of the box's children
+ * \param y0 top of range, relative to the box's content origin
+ * \param y1 bottom of range, relative to the box's content origin
+ * \param first updated with the index of the first candidate child
+ * \param last updated with the index after the last candidate child
+ */
+void box_index_range(const struct box_index *index, int y0, int y1,
+		unsigned int *first, unsigned int *last);
+
+#endif
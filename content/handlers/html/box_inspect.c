@@ -36,6 +36,7 @@
 
 #include "html/private.h"
 #include "html/box.h"
+#include "html/box_index.h"
 #include "html/box_inspect.h"
 
 /**
@@ -577,6 +578,24 @@ void box_bounds(struct box *box, struct rect *r)
 }
 
 
+/**
+ * Move from a box to one of its siblings, adjusting for box coord change
+ *
+ * \param from box to move from
+ * \param to sibling to move to
+ * \param x box's global x-coord, updated to position of sibling
+ * \param y box's global y-coord, updated to position of sibling
+ * \return the sibling
+ */
+static inline struct box *
+box_jump_xy(struct box *from, struct box *to, int *x, int *y)
+{
+	*x += to->x - from->x;
+	*y += to->y - from->y;
+	return to;
+}
+
+
 /* Exported function documented in html/box.h */
 struct box *
 box_at_point(const css_unit_ctx *unit_len_ctx,
@@ -586,11 +605,38 @@ box_at_point(const css_unit_ctx *unit_len_ctx,
 {
 	bool skip_children;
 	bool physically;
+	const struct box_index *index;
+	unsigned int first, last;
 
 	assert(box);
 
 	skip_children = false;
 	while ((box = box_next_xy(box, box_x, box_y, skip_children))) {
+		/* Use the parent's index, if any, to skip over siblings
+		 * which cannot contain the point */
+		index = NULL;
+		if (box->parent != NULL && !box_is_float(box)) {
+			index = box->parent->index;
+		}
+		if (index != NULL) {
+			int py = y - *box_y + box->y;
+
+			box_index_range(index, py, py, &first, &last);
+
+			if (box == index->child[0]) {
+				if (first >= last) {
+					/* no child can contain the point */
+					box = box_jump_xy(box,
+						index->child[index->count - 1],
+						box_x, box_y);
+					skip_children = true;
+					continue;
+				}
+				box = box_jump_xy(box, index->child[first],
+						  box_x, box_y);
+			}
+		}
+
 		if (box_contains_point(unit_len_ctx, box, x - *box_x, y - *box_y,
 				       &physically)) {
 			*box_x -= scrollbar_get_offset(box->scroll_x);
@@ -602,6 +648,16 @@ box_at_point(const css_unit_ctx *unit_len_ctx,
 			skip_children = false;
 		} else {
 			skip_children = true;
+
+			if (index != NULL && last > 0 &&
+			    (box == index->child[last - 1] ||
+			     (last < index->count &&
+			      box == index->child[last]))) {
+				/* no later child can contain the point */
+				box = box_jump_xy(box,
+						index->child[index->count - 1],
+						box_x, box_y);
+			}
 		}
 	}
 
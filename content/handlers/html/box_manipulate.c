@@ -26,7 +26,12 @@
  */
 
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "utils/errors.h"
+#include "utils/log.h"
+#include "netsurf/inttypes.h"
 #include "utils/talloc.h"
 #include "utils/nsurl.h"
 #include "netsurf/types.h"
@@ -38,15 +43,60 @@
 #include "html/interaction.h"
 #include "html/box.h"
 #include "html/box_manipulate.h"
+#include "html/box_index.h"
+
+
+/** Number of boxes in each slab of a box arena */
+#define BOX_ARENA_SLAB_BOXES 256
+
+/** Size of each block of box text in a box arena */
+#define BOX_ARENA_TEXT_SIZE 16384
+
+/**
+ * Slab of boxes in a box arena.
+ */
+struct box_arena_slab {
+	struct box_arena_slab *next; /**< next older slab */
+	unsigned int used; /**< number of boxes handed out from slab */
+	struct box box[BOX_ARENA_SLAB_BOXES]; /**< the boxes */
+};
+
+/**
+ * Block of box text in a box arena.
+ */
+struct box_arena_text {
+	struct box_arena_text *next; /**< next older block */
+	size_t used; /**< number of bytes handed out from block */
+	size_t size; /**< size of data */
+	char data[]; /**< the text */
+};
+
+/**
+ * Allocator for the boxes and text of one box tree.
+ *
+ * Boxes and text are handed out from large slabs which are all released
+ * together when the arena, which is also the talloc context for the
+ * rest of the box tree, is freed.
+ */
+struct box_arena {
+	struct box_arena_slab *slabs; /**< box slabs, newest first */
+	struct box_arena_text *text; /**< text blocks, newest first */
+	struct box *free_boxes; /**< boxes freed individually, for reuse */
+
+	unsigned int box_allocs; /**< number of boxes handed out */
+	unsigned int box_frees; /**< number of boxes freed individually */
+	unsigned int text_allocs; /**< number of text runs handed out */
+	size_t text_used; /**< bytes of text handed out */
+	size_t size; /**< total size of slabs and blocks */
+};
 
 
 /**
- * Destructor for box nodes which own styles
+ * Release the resources owned by a box.
  *
  * \param b The box being destroyed.
- * \return 0 to allow talloc to continue destroying the tree.
  */
-static int box_talloc_destructor(struct box *b)
+static void box_destroy(struct box *b)
 {
 	struct html_scrollbar_data *data;
 
@@ -83,10 +133,180 @@ static int box_talloc_destructor(struct box *b)
 		free(data);
 	}
 
+	free(b->col);
+	free(b->layout_cache);
+	box_index_invalidate(b);
+}
+
+
+/**
+ * Destructor for box arenas
+ *
+ * Destroys every box still in use and releases the slabs.
+ *
+ * \param arena The arena being destroyed.
+ * \return 0 to allow talloc to continue destroying the tree.
+ */
+static int box_arena_talloc_destructor(struct box_arena *arena)
+{
+	struct box_arena_slab *slab;
+	struct box_arena_text *text;
+	unsigned int i;
+
+	NSLOG(netsurf, INFO,
+	      "Box arena: %u boxes (%u freed), %u text runs of %"PRIsizet
+	      " bytes; %"PRIsizet" of %"PRIsizet" bytes in use",
+	      arena->box_allocs, arena->box_frees,
+	      arena->text_allocs, arena->text_used,
+	      (arena->box_allocs - arena->box_frees) * sizeof(struct box) +
+	      arena->text_used,
+	      arena->size);
+
+	while (arena->slabs != NULL) {
+		slab = arena->slabs;
+		for (i = 0; i != slab->used; i++) {
+			/* clones share their resources with the original */
+			if ((slab->box[i].flags & (ARENA_FREE | CLONE)) == 0) {
+				box_destroy(&slab->box[i]);
+			}
+		}
+		arena->slabs = slab->next;
+		free(slab);
+	}
+
+	while (arena->text != NULL) {
+		text = arena->text;
+		arena->text = text->next;
+		free(text);
+	}
+
 	return 0;
 }
 
 
+/* Exported function documented in html/box_manipulate.h */
+struct box_arena *box_arena_create(void)
+{
+	struct box_arena *arena;
+
+	arena = talloc_zero(NULL, struct box_arena);
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	talloc_set_destructor(arena, box_arena_talloc_destructor);
+
+	return arena;
+}
+
+
+/**
+ * Allocate an uninitialised box from an arena.
+ *
+ * \param arena The arena to allocate from.
+ * \return The box or NULL on memory exhaustion.
+ */
+static struct box *box_arena_alloc(struct box_arena *arena)
+{
+	struct box_arena_slab *slab = arena->slabs;
+	struct box *box;
+
+	if (arena->free_boxes != NULL) {
+		box = arena->free_boxes;
+		arena->free_boxes = box->next;
+		arena->box_allocs++;
+		return box;
+	}
+
+	if (slab == NULL || slab->used == BOX_ARENA_SLAB_BOXES) {
+		slab = malloc(sizeof(*slab));
+		if (slab == NULL) {
+			return NULL;
+		}
+		slab->used = 0;
+		slab->next = arena->slabs;
+		arena->slabs = slab;
+		arena->size += sizeof(*slab);
+	}
+
+	arena->box_allocs++;
+
+	return &slab->box[slab->used++];
+}
+
+
+/* Exported function documented in html/box_manipulate.h */
+char *
+box_arena_strndup(struct box_arena *arena, const char *text, size_t len)
+{
+	struct box_arena_text *block = arena->text;
+	char *copy;
+
+	if (block == NULL || block->size - block->used < len + 1) {
+		size_t size = BOX_ARENA_TEXT_SIZE;
+
+		if (len + 1 > size) {
+			size = len + 1;
+		}
+
+		block = malloc(sizeof(*block) + size);
+		if (block == NULL) {
+			return NULL;
+		}
+		block->used = 0;
+		block->size = size;
+
+		/* keep filling the current block if the new one is
+		 * just for this text
+		 */
+		if (arena->text != NULL && size > BOX_ARENA_TEXT_SIZE) {
+			block->next = arena->text->next;
+			arena->text->next = block;
+		} else {
+			block->next = arena->text;
+			arena->text = block;
+		}
+		arena->size += sizeof(*block) + size;
+	}
+
+	copy = block->data + block->used;
+	block->used += len + 1;
+
+	memcpy(copy, text, len);
+	copy[len] = '\0';
+
+	arena->text_allocs++;
+	arena->text_used += len + 1;
+
+	return copy;
+}
+
+
+/* Exported function documented in html/box_manipulate.h */
+char *box_arena_strdup(struct box_arena *arena, const char *text)
+{
+	return box_arena_strndup(arena, text, strlen(text));
+}
+
+
+/* Exported function documented in html/box_manipulate.h */
+struct box *box_clone(const struct box *box)
+{
+	struct box *clone;
+
+	clone = box_arena_alloc(box->arena);
+	if (clone == NULL) {
+		return NULL;
+	}
+
+	*clone = *box;
+	clone->flags |= CLONE;
+	clone->index = NULL;
+
+	return clone;
+}
+
+
 /* Exported function documented in html/box.h */
 struct box *
 box_create(css_select_results *styles,
@@ -96,20 +316,19 @@ box_create(css_select_results *styles,
 	   const char *target,
 	   const char *title,
 	   lwc_string *id,
-	   void *context)
+	   struct box_arena *arena)
 {
 	unsigned int i;
 	struct box *box;
 
-	box = talloc(context, struct box);
+	box = box_arena_alloc(arena);
 	if (!box) {
 		return 0;
 	}
 
-	talloc_set_destructor(box, box_talloc_destructor);
-
+	box->arena = arena;
 	box->type = BOX_INLINE;
-	box->flags = 0;
+	box->flags = LAYOUT_DIRTY;
 	box->flags = style_owned ? (box->flags | STYLE_OWNED) : box->flags;
 	box->styles = styles;
 	box->style = style;
@@ -142,8 +361,11 @@ box_create(css_select_results *styles,
 	box->float_children = NULL;
 	box->float_container = NULL;
 	box->next_float = NULL;
+	box->index = NULL;
 	box->cached_place_below_level = 0;
+	box->layout_cache = NULL;
 	box->list_value = 1;
+	box->style_share = 0;
 	box->list_marker = NULL;
 	box->col = NULL;
 	box->gadget = NULL;
@@ -175,6 +397,8 @@ void box_add_child(struct box *parent, struct box *child)
 
 	parent->last = child;
 	child->parent = parent;
+
+	box_mark_layout_dirty(parent);
 }
 
 
@@ -189,6 +413,25 @@ void box_insert_sibling(struct box *box, struct box *new_box)
 		new_box->next->prev = new_box;
 	else if (new_box->parent)
 		new_box->parent->last = new_box;
+
+	if (new_box->parent)
+		box_mark_layout_dirty(new_box->parent);
+}
+
+
+/* Exported function documented in html/box.h */
+void box_mark_layout_dirty(struct box *box)
+{
+	/* The children of the box may have changed */
+	if (box != NULL) {
+		box_index_invalidate(box);
+	}
+
+	/* A dirty box always has dirty ancestors, so stop at the first */
+	for (; box != NULL && !(box->flags & LAYOUT_DIRTY); box = box->parent) {
+		box->flags |= LAYOUT_DIRTY;
+		box->max_width = UNKNOWN_MAX_WIDTH;
+	}
 }
 
 
@@ -204,6 +447,7 @@ void box_unlink_and_free(struct box *box)
 			parent->children = next;
 		if (parent->last == box)
 			parent->last = next ? next : prev;
+		box_mark_layout_dirty(parent);
 	}
 
 	if (prev)
@@ -234,18 +478,19 @@ void box_free(struct box *box)
 /* Exported function documented in html/box.h */
 void box_free_box(struct box *box)
 {
+	struct box_arena *arena = box->arena;
+
 	if (!(box->flags & CLONE)) {
 		if (box->gadget)
 			form_free_control(box->gadget);
-		if (box->scroll_x != NULL)
-			scrollbar_destroy(box->scroll_x);
-		if (box->scroll_y != NULL)
-			scrollbar_destroy(box->scroll_y);
-		if (box->styles != NULL)
-			css_select_results_destroy(box->styles);
+		box_destroy(box);
 	}
 
-	talloc_free(box);
+	/* return the box to the arena for reuse */
+	box->flags = ARENA_FREE;
+	box->next = arena->free_boxes;
+	arena->free_boxes = box;
+	arena->box_frees++;
 }
 
 
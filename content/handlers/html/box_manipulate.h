@@ -25,6 +25,41 @@
 #ifndef NETSURF_HTML_BOX_MANIPULATE_H
 #define NETSURF_HTML_BOX_MANIPULATE_H
 
+struct box_arena;
+
+/**
+ * Create an arena for the boxes and text of a box tree.
+ *
+ * The arena is also a talloc context; freeing it with talloc_free()
+ * destroys every box allocated from it.
+ *
+ * \return new arena or NULL on memory exhaustion
+ */
+struct box_arena *box_arena_create(void);
+
+
+/**
+ * Copy text into a box arena.
+ *
+ * The copy is nul terminated and lives until the arena is freed.
+ *
+ * \param arena arena to allocate from
+ * \param text text to copy
+ * \param len length of text
+ * \return copy of text or NULL on memory exhaustion
+ */
+char *box_arena_strndup(struct box_arena *arena, const char *text, size_t len);
+
+
+/**
+ * Copy a nul terminated string into a box arena.
+ *
+ * \param arena arena to allocate from
+ * \param text string to copy
+ * \return copy of text or NULL on memory exhaustion
+ */
+char *box_arena_strdup(struct box_arena *arena, const char *text);
+
 
 /**
  * Create a box tree node.
@@ -36,13 +71,13 @@
  * \param  target       target for the box (not copied), or 0
  * \param  title        title for the box (not copied), or 0
  * \param  id           id for the box (not copied), or 0
- * \param  context      context for allocations
+ * \param  arena        arena to allocate the box from
  * \return  allocated and initialised box, or 0 on memory exhaustion
  *
  * styles is always owned by the box, if it is set.
  * style is only owned by the box in the case of implied boxes.
  */
-struct box * box_create(css_select_results *styles, css_computed_style *style, bool style_owned, struct nsurl *href, const char *target, const char *title, lwc_string *id, void *context);
+struct box * box_create(css_select_results *styles, css_computed_style *style, bool style_owned, struct nsurl *href, const char *target, const char *title, lwc_string *id, struct box_arena *arena);
 
 
 /**
@@ -63,6 +98,18 @@ void box_add_child(struct box *parent, struct box *child);
 void box_insert_sibling(struct box *box, struct box *new_box);
 
 
+/**
+ * Mark a box as needing layout.
+ *
+ * The box and its ancestors are marked dirty so that the next layout
+ * does not reuse their previous layout, and their minimum and maximum
+ * widths are invalidated.
+ *
+ * \param box box which has changed
+ */
+void box_mark_layout_dirty(struct box *box);
+
+
 /**
  * Unlink a box from the box tree and then free it recursively.
  *
@@ -89,6 +136,17 @@ void box_free(struct box *box);
 void box_free_box(struct box *box);
 
 
+/**
+ * Create a continuation of a box in the same arena.
+ *
+ * The clone shares all the resources of the original box.
+ *
+ * \param box box to clone
+ * \return the clone or NULL on memory exhaustion
+ */
+struct box *box_clone(const struct box *box);
+
+
 /**
  * Applies the given scroll setup to a box. This includes scroll
  * creation/deletion as well as scroll dimension updates.
@@ -1165,7 +1165,7 @@ box_image(dom_node *n,
 		dom_string_unref(s);
 		if (alt == NULL)
 			return false;
-		box->text = talloc_strdup(content->bctx, alt);
+		box->text = box_arena_strdup(content->bctx, alt);
 		free(alt);
 		if (box->text == NULL)
 			return false;
@@ -22,12 +22,109 @@
  * HTML internal font handling implementation.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "utils/log.h"
+#include "netsurf/inttypes.h"
 #include "utils/nsoption.h"
 #include "netsurf/plot_style.h"
+#include "netsurf/layout.h"
 #include "css/utils.h"
 
 #include "html/font.h"
 
+/** Number of hash chains in the measurement cache, a power of two */
+#define FONT_MEASURE_CACHE_BUCKETS 4096
+
+/** Size of measurements at which least recently used ones are dropped */
+#define FONT_MEASURE_CACHE_LIMIT (1024 * 1024)
+
+/** Longest text run the measurement cache holds */
+#define FONT_MEASURE_CACHE_TEXT 1024
+
+/**
+ * Kinds of font measurement.
+ */
+enum font_measure_kind {
+	FONT_MEASURE_WIDTH, /**< width of a string */
+	FONT_MEASURE_SPLIT, /**< split point of a string for a width */
+};
+
+/**
+ * Font measurement cache entry.
+ */
+struct font_measure_entry {
+	struct font_measure_entry *next; /**< next entry in hash chain */
+	struct font_measure_entry *prev_used; /**< more recently used entry */
+	struct font_measure_entry *next_used; /**< less recently used entry */
+
+	const struct gui_layout_table *font_func; /**< measuring functions */
+	uint32_t hash; /**< hash of the whole key */
+	uint32_t families; /**< hash of font family names */
+	plot_font_generic_family_t family; /**< generic font family */
+	plot_style_fixed size; /**< font size */
+	int weight; /**< font weight */
+	plot_font_flags_t flags; /**< font flags */
+	enum font_measure_kind kind; /**< kind of measurement */
+	int x; /**< width to split at, for splits */
+
+	int width; /**< width of the string or of the text before a split */
+	size_t offset; /**< first character after a split */
+
+	size_t length; /**< length of text */
+	size_t families_length; /**< length of family names after text */
+	char text[]; /**< measured text then each family name NUL terminated */
+};
+
+/**
+ * Key for a font measurement.
+ */
+struct font_measure_key {
+	const struct gui_layout_table *font_func; /**< measuring functions */
+	const plot_font_style_t *fstyle; /**< font style */
+	uint32_t families; /**< hash of font family names */
+	enum font_measure_kind kind; /**< kind of measurement */
+	int x; /**< width to split at, for splits */
+	const char *text; /**< text to measure */
+	size_t length; /**< length of text */
+	uint32_t hash; /**< hash of the whole key */
+};
+
+/**
+ * Cache of text measurements shared by all contents.
+ *
+ * Measurements are found by hashing the text run with the parts of the
+ * font style which affect its size. The total size is bounded and the
+ * least recently used measurements are dropped first.
+ */
+static struct font_measure_cache {
+#ifdef WITH_PTHREAD
+	pthread_mutex_t lock; /**< protects entries and statistics */
+#endif
+	struct font_measure_entry *bucket[FONT_MEASURE_CACHE_BUCKETS];
+	struct font_measure_entry *most_used; /**< most recently used */
+	struct font_measure_entry *least_used; /**< least recently used */
+	struct font_measure_stats stats; /**< statistics */
+
+	/** Font options the cached measurements were made with */
+	struct {
+		int size;
+		int min_size;
+		int family;
+		char *names[PLOT_FONT_FAMILY_COUNT];
+	} options;
+} font_measure_cache = {
+#ifdef WITH_PTHREAD
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
 /**
  * Map a generic CSS font family to a generic plot font family
  *
@@ -163,3 +260,550 @@ void font_plot_style_from_css(
 	fstyle->foreground = nscss_color_to_ns(col);
 	fstyle->background = 0;
 }
+
+
+/**
+ * Hash the names of the font families in a font style.
+ *
+ * \param fstyle Font style to hash
+ * \return hash of the family names
+ */
+static uint32_t font_measure_families(const plot_font_style_t *fstyle)
+{
+	lwc_string * const *family;
+	uint32_t hash = 0x811c9dc5;
+
+	if (fstyle->families == NULL) {
+		return hash;
+	}
+
+	for (family = fstyle->families; *family != NULL; family++) {
+		hash ^= lwc_string_hash_value(*family);
+		hash *= 0x01000193;
+	}
+
+	return hash;
+}
+
+
+/**
+ * Length of the family names of a font style as stored in an entry.
+ *
+ * \param fstyle Font style
+ * \return length of the NUL terminated names
+ */
+static size_t font_measure_families_length(const plot_font_style_t *fstyle)
+{
+	lwc_string * const *family;
+	size_t length = 0;
+
+	if (fstyle->families == NULL) {
+		return 0;
+	}
+
+	for (family = fstyle->families; *family != NULL; family++) {
+		length += lwc_string_length(*family) + 1;
+	}
+
+	return length;
+}
+
+
+/**
+ * Check whether the family names stored in an entry match a font style.
+ *
+ * \param entry Cache entry
+ * \param fstyle Font style
+ * \return true if the names are the same else false
+ */
+static bool
+font_measure_families_match(const struct font_measure_entry *entry,
+			    const plot_font_style_t *fstyle)
+{
+	lwc_string * const *family;
+	const char *names = entry->text + entry->length;
+	size_t remaining = entry->families_length;
+
+	if (fstyle->families != NULL) {
+		for (family = fstyle->families; *family != NULL; family++) {
+			size_t len = lwc_string_length(*family);
+
+			if (remaining < len + 1 ||
+			    memcmp(names, lwc_string_data(*family), len) != 0 ||
+			    names[len] != '\0') {
+				return false;
+			}
+			names += len + 1;
+			remaining -= len + 1;
+		}
+	}
+
+	return remaining == 0;
+}
+
+
+/**
+ * Make the key for a measurement.
+ *
+ * The key hash covers the text run and the parts of the font style
+ * which affect its size.
+ *
+ * \param key Key to fill in
+ * \param font_func Frontend font measuring functions
+ * \param fstyle Font style
+ * \param kind Kind of measurement
+ * \param x Width to split at, for splits
+ * \param string UTF-8 string
+ * \param length Length of string
+ */
+static void
+font_measure_key(struct font_measure_key *key,
+		 const struct gui_layout_table *font_func,
+		 const plot_font_style_t *fstyle,
+		 enum font_measure_kind kind,
+		 int x,
+		 const char *string,
+		 size_t length)
+{
+	uint32_t hash;
+	size_t idx;
+
+	key->font_func = font_func;
+	key->fstyle = fstyle;
+	key->families = font_measure_families(fstyle);
+	key->kind = kind;
+	key->x = x;
+	key->text = string;
+	key->length = length;
+
+	hash = key->families;
+	hash = (hash ^ fstyle->family) * 0x01000193;
+	hash = (hash ^ (uint32_t)fstyle->size) * 0x01000193;
+	hash = (hash ^ (uint32_t)fstyle->weight) * 0x01000193;
+	hash = (hash ^ fstyle->flags) * 0x01000193;
+	hash = (hash ^ kind) * 0x01000193;
+	hash = (hash ^ (uint32_t)x) * 0x01000193;
+	for (idx = 0; idx < length; idx++) {
+		hash = (hash ^ (uint8_t)string[idx]) * 0x01000193;
+	}
+	key->hash = hash;
+}
+
+
+/**
+ * Check whether a cache entry holds a measurement.
+ */
+static inline bool
+font_measure_match(const struct font_measure_entry *entry,
+		   const struct font_measure_key *key)
+{
+	return entry->hash == key->hash &&
+		entry->font_func == key->font_func &&
+		entry->families == key->families &&
+		entry->family == key->fstyle->family &&
+		entry->size == key->fstyle->size &&
+		entry->weight == key->fstyle->weight &&
+		entry->flags == key->fstyle->flags &&
+		entry->kind == key->kind &&
+		entry->x == key->x &&
+		entry->length == key->length &&
+		memcmp(entry->text, key->text, key->length) == 0 &&
+		font_measure_families_match(entry, key->fstyle);
+}
+
+
+/**
+ * Unlink an entry from the recently used list.
+ */
+static void
+font_measure_unuse(struct font_measure_cache *cache,
+		   struct font_measure_entry *entry)
+{
+	if (entry->prev_used != NULL) {
+		entry->prev_used->next_used = entry->next_used;
+	} else {
+		cache->most_used = entry->next_used;
+	}
+	if (entry->next_used != NULL) {
+		entry->next_used->prev_used = entry->prev_used;
+	} else {
+		cache->least_used = entry->prev_used;
+	}
+}
+
+
+/**
+ * Make an entry the most recently used.
+ */
+static void
+font_measure_use(struct font_measure_cache *cache,
+		 struct font_measure_entry *entry)
+{
+	entry->prev_used = NULL;
+	entry->next_used = cache->most_used;
+	if (cache->most_used != NULL) {
+		cache->most_used->prev_used = entry;
+	} else {
+		cache->least_used = entry;
+	}
+	cache->most_used = entry;
+}
+
+
+/**
+ * Find a measurement in the cache.
+ *
+ * Must be called with the cache lock held.
+ *
+ * \param cache The measurement cache
+ * \param key Key of the measurement
+ * \return The entry or NULL if the measurement is not cached
+ */
+static struct font_measure_entry *
+font_measure_find(struct font_measure_cache *cache,
+		  const struct font_measure_key *key)
+{
+	struct font_measure_entry *entry;
+
+	entry = cache->bucket[key->hash & (FONT_MEASURE_CACHE_BUCKETS - 1)];
+	while (entry != NULL && !font_measure_match(entry, key)) {
+		entry = entry->next;
+	}
+
+	if (entry != NULL && entry != cache->most_used) {
+		font_measure_unuse(cache, entry);
+		font_measure_use(cache, entry);
+	}
+
+	return entry;
+}
+
+
+/**
+ * Remove the least recently used measurement from the cache.
+ *
+ * Must be called with the cache lock held.
+ *
+ * \param cache The measurement cache
+ */
+static void font_measure_evict(struct font_measure_cache *cache)
+{
+	struct font_measure_entry *entry = cache->least_used;
+	struct font_measure_entry **link;
+
+	link = &cache->bucket[entry->hash & (FONT_MEASURE_CACHE_BUCKETS - 1)];
+	while (*link != entry) {
+		link = &(*link)->next;
+	}
+	*link = entry->next;
+
+	font_measure_unuse(cache, entry);
+
+	cache->stats.size -= sizeof(*entry) + entry->length +
+		entry->families_length;
+	cache->stats.entries--;
+	cache->stats.evictions++;
+
+	free(entry);
+}
+
+
+/**
+ * Add a measurement to the cache.
+ *
+ * Must be called with the cache lock held.
+ *
+ * \param cache The measurement cache
+ * \param key Key of the measurement
+ * \param width Measured width
+ * \param offset Measured split offset
+ */
+static void
+font_measure_insert(struct font_measure_cache *cache,
+		    const struct font_measure_key *key,
+		    int width,
+		    size_t offset)
+{
+	struct font_measure_entry *entry;
+	struct font_measure_entry **bucket;
+	lwc_string * const *family;
+	size_t families_length;
+	char *names;
+
+	/* Another thread may have measured it in the meantime */
+	if (font_measure_find(cache, key) != NULL) {
+		return;
+	}
+
+	families_length = font_measure_families_length(key->fstyle);
+
+	entry = malloc(sizeof(*entry) + key->length + families_length);
+	if (entry == NULL) {
+		/* Not fatal; the measurement is just not remembered */
+		return;
+	}
+
+	entry->font_func = key->font_func;
+	entry->hash = key->hash;
+	entry->families = key->families;
+	entry->family = key->fstyle->family;
+	entry->size = key->fstyle->size;
+	entry->weight = key->fstyle->weight;
+	entry->flags = key->fstyle->flags;
+	entry->kind = key->kind;
+	entry->x = key->x;
+	entry->width = width;
+	entry->offset = offset;
+	entry->length = key->length;
+	memcpy(entry->text, key->text, key->length);
+
+	entry->families_length = families_length;
+	names = entry->text + entry->length;
+	if (key->fstyle->families != NULL) {
+		for (family = key->fstyle->families;
+		     *family != NULL;
+		     family++) {
+			size_t len = lwc_string_length(*family);
+			memcpy(names, lwc_string_data(*family), len);
+			names[len] = '\0';
+			names += len + 1;
+		}
+	}
+
+	bucket = &cache->bucket[key->hash & (FONT_MEASURE_CACHE_BUCKETS - 1)];
+	entry->next = *bucket;
+	*bucket = entry;
+	font_measure_use(cache, entry);
+
+	cache->stats.size += sizeof(*entry) + entry->length +
+		entry->families_length;
+	cache->stats.entries++;
+
+	while (cache->stats.size > FONT_MEASURE_CACHE_LIMIT) {
+		font_measure_evict(cache);
+	}
+}
+
+
+/**
+ * Look up a measurement, counting the hit or miss.
+ *
+ * \param key Key of the measurement
+ * \param width Updated with the cached width on a hit
+ * \param offset Updated with the cached split offset on a hit
+ * \return true if the measurement was cached else false
+ */
+static bool
+font_measure_lookup(const struct font_measure_key *key,
+		    int *width,
+		    size_t *offset)
+{
+	struct font_measure_cache *cache = &font_measure_cache;
+	struct font_measure_entry *entry;
+
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&cache->lock);
+#endif
+	entry = font_measure_find(cache, key);
+	if (entry != NULL) {
+		*width = entry->width;
+		*offset = entry->offset;
+		cache->stats.hits++;
+	} else {
+		cache->stats.misses++;
+	}
+#ifdef WITH_PTHREAD
+	pthread_mutex_unlock(&cache->lock);
+#endif
+
+	return entry != NULL;
+}
+
+
+/**
+ * Remember a measurement made by the frontend.
+ *
+ * \param key Key of the measurement
+ * \param width Measured width
+ * \param offset Measured split offset
+ */
+static void
+font_measure_store(const struct font_measure_key *key,
+		   int width,
+		   size_t offset)
+{
+	struct font_measure_cache *cache = &font_measure_cache;
+
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&cache->lock);
+#endif
+	font_measure_insert(cache, key, width, offset);
+#ifdef WITH_PTHREAD
+	pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+
+/* exported function documented in html/font.h */
+nserror
+font_measure_width(const struct gui_layout_table *font_func,
+		   const plot_font_style_t *fstyle,
+		   const char *string,
+		   size_t length,
+		   int *width)
+{
+	struct font_measure_key key;
+	size_t offset;
+	nserror res;
+
+	if (length <= FONT_MEASURE_CACHE_TEXT) {
+		font_measure_key(&key, font_func, fstyle,
+				FONT_MEASURE_WIDTH, 0, string, length);
+		if (font_measure_lookup(&key, width, &offset)) {
+			return NSERROR_OK;
+		}
+	}
+
+	res = font_func->width(fstyle, string, length, width);
+
+	if (res == NSERROR_OK && length <= FONT_MEASURE_CACHE_TEXT) {
+		font_measure_store(&key, *width, 0);
+	}
+
+	return res;
+}
+
+
+/* exported function documented in html/font.h */
+nserror
+font_measure_split(const struct gui_layout_table *font_func,
+		   const plot_font_style_t *fstyle,
+		   const char *string,
+		   size_t length,
+		   int x,
+		   size_t *char_offset,
+		   int *actual_x)
+{
+	struct font_measure_key key;
+	nserror res;
+
+	if (length <= FONT_MEASURE_CACHE_TEXT) {
+		font_measure_key(&key, font_func, fstyle,
+				FONT_MEASURE_SPLIT, x, string, length);
+		if (font_measure_lookup(&key, actual_x, char_offset)) {
+			return NSERROR_OK;
+		}
+	}
+
+	res = font_func->split(fstyle, string, length, x,
+			char_offset, actual_x);
+
+	if (res == NSERROR_OK && length <= FONT_MEASURE_CACHE_TEXT) {
+		font_measure_store(&key, *actual_x, *char_offset);
+	}
+
+	return res;
+}
+
+
+/* exported function documented in html/font.h */
+void font_measure_get_stats(struct font_measure_stats *stats)
+{
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&font_measure_cache.lock);
+#endif
+	*stats = font_measure_cache.stats;
+#ifdef WITH_PTHREAD
+	pthread_mutex_unlock(&font_measure_cache.lock);
+#endif
+}
+
+
+/**
+ * Compare a font option string with the value measurements were made with.
+ *
+ * \param saved Saved option value, updated if it differs
+ * \param value Current option value
+ * \return true if the value differs else false
+ */
+static bool font_measure_option_changed(char **saved, const char *value)
+{
+	if (*saved == NULL && value == NULL) {
+		return false;
+	}
+	if (*saved != NULL && value != NULL && strcmp(*saved, value) == 0) {
+		return false;
+	}
+
+	free(*saved);
+	*saved = (value != NULL) ? strdup(value) : NULL;
+
+	return true;
+}
+
+
+/* exported function documented in html/font.h */
+void font_measure_check_options(void)
+{
+	struct font_measure_cache *cache = &font_measure_cache;
+	bool changed = false;
+
+#ifdef WITH_PTHREAD
+	pthread_mutex_lock(&cache->lock);
+#endif
+	if (cache->options.size != nsoption_int(font_size) ||
+	    cache->options.min_size != nsoption_int(font_min_size) ||
+	    cache->options.family != nsoption_int(font_default)) {
+		cache->options.size = nsoption_int(font_size);
+		cache->options.min_size = nsoption_int(font_min_size);
+		cache->options.family = nsoption_int(font_default);
+		changed = true;
+	}
+
+	/* Every option must be compared so all the saved values update */
+	changed |= font_measure_option_changed(&cache->options.names[0],
+			nsoption_charp(font_sans));
+	changed |= font_measure_option_changed(&cache->options.names[1],
+			nsoption_charp(font_serif));
+	changed |= font_measure_option_changed(&cache->options.names[2],
+			nsoption_charp(font_mono));
+	changed |= font_measure_option_changed(&cache->options.names[3],
+			nsoption_charp(font_cursive));
+	changed |= font_measure_option_changed(&cache->options.names[4],
+			nsoption_charp(font_fantasy));
+
+	if (changed && cache->least_used != NULL) {
+		NSLOG(netsurf, INFO,
+		      "Font options changed, discarding %u measurements",
+		      cache->stats.entries);
+		while (cache->least_used != NULL) {
+			font_measure_evict(cache);
+		}
+	}
+#ifdef WITH_PTHREAD
+	pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+
+/* exported function documented in html/font.h */
+void font_measure_fini(void)
+{
+	struct font_measure_cache *cache = &font_measure_cache;
+	struct font_measure_stats *stats = &cache->stats;
+	unsigned int idx;
+
+	NSLOG(netsurf, INFO,
+	      "Font measurements: %"PRIu64" hits, %"PRIu64" misses, "
+	      "%"PRIu64" evicted",
+	      stats->hits, stats->misses, stats->evictions);
+
+	while (cache->least_used != NULL) {
+		font_measure_evict(cache);
+	}
+
+	for (idx = 0; idx < PLOT_FONT_FAMILY_COUNT; idx++) {
+		free(cache->options.names[idx]);
+		cache->options.names[idx] = NULL;
+	}
+}
@@ -27,7 +27,23 @@
 #ifndef NETSURF_HTML_FONT_H
 #define NETSURF_HTML_FONT_H
 
+#include <stdint.h>
+
+#include "utils/errors.h"
+
 struct plot_font_style;
+struct gui_layout_table;
+
+/**
+ * Font measurement cache statistics.
+ */
+struct font_measure_stats {
+	uint64_t hits; /**< measurements found in the cache */
+	uint64_t misses; /**< measurements made by the frontend */
+	uint64_t evictions; /**< measurements dropped to bound the size */
+	size_t size; /**< current size of the cache in bytes */
+	unsigned int entries; /**< current number of measurements */
+};
 
 /**
  * Populate a font style using data from a computed CSS style
@@ -40,4 +56,69 @@ void font_plot_style_from_css(const css_unit_ctx *unit_len_ctx,
 			      const css_computed_style *css,
 			      struct plot_font_style *fstyle);
 
+/**
+ * Measure the width of a string, using the measurement cache.
+ *
+ * Measurements are shared by all layout passes of all contents so
+ * that measuring the same text run again does not call the frontend.
+ * The cache may be used from several threads at once, but the frontend
+ * is called from the calling thread, so this must only be called off
+ * the main thread when font_func is marked thread safe.
+ *
+ * \param font_func Frontend font measuring functions
+ * \param fstyle    Font style to measure with
+ * \param string    UTF-8 string to measure
+ * \param length    Length of string in bytes
+ * \param width     Updated to width of string
+ * \return NSERROR_OK and width updated or appropriate error
+ */
+nserror font_measure_width(const struct gui_layout_table *font_func,
+			   const struct plot_font_style *fstyle,
+			   const char *string,
+			   size_t length,
+			   int *width);
+
+/**
+ * Find where to split a string to fit a width, using the measurement cache.
+ *
+ * Behaves as the frontend split function of font_func.
+ *
+ * \param font_func   Frontend font measuring functions
+ * \param fstyle      Font style to measure with
+ * \param string      UTF-8 string to measure
+ * \param length      Length of string in bytes
+ * \param x           Width available
+ * \param char_offset Updated to offset in string of split point
+ * \param actual_x    Updated to width of string before split point
+ * \return NSERROR_OK and offsets updated or appropriate error
+ */
+nserror font_measure_split(const struct gui_layout_table *font_func,
+			   const struct plot_font_style *fstyle,
+			   const char *string,
+			   size_t length,
+			   int x,
+			   size_t *char_offset,
+			   int *actual_x);
+
+/**
+ * Get the font measurement cache statistics.
+ *
+ * \param stats Updated with the current statistics
+ */
+void font_measure_get_stats(struct font_measure_stats *stats);
+
+/**
+ * Discard cached font measurements if the font options have changed.
+ *
+ * The frontend maps generic families to its fonts from the options,
+ * so measurements made before a change may no longer be right. Must
+ * not be called while measurements are being made.
+ */
+void font_measure_check_options(void);
+
+/**
+ * Discard all cached font measurements.
+ */
+void font_measure_fini(void);
+
 #endif
@@ -61,6 +61,7 @@
 #include "html/private.h"
 #include "html/dom_event.h"
 #include "html/css.h"
+#include "html/font.h"
 #include "html/object.h"
 #include "html/html_save.h"
 #include "html/interaction.h"
@@ -273,19 +274,59 @@ static void html_box_convert_done(html_content *c, bool success)
 	dom_hubbub_parser_destroy(c->parser);
 	c->parser = NULL;
 
-	content_set_ready(&c->base);
+	if (content__get_status(&c->base) == CONTENT_STATUS_READY) {
+		/* A partial box tree was displayed: show the whole tree */
+		content__reformat(&c->base, false, c->base.available_width,
+				c->base.available_height);
+	} else {
+		content_set_ready(&c->base);
+	}
 
 	html_proceed_to_done(c);
 
 	dom_node_unref(html);
 }
 
+/**
+ * Display a partially constructed box tree
+ *
+ * \param c  HTML content whose layout is the partial box tree
+ * \return true if the partial box tree is displayed
+ */
+static bool html_box_convert_progress(html_content *c)
+{
+	switch (content__get_status(&c->base)) {
+	case CONTENT_STATUS_LOADING:
+		if (c->aborted)
+			return false;
+
+		NSLOG(netsurf, INFO, "Displaying partial box tree (content %p)",
+		      c);
+		content_set_ready(&c->base);
+		break;
+
+	case CONTENT_STATUS_READY:
+		content__reformat(&c->base, false, c->base.available_width,
+				c->base.available_height);
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
+}
+
 /* Documented in html_internal.h */
 nserror
 html_proceed_to_done(html_content *html)
 {
 	switch (content__get_status(&html->base)) {
 	case CONTENT_STATUS_READY:
+		/* A displayed partial box tree is still being constructed */
+		if (html->box_conversion_context != NULL) {
+			return NSERROR_OK;
+		}
 		if (html->base.active == 0) {
 			content_set_done(&html->base);
 			return NSERROR_OK;
@@ -401,7 +442,9 @@ void html_finish_conversion(html_content *htmlc)
 
 	html_get_dimensions(htmlc);
 
-	error = dom_to_box(html, htmlc, html_box_convert_done, &htmlc->box_conversion_context);
+	error = dom_to_box(html, htmlc, html_box_convert_done,
+			html_box_convert_progress,
+			&htmlc->box_conversion_context);
 	if (error != NSERROR_OK) {
 		NSLOG(netsurf, INFO, "box conversion failed");
 		dom_node_unref(html);
@@ -470,9 +513,11 @@ html_create_html_data(html_content *c, const http_parameter *params)
 	c->aborted = false;
 	c->refresh = false;
 	c->reflowing = false;
+	c->unsettled = false;
 	c->title = NULL;
 	c->bctx = NULL;
 	c->layout = NULL;
+	c->display_list = NULL;
 	c->background_colour = NS_TRANSPARENT;
 	c->stylesheet_count = 0;
 	c->stylesheets = NULL;
@@ -1012,8 +1057,10 @@ static void html_stop(struct content *c)
 		html_object_abort_objects(htmlc);
 
 		/* If there are no further active fetches and we're still
-		 * in the READY state, transition to the DONE state. */
-		if (c->status == CONTENT_STATUS_READY && c->active == 0) {
+		 * in the READY state, transition to the DONE state.  A
+		 * displayed partial box tree completes construction first. */
+		if (c->status == CONTENT_STATUS_READY && c->active == 0 &&
+		    htmlc->box_conversion_context == NULL) {
 			content_set_done(c);
 		}
 
@@ -1043,10 +1090,18 @@ static void html_reformat(struct content *c, int width, int height)
 	uint64_t ms_after;
 	uint64_t ms_interval;
 
+	if (htmlc->unsettled) {
+		/* box construction reformats at its next checkpoint */
+		return;
+	}
+
 	nsu_getmonotonic_ms(&ms_before);
 
 	htmlc->reflowing = true;
 
+	/* measurements made with old font settings must not be reused */
+	font_measure_check_options();
+
 	htmlc->unit_len_ctx.viewport_width = css_unit_device2css_px(
 			INTTOFIX(width), htmlc->unit_len_ctx.device_dpi);
 	htmlc->unit_len_ctx.viewport_height = css_unit_device2css_px(
@@ -1097,6 +1152,11 @@ void html_redraw_a_box(hlcache_handle *h, struct box *box)
 {
 	int x, y;
 
+	if (html_redraw_box_is_retained(box)) {
+		html_display_list_invalidate(
+				(html_content *) hlcache_handle_get_content(h));
+	}
+
 	box_coords(box, &x, &y);
 
 	content_request_redraw(h, x, y,
@@ -1116,6 +1176,10 @@ void html__redraw_a_box(struct html_content *html, struct box *box)
 {
 	int x, y;
 
+	if (html_redraw_box_is_retained(box)) {
+		html_display_list_invalidate(html);
+	}
+
 	box_coords(box, &x, &y);
 
 	content__request_redraw((struct content *)html, x, y,
@@ -1172,9 +1236,11 @@ static void html_destroy_iframe(struct content_html_iframe *iframe)
 
 static void html_free_layout(html_content *htmlc)
 {
+	html_display_list_invalidate(htmlc);
+
 	if (htmlc->bctx != NULL) {
-		/* freeing talloc context should let the entire box
-		 * set be destroyed
+		/* freeing the box arena destroys the entire box set
+		 * and everything allocated in its talloc context
 		 */
 		talloc_free(htmlc->bctx);
 	}
@@ -1441,6 +1507,10 @@ html_get_contextual_content(struct content *c, int x, int y,
 	struct box *next;
 	int box_x = 0, box_y = 0;
 
+	if (html->unsettled) {
+		return NSERROR_OK;
+	}
+
 	while ((next = box_at_point(&html->unit_len_ctx, box, x, y,
 			&box_x, &box_y)) != NULL) {
 		box = next;
@@ -1520,6 +1590,10 @@ html_scroll_at_point(struct content *c, int x, int y, int scrx, int scry)
 	int box_x = 0, box_y = 0;
 	bool handled_scroll = false;
 
+	if (html->unsettled) {
+		return false;
+	}
+
 	/* TODO: invert order; visit deepest box first */
 
 	while ((next = box_at_point(&html->unit_len_ctx, box, x, y,
@@ -1670,6 +1744,10 @@ static bool html_drop_file_at_point(struct content *c, int x, int y, char *file)
 	struct box *text_box = NULL;
 	int box_x = 0, box_y = 0;
 
+	if (html->unsettled) {
+		return false;
+	}
+
 	/* Scan box tree for boxes that can handle drop */
 	while ((next = box_at_point(&html->unit_len_ctx, box, x, y,
 			&box_x, &box_y)) != NULL) {
@@ -2194,6 +2272,8 @@ static content_type html_content_type(void)
 static void html_fini(void)
 {
 	html_css_fini();
+	font_measure_fini();
+	layout_fini();
 }
 
 /**
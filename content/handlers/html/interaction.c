@@ -1467,6 +1467,11 @@ html_mouse_action(struct content *c,
 	html_content *html = (html_content *)c;
 	nserror res;
 
+	if (html->unsettled) {
+		/* the box tree can not be hit tested mid construction */
+		return NSERROR_OK;
+	}
+
 	/* handle open select menu */
 	if (html->visible_select_menu != NULL) {
 		return mouse_action_select_menu(html, bw, mouse, x, y);
@@ -1557,6 +1562,10 @@ bool html_keypress(struct content *c, uint32_t key)
 				html->layout->node, true, true, key);
 	}
 
+	if (html->unsettled) {
+		return false;
+	}
+
 	switch (html->focus_type) {
 	case HTML_FOCUS_CONTENT:
 		return content_keypress(html->focus_owner.content->object, key);
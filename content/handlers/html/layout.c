@@ -41,6 +41,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include <dom/dom.h>
 
 #include "utils/log.h"
@@ -63,7 +67,9 @@
 #include "html/html_save.h"
 #include "html/private.h"
 #include "html/box.h"
+#include "html/box_index.h"
 #include "html/box_inspect.h"
+#include "html/box_manipulate.h"
 #include "html/font.h"
 #include "html/form_internal.h"
 #include "html/layout.h"
@@ -658,8 +664,8 @@ layout_minmax_line(struct box *first,
 
 			if (b->next) {
 				if (b->space == UNKNOWN_WIDTH) {
-					font_func->width(&fstyle, " ", 1,
-							 &b->space);
+					font_measure_width(font_func, &fstyle,
+							" ", 1, &b->space);
 				}
 				max += b->space;
 			}
@@ -695,7 +701,8 @@ layout_minmax_line(struct box *first,
 							data.select.items; o;
 							o = o->next) {
 						int opt_width;
-						font_func->width(&fstyle,
+						font_measure_width(font_func,
+								&fstyle,
 								o->text,
 								strlen(o->text),
 								&opt_width);
@@ -709,16 +716,17 @@ layout_minmax_line(struct box *first,
 						b->width += SCROLLBAR_WIDTH;
 
 				} else {
-					font_func->width(&fstyle, b->text,
-						b->length, &b->width);
+					font_measure_width(font_func, &fstyle,
+							b->text, b->length,
+							&b->width);
 					b->flags |= MEASURED;
 				}
 			}
 			max += b->width;
 			if (b->next) {
 				if (b->space == UNKNOWN_WIDTH) {
-					font_func->width(&fstyle, " ", 1,
-							 &b->space);
+					font_measure_width(font_func, &fstyle,
+							" ", 1, &b->space);
 				}
 				max += b->space;
 			}
@@ -744,8 +752,9 @@ layout_minmax_line(struct box *first,
 					for (j = i; j != b->length &&
 							b->text[j] != ' '; j++)
 						;
-					font_func->width(&fstyle, b->text + i,
-							 j - i, &width);
+					font_measure_width(font_func, &fstyle,
+							b->text + i, j - i,
+							&width);
 					if (min < width)
 						min = width;
 					i = j + 1;
@@ -952,6 +961,32 @@ layout_minmax_inline_container(struct box *inline_container,
 }
 
 
+/**
+ * Set whether the minimum width of a block is of any interest.
+ *
+ * \param block  box of type BLOCK, INLINE_BLOCK, or TABLE_CELL
+ * \param wtype  type of the block's computed width
+ */
+static void
+layout_minmax_need_min(struct box *block, enum css_width_e wtype)
+{
+	if (((block->parent && (block->parent->type == BOX_FLOAT_LEFT ||
+			block->parent->type == BOX_FLOAT_RIGHT)) ||
+			block->type == BOX_INLINE_BLOCK) &&
+			wtype != CSS_WIDTH_SET) {
+		/* box shrinks to fit; need minimum width */
+		block->flags |= NEED_MIN;
+	} else if (block->type == BOX_TABLE_CELL) {
+		/* box shrinks to fit; need minimum width */
+		block->flags |= NEED_MIN;
+	} else if (block->parent && (block->parent->flags & NEED_MIN) &&
+			wtype != CSS_WIDTH_SET) {
+		/* box inside shrink-to-fit context; need minimum width */
+		block->flags |= NEED_MIN;
+	}
+}
+
+
 /**
  * Calculate minimum and maximum width of a block.
  *
@@ -993,21 +1028,7 @@ static void layout_minmax_block(
 		bs = css_computed_box_sizing(block->style);
 	}
 
-	/* set whether the minimum width is of any interest for this box */
-	if (((block->parent && (block->parent->type == BOX_FLOAT_LEFT ||
-			block->parent->type == BOX_FLOAT_RIGHT)) ||
-			block->type == BOX_INLINE_BLOCK) &&
-			wtype != CSS_WIDTH_SET) {
-		/* box shrinks to fit; need minimum width */
-		block->flags |= NEED_MIN;
-	} else if (block->type == BOX_TABLE_CELL) {
-		/* box shrinks to fit; need minimum width */
-		block->flags |= NEED_MIN;
-	} else if (block->parent && (block->parent->flags & NEED_MIN) &&
-			wtype != CSS_WIDTH_SET) {
-		/* box inside shrink-to-fit context; need minimum width */
-		block->flags |= NEED_MIN;
-	}
+	layout_minmax_need_min(block, wtype);
 
 	if (block->gadget && (block->gadget->type == GADGET_TEXTBOX ||
 			block->gadget->type == GADGET_PASSWORD ||
@@ -1181,6 +1202,368 @@ static void layout_minmax_block(
 }
 
 
+#ifdef WITH_PTHREAD
+/**
+ * Subtrees with at least this many boxes are shared between threads.
+ */
+#define LAYOUT_MINMAX_SPLIT_SIZE 2048
+
+/**
+ * Subtrees with fewer boxes than this are left to the main thread.
+ */
+#define LAYOUT_MINMAX_TASK_SIZE 128
+
+/**
+ * Maximum number of worker threads computing minimum and maximum
+ * widths. The main thread works alongside them.
+ */
+#define LAYOUT_MINMAX_WORKER_MAX 3
+
+/**
+ * Independent subtrees to calculate minimum and maximum widths of.
+ *
+ * Subtree roots are collected before any work starts, and each thread
+ * takes the next root until none are left.
+ */
+struct layout_minmax_tasks {
+	pthread_mutex_t lock; /**< protects next */
+	struct box **root; /**< subtree roots */
+	size_t count; /**< number of subtree roots */
+	size_t alloc; /**< allocated length of root */
+	size_t next; /**< next subtree root to be taken */
+	const struct gui_layout_table *font_func; /**< font functions */
+	const html_content *content; /**< content being laid out */
+};
+
+/**
+ * Worker threads computing minimum and maximum widths.
+ *
+ * The workers are started on the first parallel pass and wait for
+ * tasks between passes, so a reflow does not pay for creating threads.
+ */
+static struct layout_minmax_pool {
+	pthread_mutex_t lock; /**< protects the pool */
+	pthread_cond_t start; /**< signalled when tasks are posted */
+	pthread_cond_t done; /**< signalled when the last worker finishes */
+	pthread_t thread[LAYOUT_MINMAX_WORKER_MAX]; /**< worker threads */
+	unsigned int count; /**< number of workers started */
+	bool started; /**< whether starting workers has been tried */
+	bool quit; /**< workers should exit */
+	unsigned int generation; /**< incremented when tasks are posted */
+	unsigned int busy; /**< workers still on the posted tasks */
+	struct layout_minmax_tasks *tasks; /**< posted tasks */
+} layout_minmax_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.start = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+
+/**
+ * Count the boxes in a tree whose widths are unknown.
+ *
+ * Boxes with a HTML object are never given to a worker thread, as
+ * their size comes from another content's box tree. A tree containing
+ * one is reported as at least limit in size, so that it is split
+ * further or left to the main thread.
+ *
+ * \param box    tree of boxes to count
+ * \param limit  count at which to stop counting
+ * \param nested updated to true if the tree has a HTML object
+ * \return number of boxes, which may exceed limit
+ */
+static size_t
+layout_minmax_count(const struct box *box, size_t limit, bool *nested)
+{
+	const struct box *child;
+	size_t count = 1;
+
+	if (box->max_width != UNKNOWN_MAX_WIDTH)
+		return 0;
+
+	if (box->object != NULL &&
+			content_get_type(box->object) == CONTENT_HTML) {
+		*nested = true;
+		return limit;
+	}
+
+	for (child = box->children; child != NULL && count < limit;
+			child = child->next)
+		count += layout_minmax_count(child, limit - count, nested);
+
+	return count;
+}
+
+
+/**
+ * Collect the independent subtrees of a large block.
+ *
+ * Children which are large themselves are split further. Whether a
+ * block needs its minimum width is found first, as its children
+ * depend upon it.
+ *
+ * \param tasks  subtree list to add to
+ * \param block  box of type BLOCK to split
+ * \return true on success, false on memory exhaustion
+ */
+static bool
+layout_minmax_split(struct layout_minmax_tasks *tasks, struct box *block)
+{
+	enum css_width_e wtype = CSS_WIDTH_AUTO;
+	css_fixed width = 0;
+	css_unit wunit = CSS_UNIT_PX;
+	struct box *child;
+
+	if (block->style != NULL)
+		wtype = css_computed_width(block->style, &width, &wunit);
+	layout_minmax_need_min(block, wtype);
+
+	for (child = block->children; child; child = child->next) {
+		bool nested = false;
+		size_t size;
+
+		if (child->type != BOX_BLOCK && child->type != BOX_TABLE)
+			continue;
+
+		size = layout_minmax_count(child, LAYOUT_MINMAX_SPLIT_SIZE,
+				&nested);
+		if (size < LAYOUT_MINMAX_TASK_SIZE)
+			continue;
+
+		if (size >= LAYOUT_MINMAX_SPLIT_SIZE &&
+				child->type == BOX_BLOCK &&
+				child->object == NULL &&
+				!(child->flags & IFRAME)) {
+			if (!layout_minmax_split(tasks, child))
+				return false;
+			continue;
+		}
+
+		if (nested)
+			continue;
+
+		if (tasks->count == tasks->alloc) {
+			size_t alloc = tasks->alloc * 2 + 16;
+			struct box **root;
+
+			root = realloc(tasks->root, alloc * sizeof *root);
+			if (root == NULL)
+				return false;
+			tasks->root = root;
+			tasks->alloc = alloc;
+		}
+		tasks->root[tasks->count++] = child;
+	}
+
+	return true;
+}
+
+
+/**
+ * Take subtrees from a task list until none are left.
+ *
+ * \param tasks  the subtrees to work on
+ */
+static void layout_minmax_run(struct layout_minmax_tasks *tasks)
+{
+	struct box *root;
+
+	for (;;) {
+		pthread_mutex_lock(&tasks->lock);
+		if (tasks->next == tasks->count) {
+			pthread_mutex_unlock(&tasks->lock);
+			break;
+		}
+		root = tasks->root[tasks->next++];
+		pthread_mutex_unlock(&tasks->lock);
+
+		if (root->type == BOX_TABLE)
+			layout_minmax_table(root, tasks->font_func,
+					tasks->content);
+		else
+			layout_minmax_block(root, tasks->font_func,
+					tasks->content);
+	}
+}
+
+
+/**
+ * Minimum and maximum width worker thread.
+ *
+ * \param arg  the worker pool
+ * \return NULL
+ */
+static void *layout_minmax_worker(void *arg)
+{
+	struct layout_minmax_pool *pool = arg;
+	struct layout_minmax_tasks *tasks;
+	unsigned int generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->quit && pool->generation == generation)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->quit)
+			break;
+		generation = pool->generation;
+		tasks = pool->tasks;
+		pthread_mutex_unlock(&pool->lock);
+
+		layout_minmax_run(tasks);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+
+/**
+ * Start the worker threads if that has not been tried yet.
+ *
+ * Called with the pool locked, before any tasks are posted.
+ *
+ * \param pool  the worker pool
+ */
+static void layout_minmax_pool_start(struct layout_minmax_pool *pool)
+{
+	long ncpu;
+
+	if (pool->started)
+		return;
+	pool->started = true;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	while (pool->count < ncpu - 1 &&
+			pool->count < LAYOUT_MINMAX_WORKER_MAX) {
+		if (pthread_create(&pool->thread[pool->count], NULL,
+				layout_minmax_worker, pool) != 0)
+			break;
+		pool->count++;
+	}
+
+	NSLOG(layout, INFO, "%u min/max worker threads", pool->count);
+}
+
+
+/**
+ * Calculate minimum and maximum widths of the large independent
+ * subtrees of a document on several threads.
+ *
+ * Only boxes below the document whose widths are still unknown are
+ * considered. The widths of the boxes above the subtrees are left for
+ * layout_minmax_block() which finds the subtrees already done.
+ *
+ * This is only done when the frontend's layout functions may be called
+ * from several threads at once. The main thread waits for the workers
+ * before returning, so no content changes while they run.
+ *
+ * \param doc        root of document box tree
+ * \param font_func  font functions
+ * \param content    the HTML content being laid out
+ */
+static void
+layout_minmax_parallel(struct box *doc,
+		       const struct gui_layout_table *font_func,
+		       const html_content *content)
+{
+	struct layout_minmax_pool *pool = &layout_minmax_pool;
+	struct layout_minmax_tasks tasks = {
+		.font_func = font_func,
+		.content = content,
+	};
+	bool nested = false;
+
+	if (!font_func->thread_safe)
+		return;
+
+	if (layout_minmax_count(doc, LAYOUT_MINMAX_SPLIT_SIZE, &nested) <
+			LAYOUT_MINMAX_SPLIT_SIZE)
+		return;
+
+	if (!layout_minmax_split(&tasks, doc) || tasks.count < 2) {
+		free(tasks.root);
+		return;
+	}
+
+	if (pthread_mutex_init(&tasks.lock, NULL) != 0) {
+		free(tasks.root);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	layout_minmax_pool_start(pool);
+	if (pool->count == 0 || pool->tasks != NULL) {
+		/* no workers, or they are busy with another document */
+		pthread_mutex_unlock(&pool->lock);
+		pthread_mutex_destroy(&tasks.lock);
+		free(tasks.root);
+		return;
+	}
+	pool->tasks = &tasks;
+	pool->busy = pool->count;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	NSLOG(layout, DEBUG, "%"PRIsizet" subtrees on %u threads",
+	      tasks.count, pool->count + 1);
+
+	layout_minmax_run(&tasks);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy != 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pool->tasks = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_destroy(&tasks.lock);
+	free(tasks.root);
+}
+#endif
+
+
+/* exported function documented in html/layout.h */
+void layout_fini(void)
+{
+#ifdef WITH_PTHREAD
+	struct layout_minmax_pool *pool = &layout_minmax_pool;
+	unsigned int idx;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (idx = 0; idx < pool->count; idx++)
+		pthread_join(pool->thread[idx], NULL);
+	pool->count = 0;
+#endif
+}
+
+
+/**
+ * Calculate minimum and maximum widths of a document.
+ *
+ * \param doc        root of document box tree
+ * \param font_func  font functions
+ * \param content    the HTML content being laid out
+ */
+static void
+layout_minmax_document(struct box *doc,
+		       const struct gui_layout_table *font_func,
+		       const html_content *content)
+{
+#ifdef WITH_PTHREAD
+	layout_minmax_parallel(doc, font_func, content);
+#endif
+	layout_minmax_block(doc, font_func, content);
+}
+
+
 /**
  * Adjust a specified width or height for the box-sizing property.
  *
@@ -2801,7 +3184,7 @@ layout_text_box_split(html_content *content,
 		/* We're need to add a space, and we don't know how big
 		 * it's to be, OR we have a space of unknown width anyway;
 		 * Calculate space width */
-		font_func->width(fstyle, " ", 1, &space_width);
+		font_measure_width(font_func, fstyle, " ", 1, &space_width);
 	}
 
 	if (split_box->space == UNKNOWN_WIDTH)
@@ -2810,10 +3193,9 @@ layout_text_box_split(html_content *content,
 		space_width = 0;
 
 	/* Create clone of split_box, c2 */
-	c2 = talloc_memdup(content->bctx, split_box, sizeof *c2);
+	c2 = box_clone(split_box);
 	if (!c2)
 		return false;
-	c2->flags |= CLONE;
 
 	/* Set remaining text in c2 */
 	c2->text += used_length;
@@ -3278,7 +3660,8 @@ layout_line(struct box *first,
 		} else if (b->type == BOX_INLINE_END) {
 			b->width = 0;
 			if (b->space == UNKNOWN_WIDTH) {
-				font_func->width(&fstyle, " ", 1, &b->space);
+				font_measure_width(font_func, &fstyle,
+						" ", 1, &b->space);
 				/** \todo handle errors */
 			}
 			space_after = b->space;
@@ -3318,7 +3701,7 @@ layout_line(struct box *first,
 							data.select.items; o;
 							o = o->next) {
 						int opt_width;
-						font_func->width(&fstyle,
+						font_measure_width(font_func, &fstyle,
 								o->text,
 								strlen(o->text),
 								&opt_width);
@@ -3330,8 +3713,9 @@ layout_line(struct box *first,
 					if (nsoption_bool(core_select_menu))
 						b->width += SCROLLBAR_WIDTH;
 				} else {
-					font_func->width(&fstyle, b->text,
-							b->length, &b->width);
+					font_measure_width(font_func, &fstyle,
+							b->text, b->length,
+							&b->width);
 					b->flags |= MEASURED;
 				}
 			}
@@ -3343,14 +3727,16 @@ layout_line(struct box *first,
 			if (b->text && (x + b->width < x1 - x0) &&
 					!(b->flags & MEASURED) &&
 					b->next) {
-				font_func->width(&fstyle, b->text,
-						 b->length, &b->width);
+				font_measure_width(font_func, &fstyle,
+						b->text, b->length,
+						&b->width);
 				b->flags |= MEASURED;
 			}
 
 			x += b->width;
 			if (b->space == UNKNOWN_WIDTH) {
-				font_func->width(&fstyle, " ", 1, &b->space);
+				font_measure_width(font_func, &fstyle,
+						" ", 1, &b->space);
 				/** \todo handle errors */
 			}
 			space_after = b->space;
@@ -3488,8 +3874,8 @@ layout_line(struct box *first,
 							&content->unit_len_ctx,
 							b->style, &fstyle);
 					/** \todo handle errors */
-					font_func->width(&fstyle, " ", 1,
-							 &b->space);
+					font_measure_width(font_func, &fstyle,
+							" ", 1, &b->space);
 				}
 				space_after = b->space;
 			} else {
@@ -3642,7 +4028,7 @@ layout_line(struct box *first,
 			font_plot_style_from_css(&content->unit_len_ctx,
 					split_box->style, &fstyle);
 			/** \todo handle errors */
-			font_func->split(&fstyle,
+			font_measure_split(font_func, &fstyle,
 					 split_box->text,
 					 split_box->length,
 					 x1 - x0 - x - space_before,
@@ -3869,6 +4255,141 @@ layout_line(struct box *first,
 }
 
 
+/**
+ * Inputs and results of the previous layout of a box.
+ *
+ * A box which is not dirty and is given the same inputs as last time
+ * lays out exactly as before, so the results are restored rather than
+ * laying out its subtree again.
+ */
+struct box_layout_cache {
+	int width;		/**< Available content width */
+	int height;		/**< Given content height, or AUTO */
+	int padding[4];		/**< Given padding */
+	int viewport_height;	/**< Viewport height, or -ve if unknown */
+	bool floats;		/**< Floats outside the box affect its layout */
+
+	int result_width;	/**< Content width after layout */
+	int result_height;	/**< Content height after layout */
+	int result_padding[4];	/**< Padding after layout */
+};
+
+
+/**
+ * Collect the inputs for the layout of a box.
+ *
+ * \param box              box about to be laid out
+ * \param width            available content width
+ * \param height           given content height, or AUTO
+ * \param viewport_height  height of viewport in pixels or -ve if unknown
+ * \param floats           whether floats outside the box affect its layout
+ * \param in               updated with the layout inputs
+ */
+static void
+layout_cache_inputs(const struct box *box,
+		    int width,
+		    int height,
+		    int viewport_height,
+		    bool floats,
+		    struct box_layout_cache *in)
+{
+	in->width = width;
+	in->height = height;
+	memcpy(in->padding, box->padding, sizeof in->padding);
+	in->viewport_height = viewport_height;
+	in->floats = floats;
+}
+
+
+/**
+ * Reuse the previous layout of a box if its inputs are unchanged.
+ *
+ * If the previous layout can not be used it is discarded, so a box
+ * must either be laid out afterwards or never be reused again.
+ *
+ * \param content  html content being laid out
+ * \param box      box about to be laid out
+ * \param in       inputs of the layout
+ * \return true if the box keeps its previous layout, else false
+ */
+static bool
+layout_cache_reuse(const html_content *content,
+		   struct box *box,
+		   const struct box_layout_cache *in)
+{
+	struct box_layout_cache *cache = box->layout_cache;
+
+	box->flags &= ~LAYOUT_REUSED;
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	if (!content->layout_reuse ||
+	    (box->flags & LAYOUT_DIRTY) ||
+	    in->floats ||
+	    cache->width != in->width ||
+	    cache->height != in->height ||
+	    cache->viewport_height != in->viewport_height ||
+	    memcmp(cache->padding, in->padding, sizeof in->padding) != 0) {
+		cache->width = UNKNOWN_WIDTH;
+		return false;
+	}
+
+	box->width = cache->result_width;
+	box->height = cache->result_height;
+	memcpy(box->padding, cache->result_padding, sizeof box->padding);
+	box->flags |= LAYOUT_REUSED;
+
+	return true;
+}
+
+
+/**
+ * Record the layout of a box so that later layouts can reuse it.
+ *
+ * \param box      box which has been laid out
+ * \param in       inputs the box was laid out with
+ */
+static void
+layout_cache_store(struct box *box, const struct box_layout_cache *in)
+{
+	struct box_layout_cache *cache = box->layout_cache;
+
+	if (cache == NULL) {
+		cache = malloc(sizeof(*cache));
+		if (cache == NULL) {
+			/* Not fatal; the box is laid out again next time */
+			return;
+		}
+		box->layout_cache = cache;
+	}
+
+	*cache = *in;
+	cache->result_width = box->width;
+	cache->result_height = box->height;
+	memcpy(cache->result_padding, box->padding, sizeof box->padding);
+}
+
+
+/**
+ * Prevent reuse of the previous layout of a box's ancestors.
+ *
+ * Used for boxes whose layout is done outside of their ancestors'
+ * layout, such as absolutely positioned boxes.
+ *
+ * \param box  box whose ancestors must be laid out every time
+ */
+static void layout_cache_invalidate_ancestors(struct box *box)
+{
+	for (box = box->parent; box != NULL; box = box->parent) {
+		if (box->layout_cache != NULL) {
+			box->layout_cache->width = UNKNOWN_WIDTH;
+		}
+	}
+}
+
+
 /**
  * Layout lines of text or inline boxes with floats.
  *
@@ -3886,6 +4407,7 @@ static bool layout_inline_container(struct box *inline_container, int width,
 	bool first_line = true;
 	bool has_text_children;
 	struct box *c, *next;
+	struct box_layout_cache in;
 	int y = 0;
 	int curwidth,maxwidth = width;
 
@@ -3899,6 +4421,11 @@ static bool layout_inline_container(struct box *inline_container, int width,
 	      cx,
 	      cy);
 
+	/* Lines only depend on the width unless there are floats about */
+	layout_cache_inputs(inline_container, width, AUTO, -1,
+			cont->float_children != NULL, &in);
+	if (layout_cache_reuse(content, inline_container, &in))
+		return true;
 
 	has_text_children = false;
 	for (c = inline_container->children; c; c = c->next) {
@@ -3941,6 +4468,9 @@ static bool layout_inline_container(struct box *inline_container, int width,
 	inline_container->width = maxwidth;
 	inline_container->height = y;
 
+	if (cont->float_children == NULL)
+		layout_cache_store(inline_container, &in);
+
 	return true;
 }
 
@@ -3971,6 +4501,7 @@ layout_block_context(struct box *block,
 	bool in_margin = false;
 	css_fixed gadget_size;
 	css_unit gadget_unit; /* Checkbox / radio buttons */
+	struct box_layout_cache in;
 
 	assert(block->type == BOX_BLOCK ||
 			block->type == BOX_INLINE_BLOCK ||
@@ -3978,6 +4509,15 @@ layout_block_context(struct box *block,
 	assert(block->width != UNKNOWN_WIDTH);
 	assert(block->width != AUTO);
 
+	/* Table cells are not reused as table layout moves their
+	 * children for vertical alignment after laying them out. */
+	if (block->type != BOX_TABLE_CELL) {
+		layout_cache_inputs(block, block->width, block->height,
+				viewport_height, false, &in);
+		if (layout_cache_reuse(content, block, &in))
+			return true;
+	}
+
 	block->float_children = NULL;
 	block->cached_place_below_level = 0;
 	block->clear_level = 0;
@@ -4440,6 +4980,9 @@ layout_block_context(struct box *block,
 				block->padding[BOTTOM], block->padding[LEFT]);
 	}
 
+	if (block->type != BOX_TABLE_CELL)
+		layout_cache_store(block, &in);
+
 	return true;
 }
 
@@ -4862,7 +5405,9 @@ layout_lists(const html_content *content, struct box *box)
 							&content->unit_len_ctx,
 							marker->style,
 							&fstyle);
-					content->font_func->width(&fstyle,
+					font_measure_width(
+							content->font_func,
+							&fstyle,
 							marker->text,
 							marker->length,
 							&marker->width);
@@ -5384,6 +5929,9 @@ layout_position_absolute(struct box *box,
 						CSS_POSITION_ABSOLUTE ||
 				 css_computed_position(c->style) ==
 						CSS_POSITION_FIXED)) {
+			/* Laying out the ancestors gives the static
+			 * position, which is overwritten below */
+			layout_cache_invalidate_ancestors(c);
 			if (!layout_absolute(c, containing_block,
 					cx, cy, content))
 				return false;
@@ -5581,8 +6129,11 @@ layout_position_relative(
 			fny = fy + y;
 		}
 
-		/* recurse first */
-		layout_position_relative(unit_len_ctx, box, fn, fnx, fny);
+		/* recurse first, unless the children kept their previous
+		 * layout which already has their offsets applied */
+		if (!(box->flags & LAYOUT_REUSED))
+			layout_position_relative(unit_len_ctx, box, fn,
+					fnx, fny);
 
 		/* Ignore things we're not interested in. */
 		if (!box->style || (box->style &&
@@ -5819,8 +6370,134 @@ static void layout_calculate_descendant_bboxes(
 }
 
 
-/* exported function documented in html/layout.h */
-bool layout_document(html_content *content, int width, int height)
+/**
+ * Clear the dirty state of a laid out box tree.
+ *
+ * \param  box  tree of boxes to update
+ */
+static void layout_clear_dirty(struct box *box)
+{
+	struct box *child;
+
+	/* Dirty boxes only have dirty ancestors, so clean subtrees stop */
+	if (!(box->flags & LAYOUT_DIRTY))
+		return;
+
+	box->flags &= ~LAYOUT_DIRTY;
+
+	for (child = box->children; child; child = child->next)
+		layout_clear_dirty(child);
+
+	if (box->list_marker)
+		layout_clear_dirty(box->list_marker);
+}
+
+
+/**
+ * Check whether the previous layout was made with the same length
+ * conversion context, and so may be reused.
+ *
+ * \param  a  length conversion context of the previous layout
+ * \param  b  length conversion context of the new layout
+ * \return  true if lengths convert the same in both contexts
+ */
+static bool layout_unit_ctx_equal(const css_unit_ctx *a, const css_unit_ctx *b)
+{
+	/* Any change of viewport size changes viewport-relative lengths
+	 * which may be anywhere in the tree. */
+	return a->viewport_width == b->viewport_width &&
+			a->viewport_height == b->viewport_height &&
+			a->font_size_default == b->font_size_default &&
+			a->font_size_minimum == b->font_size_minimum &&
+			a->device_dpi == b->device_dpi &&
+			a->root_style == b->root_style;
+}
+
+
+/**
+ * Geometry of a laid out box, for checking incremental layout.
+ */
+struct layout_geometry {
+	const struct box *box;
+	int x, y, width, height;
+	int padding[4];
+	int descendant[4];
+};
+
+
+/**
+ * Record the geometry of a laid out box tree.
+ *
+ * \param  box    tree of boxes to record
+ * \param  geom   array to fill, or NULL to only count the boxes
+ * \param  count  updated with the number of boxes recorded so far
+ */
+static void
+layout_geometry_record(const struct box *box,
+		       struct layout_geometry *geom,
+		       size_t *count)
+{
+	const struct box *child;
+
+	if (geom != NULL) {
+		struct layout_geometry *g = &geom[*count];
+
+		g->box = box;
+		g->x = box->x;
+		g->y = box->y;
+		g->width = box->width;
+		g->height = box->height;
+		memcpy(g->padding, box->padding, sizeof g->padding);
+		g->descendant[0] = box->descendant_x0;
+		g->descendant[1] = box->descendant_y0;
+		g->descendant[2] = box->descendant_x1;
+		g->descendant[3] = box->descendant_y1;
+	}
+	(*count)++;
+
+	for (child = box->children; child; child = child->next)
+		layout_geometry_record(child, geom, count);
+
+	if (box->list_marker)
+		layout_geometry_record(box->list_marker, geom, count);
+}
+
+
+/**
+ * Take a copy of the geometry of a laid out box tree.
+ *
+ * \param  doc    root of box tree
+ * \param  count  updated with the number of boxes in the tree
+ * \return  the geometry of each box in tree order, or NULL on failure
+ */
+static struct layout_geometry *
+layout_geometry_snapshot(const struct box *doc, size_t *count)
+{
+	struct layout_geometry *geom;
+
+	*count = 0;
+	layout_geometry_record(doc, NULL, count);
+
+	geom = malloc(*count * sizeof *geom);
+	if (geom == NULL)
+		return NULL;
+
+	*count = 0;
+	layout_geometry_record(doc, geom, count);
+
+	return geom;
+}
+
+
+/**
+ * Layout a document, reusing the layout of unchanged subtrees.
+ *
+ * \param  content  document to layout
+ * \param  width    available width
+ * \param  height   available height
+ * \return  true on success, false on memory exhaustion
+ */
+static bool layout_document_boxes(html_content *content, int width, int height)
 {
 	bool ret;
 	struct box *doc = content->layout;
@@ -5830,7 +6507,11 @@ bool layout_document(html_content *content, int width, int height)
 			width, height, nsurl_access(content_get_url(
 					&content->base)));
 
-	layout_minmax_block(doc, font_func, content);
+	/* Any retained display list records the old geometry and may
+	 * reference boxes the reflow is about to change. */
+	html_display_list_invalidate(content);
+
+	layout_minmax_document(doc, font_func, content);
 
 	layout_block_find_dimensions(&content->unit_len_ctx,
 			width, height, 0, 0, doc);
@@ -5870,5 +6551,114 @@ bool layout_document(html_content *content, int width, int height)
 
 	layout_calculate_descendant_bboxes(&content->unit_len_ctx, doc);
 
+	layout_clear_dirty(doc);
+
+	box_index_update(doc);
+
+	return ret;
+}
+
+
+/**
+ * Check an incremental layout against a full layout of the document.
+ *
+ * The document is laid out again from scratch and any box whose
+ * geometry differs is reported. A difference is also logged to the
+ * browser window console, so that tests can detect it.
+ *
+ * \param  content  document which has just been laid out
+ * \param  width    available width
+ * \param  height   available height
+ * \return  true on success, false on memory exhaustion
+ */
+static bool layout_document_verify(html_content *content, int width, int height)
+{
+	struct layout_geometry *incremental, *full;
+	size_t incremental_count, full_count;
+	size_t differences = 0;
+	size_t i;
+	bool ret;
+
+	incremental = layout_geometry_snapshot(content->layout,
+			&incremental_count);
+	if (incremental == NULL)
+		return false;
+
+	content->layout_reuse = false;
+
+	ret = layout_document_boxes(content, width, height);
+
+	full = layout_geometry_snapshot(content->layout, &full_count);
+	if (full == NULL) {
+		free(incremental);
+		return false;
+	}
+
+	if (full_count != incremental_count) {
+		NSLOG(layout, ERROR,
+		      "Incremental layout of %s has %"PRIsizet" boxes, "
+		      "full layout has %"PRIsizet,
+		      nsurl_access(content_get_url(&content->base)),
+		      incremental_count, full_count);
+		differences++;
+	} else {
+		for (i = 0; i != full_count; i++) {
+			if (memcmp(&incremental[i], &full[i],
+					sizeof full[i]) == 0)
+				continue;
+
+			NSLOG(layout, ERROR,
+			      "Incremental layout of box %p is %i,%i %ix%i, "
+			      "full layout is %i,%i %ix%i",
+			      full[i].box,
+			      incremental[i].x, incremental[i].y,
+			      incremental[i].width, incremental[i].height,
+			      full[i].x, full[i].y,
+			      full[i].width, full[i].height);
+			differences++;
+		}
+	}
+
+	free(incremental);
+	free(full);
+
+	if (differences != 0) {
+		union content_msg_data msg_data;
+		char msg[80];
+
+		NSLOG(layout, ERROR,
+		      "Incremental layout of %s differs from full layout",
+		      nsurl_access(content_get_url(&content->base)));
+
+		msg_data.log.src = BW_CS_LAYOUT;
+		msg_data.log.msglen = snprintf(msg, sizeof msg,
+				"Incremental layout differs from full layout "
+				"in %"PRIsizet" boxes", differences);
+		if (msg_data.log.msglen >= sizeof msg)
+			msg_data.log.msglen = sizeof msg - 1;
+		msg_data.log.msg = msg;
+		msg_data.log.flags = BW_CS_FLAG_LEVEL_ERROR;
+		content_broadcast(&content->base, CONTENT_MSG_LOG, &msg_data);
+	}
+
+	return ret;
+}
+
+
+/* exported function documented in html/layout.h */
+bool layout_document(html_content *content, int width, int height)
+{
+	bool ret;
+
+	content->layout_reuse = layout_unit_ctx_equal(
+			&content->layout_unit_len_ctx,
+			&content->unit_len_ctx);
+	content->layout_unit_len_ctx = content->unit_len_ctx;
+
+	ret = layout_document_boxes(content, width, height);
+
+	if (ret && content->layout_reuse && nsoption_bool(layout_verify))
+		ret = layout_document_verify(content, width, height);
+
 	return ret;
 }
@@ -42,4 +42,11 @@ struct gui_layout_table;
  */
 bool layout_document(struct html_content *content, int width, int height);
 
+/**
+ * Finalise the layout engine.
+ *
+ * Stops any threads started by layout.
+ */
+void layout_fini(void);
+
 #endif
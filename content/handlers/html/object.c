@@ -44,6 +44,7 @@
 #include "html/private.h"
 #include "html/interaction.h"
 #include "html/box.h"
+#include "html/box_manipulate.h"
 #include "html/box_inspect.h"
 #include "html/object.h"
 
@@ -93,8 +94,6 @@ html_object_done(struct box *box,
 		 hlcache_handle *object,
 		 bool background)
 {
-	struct box *b;
-
 	if (background) {
 		box->background = object;
 		return;
@@ -112,11 +111,10 @@ html_object_done(struct box *box,
 		break;
 	}
 
-	if (!(box->flags & REPLACE_DIM)) {
-		/* invalidate parent min, max widths */
-		for (b = box; b; b = b->parent)
-			b->max_width = UNKNOWN_MAX_WIDTH;
+	/* invalidate layout and parent min, max widths */
+	box_mark_layout_dirty(box);
 
+	if (!(box->flags & REPLACE_DIM)) {
 		/* delete any clones of this box */
 		while (box->next && (box->next->flags & CLONE)) {
 			/* box_free_box(box->next); */
@@ -185,6 +183,7 @@ html_object_callback(hlcache_handle *object,
 
 			/* Adjust parent content for new object size */
 			html_object_done(box, object, o->background);
+			html_display_list_invalidate(c);
 			if (c->base.status == CONTENT_STATUS_READY ||
 					c->base.status == CONTENT_STATUS_DONE)
 				content__reformat(&c->base, false,
@@ -230,6 +229,7 @@ html_object_callback(hlcache_handle *object,
 		NSLOG(netsurf, INFO, "%d fetches active", c->base.active);
 
 		html_object_failed(box, c, o->background);
+		html_display_list_invalidate(c);
 
 		break;
 
@@ -475,6 +475,7 @@ html_object_callback(hlcache_handle *object,
 
 	if (c->base.status == CONTENT_STATUS_READY &&
 	    c->base.active == 0 &&
+	    c->box_conversion_context == NULL &&
 	    (event->type == CONTENT_MSG_LOADING ||
 	     event->type == CONTENT_MSG_DONE ||
 	     event->type == CONTENT_MSG_ERROR)) {
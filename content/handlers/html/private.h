@@ -35,6 +35,8 @@ struct gui_layout_table;
 struct scrollbar_msg_data;
 struct content_redraw_data;
 struct selection;
+struct box_arena;
+struct html_display_list;
 
 typedef enum {
 	HTML_DRAG_NONE,			/** No drag */
@@ -121,6 +123,13 @@ typedef struct html_content {
 	/** Whether a layout (reflow) is in progress */
 	bool reflowing;
 
+	/**
+	 * Whether the displayed box tree is partway through construction.
+	 * It may not be laid out, drawn or hit tested until construction
+	 * reaches its next checkpoint.
+	 */
+	bool unsettled;
+
 	/** Whether an initial layout has been done */
 	bool had_initial_layout;
 
@@ -130,14 +139,16 @@ typedef struct html_content {
 	/* Title element node */
 	dom_node *title;
 
-	/** A talloc context purely for the render box tree */
-	int *bctx;
+	/** Arena and talloc context purely for the render box tree */
+	struct box_arena *bctx;
 	/** A context pointer for the box conversion, NULL if no conversion
 	 * is in progress.
 	 */
 	void *box_conversion_context;
 	/** Box tree, or NULL. */
 	struct box *layout;
+	/** Retained display list of the box tree, or NULL. */
+	struct html_display_list *display_list;
 	/** Document background colour. */
 	colour background_colour;
 
@@ -161,6 +172,10 @@ typedef struct html_content {
 	css_media media;
 	/** CSS length conversion context for document. */
 	css_unit_ctx unit_len_ctx;
+	/** CSS length conversion context of the previous layout. */
+	css_unit_ctx layout_unit_len_ctx;
+	/** Whether the previous layout of unchanged boxes may be reused. */
+	bool layout_reuse;
 	/**< Universal selector */
 	lwc_string *universal;
 
@@ -298,6 +313,104 @@ nserror html_proceed_to_done(html_content *html);
 bool html_redraw(struct content *c, struct content_redraw_data *data,
 		const struct rect *clip, const struct redraw_context *ctx);
 
+/**
+ * Recursively draw a box.
+ *
+ * \param  html	     html content
+ * \param  box	     box to draw
+ * \param  x_parent  coordinate of parent box
+ * \param  y_parent  coordinate of parent box
+ * \param  clip      clip rectangle
+ * \param  scale     scale for redraw
+ * \param  current_background_color  background colour under this box
+ * \param  ctx	     current redraw context
+ * \return true if successful, false otherwise
+ */
+bool html_redraw_box(const html_content *html, struct box *box,
+		int x_parent, int y_parent,
+		const struct rect *clip, float scale,
+		colour current_background_color,
+		const struct redraw_context *ctx);
+
+/**
+ * Determine if the drawing of a box is retained in the display list.
+ *
+ * \param box box to consider
+ * \return true if changes to the box need the display list rebuilding
+ */
+bool html_redraw_box_is_retained(const struct box *box);
+
+/* in html/redraw_list.c */
+
+/**
+ * Redraw a HTML content from its retained display list.
+ *
+ * The display list is recorded first if necessary. Nothing is drawn if
+ * the redraw needs state which the display list does not hold, such as
+ * a text selection or a scale other than 1.
+ *
+ * \param html       content to redraw
+ * \param data       redraw data for this content redraw
+ * \param clip       current clip region
+ * \param background colour under the document
+ * \param ctx        current redraw context
+ * \param result     updated with whether the redraw succeeded
+ * \return true if the content was redrawn from the display list
+ */
+bool html_display_list_redraw(html_content *html,
+		struct content_redraw_data *data,
+		const struct rect *clip,
+		colour background,
+		const struct redraw_context *ctx,
+		bool *result);
+
+/**
+ * Discard the display list of a HTML content.
+ *
+ * \param html content whose appearance has changed
+ */
+void html_display_list_invalidate(html_content *html);
+
+/**
+ * Determine if a redraw context is recording a display list.
+ *
+ * \param ctx redraw context
+ * \return true if ctx records into a display list
+ */
+bool html_display_list_recording(const struct redraw_context *ctx);
+
+/**
+ * Record a box which must be drawn from the box tree on replay.
+ *
+ * \param box box to draw
+ * \param x_parent coordinate of parent box
+ * \param y_parent coordinate of parent box
+ * \param bbox area the box may paint
+ * \param clip clip rectangle the box is drawn under
+ * \param current_background_color background colour under the box
+ * \param ctx recording redraw context
+ */
+void html_display_list_box(struct box *box,
+		int x_parent, int y_parent,
+		const struct rect *bbox,
+		const struct rect *clip,
+		colour current_background_color,
+		const struct redraw_context *ctx);
+
+/**
+ * Redraw a content, or record it when recording a display list.
+ *
+ * \param h    content to redraw
+ * \param data redraw data for the content
+ * \param clip clip rectangle
+ * \param ctx  redraw context
+ * \return true if successful, false otherwise
+ */
+bool html_display_list_content(struct hlcache_handle *h,
+		struct content_redraw_data *data,
+		const struct rect *clip,
+		const struct redraw_context *ctx);
+
 
 /* in html/redraw_border.c */
 bool html_redraw_borders(struct box *box, int x_parent, int y_parent,
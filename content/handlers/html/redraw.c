@@ -57,6 +57,7 @@
 #include "desktop/gui_internal.h"
 
 #include "html/box.h"
+#include "html/box_index.h"
 #include "html/box_inspect.h"
 #include "html/box_manipulate.h"
 #include "html/font.h"
@@ -791,7 +792,8 @@ static bool html_redraw_background(int x, int y, struct box *box, float scale,
 				bg_data.repeat_y = repeat_y;
 
 				/* We just continue if redraw fails */
-				content_redraw(background->background,
+				html_display_list_content(
+						background->background,
 						&bg_data, &r, ctx);
 			}
 		}
@@ -951,7 +953,8 @@ static bool html_redraw_inline_background(int x, int y, struct box *box,
 			bg_data.repeat_y = repeat_y;
 
 			/* We just continue if redraw fails */
-			content_redraw(box->background, &bg_data, &r, ctx);
+			html_display_list_content(box->background,
+					&bg_data, &r, ctx);
 		}
 	}
 
@@ -1159,11 +1162,101 @@ static bool html_redraw_text_box(const html_content *html, struct box *box,
 	return true;
 }
 
-bool html_redraw_box(const html_content *html, struct box *box,
+/**
+ * Determine if the appearance of a box may change without a reflow.
+ *
+ * Such boxes draw objects, iframes, form controls, canvases or
+ * scrolled content, or have state such as scroll offsets.
+ *
+ * \param box box to consider
+ * \param overflow_x computed horizontal overflow of box
+ * \param overflow_y computed vertical overflow of box
+ * \return true if the box must always be drawn from the box tree
+ */
+static bool html_redraw_box_is_live(const struct box *box,
+		enum css_overflow_e overflow_x,
+		enum css_overflow_e overflow_y)
+{
+	return box->object != NULL ||
+		box->iframe != NULL ||
+		box->gadget != NULL ||
+		box->scroll_x != NULL ||
+		box->scroll_y != NULL ||
+		(box->node != NULL && (box->flags & REPLACE_DIM)) ||
+		overflow_x == CSS_OVERFLOW_SCROLL ||
+		overflow_x == CSS_OVERFLOW_AUTO ||
+		overflow_y == CSS_OVERFLOW_SCROLL ||
+		overflow_y == CSS_OVERFLOW_AUTO;
+}
+
+
+/* exported interface documented in html/private.h */
+bool html_redraw_box_is_retained(const struct box *box)
+{
+	enum css_overflow_e overflow_x = CSS_OVERFLOW_VISIBLE;
+	enum css_overflow_e overflow_y = CSS_OVERFLOW_VISIBLE;
+
+	if (box->style != NULL) {
+		overflow_x = css_computed_overflow_x(box->style);
+		overflow_y = css_computed_overflow_y(box->style);
+	}
+
+	return !html_redraw_box_is_live(box, overflow_x, overflow_y);
+}
+
+
+/**
+ * Draw the children of a box which has a spatial index.
+ *
+ * Only the in-flow children which may intersect the clip rectangle are
+ * visited.
+ *
+ * \param  html	     html content
+ * \param  box	     box to draw children of
+ * \param  x_parent  coordinate of parent box
+ * \param  y_parent  coordinate of parent box
+ * \param  clip      clip rectangle
+ * \param  scale     scale for redraw
+ * \param  current_background_color  background colour under this box
+ * \param  ctx	     current redraw context
+ * \return true if successful, false otherwise
+ */
+static bool
+html_redraw_box_indexed_children(const html_content *html, struct box *box,
 		int x_parent, int y_parent,
 		const struct rect *clip, float scale,
 		colour current_background_color,
-		const struct redraw_context *ctx);
+		const struct redraw_context *ctx)
+{
+	const struct box_index *index = box->index;
+	int x = x_parent + box->x - scrollbar_get_offset(box->scroll_x);
+	int y = y_parent + box->y - scrollbar_get_offset(box->scroll_y);
+	int slack = 2 + 2 / scale;
+	unsigned int first, last, i;
+	struct box *c;
+
+	/* clip range in the box's unscaled coordinates, allowing for
+	 * rounding in the scaled positions */
+	box_index_range(index,
+			clip->y0 / scale - y - slack,
+			clip->y1 / scale - y + slack,
+			&first, &last);
+
+	for (i = first; i < last; i++) {
+		if (!html_redraw_box(html, index->child[i], x, y,
+				clip, scale, current_background_color,
+				ctx))
+			return false;
+	}
+
+	for (c = box->float_children; c; c = c->next_float)
+		if (!html_redraw_box(html, c, x, y,
+				clip, scale, current_background_color,
+				ctx))
+			return false;
+
+	return true;
+}
 
 /**
  * Draw the various children of a box.
@@ -1187,6 +1280,12 @@ static bool html_redraw_box_children(const html_content *html, struct box *box,
 {
 	struct box *c;
 
+	if (box->index != NULL) {
+		return html_redraw_box_indexed_children(html, box,
+				x_parent, y_parent, clip, scale,
+				current_background_color, ctx);
+	}
+
 	for (c = box->children; c; c = c->next) {
 
 		if (c->type != BOX_FLOAT_LEFT && c->type != BOX_FLOAT_RIGHT)
@@ -1385,6 +1484,14 @@ bool html_redraw_box(const html_content *html, struct box *box,
 		else box->flags |= PRINTED; /*it won't be printed anymore*/
 	}
 
+	/* boxes which can change without a reflow are not retained */
+	if (html_display_list_recording(ctx) &&
+	    html_redraw_box_is_live(box, overflow_x, overflow_y)) {
+		html_display_list_box(box, x_parent, y_parent, &r, clip,
+				current_background_color, ctx);
+		return true;
+	}
+
 	/* if visibility is hidden render children only */
 	if (box->style && css_computed_visibility(box->style) ==
 			CSS_VISIBILITY_HIDDEN) {
@@ -1947,6 +2054,7 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 	html_content *html = (html_content *) c;
 	struct box *box;
 	bool result = true;
+	bool drawn;
 	bool select, select_only;
 	plot_style_t pstyle_fill_bg = {
 		.fill_type = PLOT_OP_TYPE_SOLID,
@@ -1956,6 +2064,17 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 	box = html->layout;
 	assert(box);
 
+	if (html->unsettled) {
+		/* only the background can be drawn until box construction
+		 * reaches a checkpoint, which will request a redraw */
+		if (html->background_colour != NS_TRANSPARENT)
+			pstyle_fill_bg.fill_colour = html->background_colour;
+
+		return (ctx->plot->clip(ctx, clip) == NSERROR_OK &&
+			ctx->plot->rectangle(ctx, &pstyle_fill_bg,
+					clip) == NSERROR_OK);
+	}
+
 	/* The select menu needs special treating because, when opened, it
 	 * reaches beyond its layout box.
 	 */
@@ -1979,8 +2098,13 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 
 		result &= (ctx->plot->rectangle(ctx, &pstyle_fill_bg, clip) == NSERROR_OK);
 
-		result &= html_redraw_box(html, box, data->x, data->y, clip,
-				data->scale, pstyle_fill_bg.fill_colour, ctx);
+		if (!html_display_list_redraw(html, data, clip,
+				pstyle_fill_bg.fill_colour, ctx, &drawn)) {
+			drawn = html_redraw_box(html, box,
+					data->x, data->y, clip, data->scale,
+					pstyle_fill_bg.fill_colour, ctx);
+		}
+		result &= drawn;
 	}
 
 	if (select) {
@@ -0,0 +1,867 @@
+/*
+ * Copyright 2026 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ *
+ * Retained display list for redrawing CONTENT_HTML implementation.
+ *
+ * The plot operations for the whole document are recorded once, at
+ * scale 1 and with the document origin at 0,0, by running the normal
+ * box tree redraw against a recording plotter table. Later redraws
+ * replay the operations which intersect the clip rectangle instead of
+ * walking the box tree again.
+ *
+ * Replay tests every entry of the list against the clip rectangle, so
+ * a small redraw of a long document still visits the whole list. The
+ * time taken by each replay is logged at DEBUG level so that it can be
+ * compared with a box tree redraw of the same area.
+ *
+ * Anything whose appearance can change without a reflow is not
+ * recorded. Boxes with objects, iframes, form controls or scrolling
+ * are recorded as a reference to the box, which is drawn normally when
+ * the list is replayed. Background images are recorded as a reference
+ * to their content, which is redrawn through content_redraw() so that
+ * animations and image cache eviction are handled as usual.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <nsutils/time.h>
+
+#include "utils/log.h"
+#include "utils/nsoption.h"
+#include "utils/utils.h"
+#include "netsurf/inttypes.h"
+#include "netsurf/content.h"
+#include "netsurf/plotters.h"
+#include "netsurf/layout.h"
+#include "content/content.h"
+#include "desktop/selection.h"
+#include "desktop/gui_internal.h"
+
+#include "html/box.h"
+#include "html/font.h"
+#include "html/private.h"
+
+/**
+ * Display list operations.
+ */
+enum html_display_op {
+	HTML_DISPLAY_CLIP,
+	HTML_DISPLAY_ARC,
+	HTML_DISPLAY_DISC,
+	HTML_DISPLAY_LINE,
+	HTML_DISPLAY_RECTANGLE,
+	HTML_DISPLAY_POLYGON,
+	HTML_DISPLAY_PATH,
+	HTML_DISPLAY_TEXT,
+	HTML_DISPLAY_GROUP_START,
+	HTML_DISPLAY_GROUP_END,
+	HTML_DISPLAY_CONTENT, /**< redraw of a content, e.g. background */
+	HTML_DISPLAY_BOX, /**< redraw of a box which is not recorded */
+};
+
+/**
+ * Display list entry.
+ */
+struct html_display_item {
+	enum html_display_op op; /**< operation */
+	struct rect bbox; /**< area the operation may paint */
+
+	union {
+		/** Shapes, lines and clip */
+		struct {
+			plot_style_t style;
+			struct rect rect;
+			int x, y;
+			int radius;
+			int angle1, angle2;
+			size_t points; /**< offset into list point data */
+			unsigned int n; /**< number of point values */
+			float transform[6];
+		} shape;
+
+		/** Text */
+		struct {
+			plot_font_style_t fstyle;
+			int x, y;
+			size_t offset; /**< offset into list text data */
+			size_t length;
+		} text;
+
+		/** Group start */
+		const char *name;
+
+		/** Content redraw */
+		struct {
+			struct hlcache_handle *h;
+			struct content_redraw_data data;
+			struct rect clip;
+		} content;
+
+		/** Box redraw */
+		struct {
+			struct box *box;
+			int x_parent, y_parent;
+			struct rect clip; /**< clip the box was drawn under */
+			colour background;
+		} box;
+	} u;
+};
+
+/**
+ * Display list of a HTML content.
+ */
+struct html_display_list {
+	struct html_display_item *item; /**< entries in paint order */
+	size_t count; /**< number of entries */
+	size_t alloc; /**< number of entries allocated */
+
+	char *text; /**< text of text entries */
+	size_t text_used; /**< bytes of text used */
+	size_t text_alloc; /**< bytes of text allocated */
+
+	float *points; /**< point data of polygon and path entries */
+	size_t points_used; /**< number of point values used */
+	size_t points_alloc; /**< number of point values allocated */
+
+	colour background; /**< background colour recorded against */
+	bool background_images; /**< whether background images recorded */
+	bool failed; /**< recording could not be completed */
+};
+
+
+/** Rectangle large enough to cover any document */
+static const struct rect html_display_everything = {
+	.x0 = INT_MIN / 4,
+	.y0 = INT_MIN / 4,
+	.x1 = INT_MAX / 4,
+	.y1 = INT_MAX / 4,
+};
+
+
+/**
+ * Add an entry to a display list.
+ *
+ * \param ctx recording redraw context
+ * \param op operation of the entry
+ * \return the new entry or NULL on memory exhaustion
+ */
+static struct html_display_item *
+html_display_add(const struct redraw_context *ctx, enum html_display_op op)
+{
+	struct html_display_list *list = ctx->priv;
+	struct html_display_item *item;
+
+	if (list->count == list->alloc) {
+		size_t alloc = list->alloc ? list->alloc * 2 : 1024;
+
+		item = realloc(list->item, alloc * sizeof(*item));
+		if (item == NULL) {
+			list->failed = true;
+			return NULL;
+		}
+		list->item = item;
+		list->alloc = alloc;
+	}
+
+	item = &list->item[list->count++];
+	item->op = op;
+	item->bbox = html_display_everything;
+
+	return item;
+}
+
+
+/**
+ * Set the bounding box of an entry, grown by a margin.
+ */
+static inline void
+html_display_bbox(struct html_display_item *item,
+		  int x0, int y0, int x1, int y1, int margin)
+{
+	item->bbox.x0 = x0 - margin;
+	item->bbox.y0 = y0 - margin;
+	item->bbox.x1 = x1 + margin;
+	item->bbox.y1 = y1 + margin;
+}
+
+
+/**
+ * Copy point data into a display list.
+ *
+ * \return offset of the copy or -1 on memory exhaustion
+ */
+static long
+html_display_points(struct html_display_list *list,
+		    const float *p, unsigned int n)
+{
+	size_t offset = list->points_used;
+
+	if (list->points_used + n > list->points_alloc) {
+		size_t alloc = (list->points_used + n) * 2;
+		float *points = realloc(list->points, alloc * sizeof(*points));
+		if (points == NULL) {
+			list->failed = true;
+			return -1;
+		}
+		list->points = points;
+		list->points_alloc = alloc;
+	}
+
+	memcpy(list->points + offset, p, n * sizeof(*p));
+	list->points_used += n;
+
+	return offset;
+}
+
+
+/**
+ * Widest a stroke may paint outside the geometry of a shape.
+ */
+static inline int html_display_stroke(const plot_style_t *pstyle)
+{
+	if (pstyle->stroke_type == PLOT_OP_TYPE_NONE) {
+		return 1;
+	}
+	return plot_style_fixed_to_int(pstyle->stroke_width) + 1;
+}
+
+
+/* Recording plotter functions */
+
+static nserror
+html_display_clip(const struct redraw_context *ctx, const struct rect *clip)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_CLIP);
+	if (item != NULL) {
+		item->u.shape.rect = *clip;
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_arc(const struct redraw_context *ctx,
+		 const plot_style_t *pstyle,
+		 int x, int y, int radius, int angle1, int angle2)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_ARC);
+	if (item != NULL) {
+		item->u.shape.style = *pstyle;
+		item->u.shape.x = x;
+		item->u.shape.y = y;
+		item->u.shape.radius = radius;
+		item->u.shape.angle1 = angle1;
+		item->u.shape.angle2 = angle2;
+		html_display_bbox(item, x - radius, y - radius,
+				x + radius, y + radius,
+				html_display_stroke(pstyle));
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_disc(const struct redraw_context *ctx,
+		  const plot_style_t *pstyle,
+		  int x, int y, int radius)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_DISC);
+	if (item != NULL) {
+		item->u.shape.style = *pstyle;
+		item->u.shape.x = x;
+		item->u.shape.y = y;
+		item->u.shape.radius = radius;
+		html_display_bbox(item, x - radius, y - radius,
+				x + radius, y + radius,
+				html_display_stroke(pstyle));
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_line(const struct redraw_context *ctx,
+		  const plot_style_t *pstyle,
+		  const struct rect *line)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_LINE);
+	if (item != NULL) {
+		item->u.shape.style = *pstyle;
+		item->u.shape.rect = *line;
+		html_display_bbox(item,
+				min(line->x0, line->x1),
+				min(line->y0, line->y1),
+				max(line->x0, line->x1),
+				max(line->y0, line->y1),
+				html_display_stroke(pstyle));
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_rectangle(const struct redraw_context *ctx,
+		       const plot_style_t *pstyle,
+		       const struct rect *rectangle)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_RECTANGLE);
+	if (item != NULL) {
+		item->u.shape.style = *pstyle;
+		item->u.shape.rect = *rectangle;
+		html_display_bbox(item,
+				rectangle->x0, rectangle->y0,
+				rectangle->x1, rectangle->y1,
+				html_display_stroke(pstyle));
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_polygon(const struct redraw_context *ctx,
+		     const plot_style_t *pstyle,
+		     const int *p,
+		     unsigned int n)
+{
+	struct html_display_list *list = ctx->priv;
+	struct html_display_item *item;
+	int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+	unsigned int i;
+	long offset;
+
+	/* polygon points are stored as floats alongside path data */
+	offset = list->points_used;
+	for (i = 0; i != n * 2; i += 2) {
+		float xy[2] = { p[i], p[i + 1] };
+
+		if (html_display_points(list, xy, 2) < 0) {
+			return NSERROR_OK;
+		}
+		x0 = min(x0, p[i]);
+		x1 = max(x1, p[i]);
+		y0 = min(y0, p[i + 1]);
+		y1 = max(y1, p[i + 1]);
+	}
+
+	item = html_display_add(ctx, HTML_DISPLAY_POLYGON);
+	if (item != NULL) {
+		item->u.shape.style = *pstyle;
+		item->u.shape.points = offset;
+		item->u.shape.n = n;
+		html_display_bbox(item, x0, y0, x1, y1,
+				html_display_stroke(pstyle));
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_path(const struct redraw_context *ctx,
+		  const plot_style_t *pstyle,
+		  const float *p,
+		  unsigned int n,
+		  const float transform[6])
+{
+	struct html_display_list *list = ctx->priv;
+	struct html_display_item *item;
+	long offset;
+
+	offset = html_display_points(list, p, n);
+	if (offset < 0) {
+		return NSERROR_OK;
+	}
+
+	/* paths are not bounded; they are always replayed */
+	item = html_display_add(ctx, HTML_DISPLAY_PATH);
+	if (item != NULL) {
+		item->u.shape.style = *pstyle;
+		item->u.shape.points = offset;
+		item->u.shape.n = n;
+		memcpy(item->u.shape.transform, transform,
+				sizeof(item->u.shape.transform));
+	}
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_bitmap(const struct redraw_context *ctx,
+		    struct bitmap *bitmap,
+		    int x, int y, int width, int height,
+		    colour bg, bitmap_flags_t flags)
+{
+	struct html_display_list *list = ctx->priv;
+
+	/* Bitmaps belong to contents which may change or discard them,
+	 * so they can not be retained; this document can only be drawn
+	 * by walking the box tree.
+	 */
+	list->failed = true;
+
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_text(const struct redraw_context *ctx,
+		  const plot_font_style_t *fstyle,
+		  int x, int y,
+		  const char *text,
+		  size_t length)
+{
+	struct html_display_list *list = ctx->priv;
+	struct html_display_item *item;
+	int size = plot_style_fixed_to_int(fstyle->size) * 2 + 2;
+	int width = 0;
+
+	if (list->text_used + length > list->text_alloc) {
+		size_t alloc = (list->text_used + length) * 2;
+		char *copy = realloc(list->text, alloc);
+		if (copy == NULL) {
+			list->failed = true;
+			return NSERROR_OK;
+		}
+		list->text = copy;
+		list->text_alloc = alloc;
+	}
+
+	item = html_display_add(ctx, HTML_DISPLAY_TEXT);
+	if (item == NULL) {
+		return NSERROR_OK;
+	}
+
+	memcpy(list->text + list->text_used, text, length);
+	item->u.text.fstyle = *fstyle;
+	item->u.text.x = x;
+	item->u.text.y = y;
+	item->u.text.offset = list->text_used;
+	item->u.text.length = length;
+	list->text_used += length;
+
+	if (font_measure_width(guit->layout, fstyle,
+			text, length, &width) != NSERROR_OK) {
+		/* bound the text by the clip alone */
+		return NSERROR_OK;
+	}
+
+	/* twice the point size is a generous bound on the height of the
+	 * glyphs, and on any overhang of slanted ones, in pixels */
+	html_display_bbox(item, x, y - size, x + width, y + size, size);
+
+	return NSERROR_OK;
+}
+
+static nserror
+html_display_group_start(const struct redraw_context *ctx, const char *name)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_GROUP_START);
+	if (item != NULL) {
+		item->u.name = name;
+	}
+	return NSERROR_OK;
+}
+
+static nserror html_display_group_end(const struct redraw_context *ctx)
+{
+	html_display_add(ctx, HTML_DISPLAY_GROUP_END);
+	return NSERROR_OK;
+}
+
+/** Plotter table which records into a display list */
+static const struct plotter_table html_display_plotters = {
+	.clip = html_display_clip,
+	.arc = html_display_arc,
+	.disc = html_display_disc,
+	.line = html_display_line,
+	.rectangle = html_display_rectangle,
+	.polygon = html_display_polygon,
+	.path = html_display_path,
+	.bitmap = html_display_bitmap,
+	.text = html_display_text,
+	.group_start = html_display_group_start,
+	.group_end = html_display_group_end,
+	.flush = NULL,
+	.option_knockout = false,
+};
+
+
+/* exported interface documented in html/private.h */
+bool html_display_list_recording(const struct redraw_context *ctx)
+{
+	return ctx->plot == &html_display_plotters;
+}
+
+
+/* exported interface documented in html/private.h */
+void html_display_list_box(struct box *box,
+		int x_parent, int y_parent,
+		const struct rect *bbox,
+		const struct rect *clip,
+		colour current_background_color,
+		const struct redraw_context *ctx)
+{
+	struct html_display_item *item;
+
+	item = html_display_add(ctx, HTML_DISPLAY_BOX);
+	if (item != NULL) {
+		item->bbox = *bbox;
+		item->u.box.box = box;
+		item->u.box.x_parent = x_parent;
+		item->u.box.y_parent = y_parent;
+		item->u.box.clip = *clip;
+		item->u.box.background = current_background_color;
+	}
+}
+
+
+/* exported interface documented in html/private.h */
+bool html_display_list_content(struct hlcache_handle *h,
+		struct content_redraw_data *data,
+		const struct rect *clip,
+		const struct redraw_context *ctx)
+{
+	struct html_display_item *item;
+
+	if (!html_display_list_recording(ctx)) {
+		return content_redraw(h, data, clip, ctx);
+	}
+
+	item = html_display_add(ctx, HTML_DISPLAY_CONTENT);
+	if (item != NULL) {
+		item->bbox = *clip;
+		item->u.content.h = h;
+		item->u.content.data = *data;
+		item->u.content.clip = *clip;
+	}
+
+	return true;
+}
+
+
+/* exported interface documented in html/private.h */
+void html_display_list_invalidate(html_content *html)
+{
+	struct html_display_list *list = html->display_list;
+
+	if (list == NULL) {
+		return;
+	}
+
+	free(list->item);
+	free(list->text);
+	free(list->points);
+	free(list);
+
+	html->display_list = NULL;
+}
+
+
+/**
+ * Record the display list of a HTML content.
+ *
+ * \param html content to record
+ * \param background colour under the document
+ * \param background_images whether to draw background images
+ * \return the display list or NULL if it could not be recorded
+ */
+static struct html_display_list *
+html_display_list_record(const html_content *html,
+			 colour background,
+			 bool background_images)
+{
+	struct html_display_list *list;
+	struct redraw_context ctx = {
+		.interactive = true,
+		.background_images = background_images,
+		.plot = &html_display_plotters,
+	};
+
+	list = calloc(1, sizeof(*list));
+	if (list == NULL) {
+		return NULL;
+	}
+	list->background = background;
+	list->background_images = background_images;
+
+	ctx.priv = list;
+
+	if (!html_redraw_box(html, html->layout, 0, 0,
+			&html_display_everything, 1.0, background, &ctx)) {
+		list->failed = true;
+	}
+
+	NSLOG(netsurf, INFO, "Recorded %"PRIsizet" display items%s",
+	      list->count, list->failed ? " (failed)" : "");
+
+	return list;
+}
+
+
+/**
+ * Intersect two rectangles.
+ */
+static inline void
+html_display_intersect(struct rect *r, const struct rect *clip)
+{
+	r->x0 = max(r->x0, clip->x0);
+	r->y0 = max(r->y0, clip->y0);
+	r->x1 = min(r->x1, clip->x1);
+	r->y1 = min(r->y1, clip->y1);
+	if (r->x1 < r->x0)
+		r->x1 = r->x0;
+	if (r->y1 < r->y0)
+		r->y1 = r->y0;
+}
+
+
+/**
+ * Replay a display list entry.
+ *
+ * \param html content being redrawn
+ * \param list display list of the content
+ * \param item entry to replay
+ * \param dx horizontal offset of the document
+ * \param dy vertical offset of the document
+ * \param clip clip rectangle of the redraw
+ * \param ctx redraw context
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_replay(const html_content *html,
+		    const struct html_display_list *list,
+		    const struct html_display_item *item,
+		    int dx, int dy,
+		    const struct rect *clip,
+		    const struct redraw_context *ctx)
+{
+	const struct plotter_table *plot = ctx->plot;
+	struct rect r;
+	nserror res = NSERROR_OK;
+
+	switch (item->op) {
+	case HTML_DISPLAY_CLIP:
+		r = item->u.shape.rect;
+		r.x0 += dx; r.x1 += dx;
+		r.y0 += dy; r.y1 += dy;
+		html_display_intersect(&r, clip);
+		res = plot->clip(ctx, &r);
+		break;
+
+	case HTML_DISPLAY_ARC:
+		res = plot->arc(ctx, &item->u.shape.style,
+				item->u.shape.x + dx, item->u.shape.y + dy,
+				item->u.shape.radius,
+				item->u.shape.angle1, item->u.shape.angle2);
+		break;
+
+	case HTML_DISPLAY_DISC:
+		res = plot->disc(ctx, &item->u.shape.style,
+				item->u.shape.x + dx, item->u.shape.y + dy,
+				item->u.shape.radius);
+		break;
+
+	case HTML_DISPLAY_LINE:
+	case HTML_DISPLAY_RECTANGLE:
+		r = item->u.shape.rect;
+		r.x0 += dx; r.x1 += dx;
+		r.y0 += dy; r.y1 += dy;
+		if (item->op == HTML_DISPLAY_LINE) {
+			res = plot->line(ctx, &item->u.shape.style, &r);
+		} else {
+			res = plot->rectangle(ctx, &item->u.shape.style, &r);
+		}
+		break;
+
+	case HTML_DISPLAY_POLYGON: {
+		const float *p = list->points + item->u.shape.points;
+		int points[16];
+		int *q = points;
+		unsigned int i;
+
+		if (item->u.shape.n * 2 > sizeof(points) / sizeof(points[0])) {
+			q = malloc(item->u.shape.n * 2 * sizeof(*q));
+			if (q == NULL) {
+				return NSERROR_NOMEM;
+			}
+		}
+		for (i = 0; i != item->u.shape.n * 2; i += 2) {
+			q[i] = p[i] + dx;
+			q[i + 1] = p[i + 1] + dy;
+		}
+		res = plot->polygon(ctx, &item->u.shape.style,
+				q, item->u.shape.n);
+		if (q != points) {
+			free(q);
+		}
+		break;
+	}
+
+	case HTML_DISPLAY_PATH: {
+		float transform[6];
+
+		memcpy(transform, item->u.shape.transform, sizeof(transform));
+		transform[4] += dx;
+		transform[5] += dy;
+		res = plot->path(ctx, &item->u.shape.style,
+				list->points + item->u.shape.points,
+				item->u.shape.n, transform);
+		break;
+	}
+
+	case HTML_DISPLAY_TEXT:
+		res = plot->text(ctx, &item->u.text.fstyle,
+				item->u.text.x + dx, item->u.text.y + dy,
+				list->text + item->u.text.offset,
+				item->u.text.length);
+		break;
+
+	case HTML_DISPLAY_GROUP_START:
+		if (plot->group_start != NULL) {
+			res = plot->group_start(ctx, item->u.name);
+		}
+		break;
+
+	case HTML_DISPLAY_GROUP_END:
+		if (plot->group_end != NULL) {
+			res = plot->group_end(ctx);
+		}
+		break;
+
+	case HTML_DISPLAY_CONTENT: {
+		struct content_redraw_data data = item->u.content.data;
+
+		r = item->u.content.clip;
+		r.x0 += dx; r.x1 += dx;
+		r.y0 += dy; r.y1 += dy;
+		html_display_intersect(&r, clip);
+		data.x += dx;
+		data.y += dy;
+		content_redraw(item->u.content.h, &data, &r, ctx);
+		break;
+	}
+
+	case HTML_DISPLAY_BOX:
+		/* the box restores this clip when it has been drawn, which
+		 * is the clip in force when it was recorded */
+		r = item->u.box.clip;
+		r.x0 += dx; r.x1 += dx;
+		r.y0 += dy; r.y1 += dy;
+		html_display_intersect(&r, clip);
+		if (!html_redraw_box(html, item->u.box.box,
+				item->u.box.x_parent + dx,
+				item->u.box.y_parent + dy,
+				&r, 1.0, item->u.box.background, ctx)) {
+			res = NSERROR_INVALID;
+		}
+		break;
+	}
+
+	return res;
+}
+
+
+/* exported interface documented in html/private.h */
+bool html_display_list_redraw(html_content *html,
+		struct content_redraw_data *data,
+		const struct rect *clip,
+		colour background,
+		const struct redraw_context *ctx,
+		bool *result)
+{
+	struct html_display_list *list = html->display_list;
+	struct rect doc_clip;
+	size_t replayed = 0;
+	uint64_t start_ms;
+	uint64_t end_ms;
+	size_t i;
+
+	if (!nsoption_bool(redraw_display_list) ||
+	    !ctx->interactive ||
+	    data->scale != 1.0 ||
+	    html_redraw_debug ||
+	    html->reflowing ||
+	    selection_active(html->sel) ||
+	    html->base.textsearch.context != NULL) {
+		/* state which is not recorded may be visible */
+		return false;
+	}
+
+	if (list != NULL &&
+	    (list->background != background ||
+	     list->background_images != ctx->background_images)) {
+		html_display_list_invalidate(html);
+		list = NULL;
+	}
+
+	if (list == NULL) {
+		list = html_display_list_record(html, background,
+				ctx->background_images);
+		if (list == NULL) {
+			return false;
+		}
+		html->display_list = list;
+	}
+
+	if (list->failed) {
+		return false;
+	}
+
+	/* clip in document coordinates */
+	doc_clip.x0 = clip->x0 - data->x;
+	doc_clip.y0 = clip->y0 - data->y;
+	doc_clip.x1 = clip->x1 - data->x;
+	doc_clip.y1 = clip->y1 - data->y;
+
+	nsu_getmonotonic_ms(&start_ms);
+
+	*result = true;
+	for (i = 0; i != list->count; i++) {
+		const struct html_display_item *item = &list->item[i];
+
+		if (item->bbox.x1 < doc_clip.x0 ||
+		    item->bbox.y1 < doc_clip.y0 ||
+		    item->bbox.x0 > doc_clip.x1 ||
+		    item->bbox.y0 > doc_clip.y1) {
+			continue;
+		}
+
+		if (html_display_replay(html, list, item,
+				data->x, data->y, clip, ctx) != NSERROR_OK) {
+			*result = false;
+			break;
+		}
+		replayed++;
+	}
+
+	nsu_getmonotonic_ms(&end_ms);
+
+	NSLOG(netsurf, DEBUG,
+	      "Replayed %"PRIsizet" of %"PRIsizet" display items in %"PRIu64"ms",
+	      replayed, list->count, end_ms - start_ms);
+
+	return true;
+}
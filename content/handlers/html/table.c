@@ -23,10 +23,10 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <dom/dom.h>
 
 #include "utils/log.h"
-#include "utils/talloc.h"
 #include "css/utils.h"
 
 #include "html/box.h"
@@ -819,7 +819,7 @@ table_calculate_column_types(const css_unit_ctx *unit_len_ctx, struct box *table
 		/* table->col already constructed, for example frameset table */
 		return true;
 
-	table->col = col = talloc_array(table, struct column, table->columns);
+	table->col = col = malloc(table->columns * sizeof(struct column));
 	if (!col)
 		return false;
 
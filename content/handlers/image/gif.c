@@ -33,9 +33,11 @@
 #include <assert.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <nsutils/assert.h>
+#include <nsutils/time.h>
 
 #include <nsgif.h>
 
@@ -61,8 +63,36 @@ typedef struct gif_content {
 
 	nsgif_t *gif; /**< GIF animation data */
 	uint32_t current_frame;   /**< current frame to display [0...(max-1)] */
+
+	uint32_t delay_ms; /**< display time of the current frame */
+	uint64_t due_ms; /**< time the next frame is due, when animating */
+	bool drawn; /**< current frame has been plotted */
+	bool paused; /**< animation stopped until the content is plotted */
+	struct gif_content *clock_prev; /**< previous animating content */
+	struct gif_content *clock_next; /**< next animating content */
+	bool on_clock; /**< content is on the animation clock */
 } gif_content;
 
+/**
+ * Frames due within this long of a clock tick are advanced by that tick.
+ */
+#define GIF_CLOCK_SLACK_MS 10
+
+/**
+ * Animation clock shared by all GIF contents.
+ *
+ * Every animating content is kept on a list with the time its next
+ * frame is due. A single scheduled callback advances all the contents
+ * which are due, so a page full of animations causes one timer and
+ * one batch of redraw requests per tick rather than one per image.
+ */
+static struct {
+	gif_content *head; /**< contents waiting for their next frame */
+	unsigned int ticks; /**< number of clock ticks run */
+	unsigned int frames; /**< number of frames advanced */
+	unsigned int pauses; /**< number of animations paused */
+} gif_clock;
+
 static inline nserror gif__nsgif_error_to_ns(nsgif_error gif_res)
 {
 	nserror err;
@@ -165,16 +195,96 @@ static nserror gif_create(const content_handler *handler,
 }
 
 /**
- * Scheduler callback. Performs any necessary animation.
+ * Scheduler callback. Advances every animation which is due.
  *
- * \param p  The content to animate
+ * \param p  unused
 */
-static void gif_animate_cb(void *p);
+static void gif_clock_tick(void *p);
+
+/**
+ * Schedule the animation clock for the earliest frame due.
+ */
+static void gif_clock_schedule(void)
+{
+	gif_content *gif;
+	uint64_t due_ms = UINT64_MAX;
+	uint64_t now_ms;
+
+	for (gif = gif_clock.head; gif != NULL; gif = gif->clock_next) {
+		if (gif->due_ms < due_ms) {
+			due_ms = gif->due_ms;
+		}
+	}
+
+	if (due_ms == UINT64_MAX) {
+		NSLOG(netsurf, DEBUG,
+		      "GIF clock idle after %u ticks, %u frames, %u pauses",
+		      gif_clock.ticks, gif_clock.frames, gif_clock.pauses);
+		guit->misc->schedule(-1, gif_clock_tick, NULL);
+		return;
+	}
+
+	nsu_getmonotonic_ms(&now_ms);
+
+	guit->misc->schedule(due_ms > now_ms ? due_ms - now_ms : 0,
+			gif_clock_tick, NULL);
+}
+
+/**
+ * Put a content on the animation clock.
+ *
+ * \param gif     The content to animate
+ * \param now_ms  The current time
+ */
+static void gif_clock_add(gif_content *gif, uint64_t now_ms)
+{
+	gif->due_ms = now_ms + gif->delay_ms;
+
+	if (gif->on_clock) {
+		return;
+	}
+
+	gif->clock_prev = NULL;
+	gif->clock_next = gif_clock.head;
+	if (gif_clock.head != NULL) {
+		gif_clock.head->clock_prev = gif;
+	}
+	gif_clock.head = gif;
+	gif->on_clock = true;
+}
+
+/**
+ * Take a content off the animation clock.
+ *
+ * \param gif  The content to stop animating
+ */
+static void gif_clock_remove(gif_content *gif)
+{
+	if (!gif->on_clock) {
+		return;
+	}
+
+	if (gif->clock_prev != NULL) {
+		gif->clock_prev->clock_next = gif->clock_next;
+	} else {
+		gif_clock.head = gif->clock_next;
+	}
+	if (gif->clock_next != NULL) {
+		gif->clock_next->clock_prev = gif->clock_prev;
+	}
+
+	gif->clock_prev = gif->clock_next = NULL;
+	gif->on_clock = false;
+}
 
 /**
  * Performs any necessary animation.
  *
- * \param p  The content to animate
+ * The content is put on the animation clock if it has a further frame
+ * to show; the caller must reschedule the clock.
+ *
+ * \param gif     The content to animate
+ * \param redraw  Whether to request a redraw of the changed area
 */
 static nserror gif__animate(gif_content *gif, bool redraw)
 {
@@ -182,6 +292,7 @@ static nserror gif__animate(gif_content *gif, bool redraw)
 	nsgif_rect_t rect;
 	uint32_t delay;
 	uint32_t f;
+	uint64_t now_ms;
 
 	gif_res = nsgif_frame_prepare(gif->gif, &rect, &delay, &f);
 	if (gif_res != NSGIF_OK) {
@@ -189,10 +300,16 @@ static nserror gif__animate(gif_content *gif, bool redraw)
 	}
 
 	gif->current_frame = f;
+	gif->drawn = false;
+	gif->paused = false;
 
 	/* Continue animating if we should */
 	if (nsoption_bool(animate_images) && delay != NSGIF_INFINITE) {
-		guit->misc->schedule(delay * 10, gif_animate_cb, gif);
+		gif->delay_ms = delay * 10;
+		nsu_getmonotonic_ms(&now_ms);
+		gif_clock_add(gif, now_ms);
+	} else {
+		gif_clock_remove(gif);
 	}
 
 	if (redraw) {
@@ -210,11 +327,40 @@ static nserror gif__animate(gif_content *gif, bool redraw)
 	return NSERROR_OK;
 }
 
-static void gif_animate_cb(void *p)
+static void gif_clock_tick(void *p)
 {
-	gif_content *gif = p;
+	gif_content *gif;
+	gif_content *next;
+	uint64_t now_ms;
 
-	gif__animate(gif, true);
+	nsu_getmonotonic_ms(&now_ms);
+	gif_clock.ticks++;
+
+	for (gif = gif_clock.head; gif != NULL; gif = next) {
+		next = gif->clock_next;
+
+		if (gif->due_ms > now_ms + GIF_CLOCK_SLACK_MS) {
+			continue;
+		}
+
+		if (!gif->drawn) {
+			/* Nothing plotted the current frame, so the image
+			 * is offscreen or in a hidden window. Stop until
+			 * it is plotted again. */
+			gif_clock_remove(gif);
+			gif->paused = true;
+			gif_clock.pauses++;
+			continue;
+		}
+
+		/* Advancing may put the content back at the list head,
+		 * which has already been visited */
+		gif_clock_remove(gif);
+		gif__animate(gif, true);
+		gif_clock.frames++;
+	}
+
+	gif_clock_schedule();
 }
 
 static bool gif_convert(struct content *c)
@@ -270,6 +416,7 @@ static bool gif_convert(struct content *c)
 		content_broadcast_error(c, NSERROR_GIF_ERROR, NULL);
 		return false;
 	}
+	gif_clock_schedule();
 
 	/* Exit as a success */
 	content_set_ready(c);
@@ -307,6 +454,18 @@ static bool gif_redraw(struct content *c, struct content_redraw_data *data,
 		return false;
 	}
 
+	gif->drawn = true;
+
+	if (gif->paused) {
+		/* Visible again; carry on from the current frame */
+		uint64_t now_ms;
+
+		gif->paused = false;
+		nsu_getmonotonic_ms(&now_ms);
+		gif_clock_add(gif, now_ms);
+		gif_clock_schedule();
+	}
+
 	return image_bitmap_plot(bitmap, data, clip, ctx);
 }
 
@@ -315,7 +474,8 @@ static void gif_destroy(struct content *c)
 	gif_content *gif = (gif_content *) c;
 
 	/* Free all the associated memory buffers */
-	guit->misc->schedule(-1, gif_animate_cb, c);
+	gif_clock_remove(gif);
+	gif_clock_schedule();
 	nsgif_destroy(gif->gif);
 }
 
@@ -366,15 +526,20 @@ static void gif_add_user(struct content *c)
 		/* First user, and content already converted, so start the animation. */
 		if (nsgif_reset(gif->gif) == NSGIF_OK) {
 			gif__animate(gif, true);
+			gif_clock_schedule();
 		}
 	}
 }
 
 static void gif_remove_user(struct content *c)
 {
+	gif_content *gif = (gif_content *) c;
+
 	if (content_count_users(c) == 1) {
 		/* Last user is about to be removed from this content, so stop the animation. */
-		guit->misc->schedule(-1, gif_animate_cb, c);
+		gif_clock_remove(gif);
+		gif->paused = false;
+		gif_clock_schedule();
 	}
 }
 
@@ -26,15 +26,23 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include "netsurf/inttypes.h"
 #include "utils/utils.h"
 #include "utils/log.h"
 #include "netsurf/misc.h"
 #include "netsurf/bitmap.h"
+#include "netsurf/plotters.h"
+#include "netsurf/content.h"
 #include "content/llcache.h"
+#include "content/content.h"
 #include "content/content_protected.h"
 #include "desktop/gui_internal.h"
+#include "desktop/bitmap.h"
 
 #include "image/image_cache.h"
 #include "image/image.h"
@@ -47,6 +55,83 @@
  */
 typedef unsigned int cache_age;
 
+/** Maximum number of decode worker threads */
+#define DECODE_THREAD_MAX 4
+
+/** Maximum number of decodes outstanding at once */
+#define DECODE_QUEUE_LENGTH 32
+
+/** Interval at which completed decodes are checked for (ms) */
+#define DECODE_RETIRE_TIME 10
+
+/**
+ * Number of reduced size bitmaps which may be held for an entry.
+ *
+ * Each is half the dimensions of the previous so the smallest is
+ * reduced by a factor of eight, the largest scaling the jpeg DCT and
+ * the png interlace passes directly support.
+ */
+#define IMAGE_CACHE_MIP_COUNT 3
+
+/**
+ * State of a decode job
+ */
+enum image_cache_decode_state {
+	DECODE_QUEUED = 0, /**< waiting for a worker */
+	DECODE_RUNNING, /**< being decoded by a worker */
+	DECODE_DONE, /**< decode finished, waiting to be retired */
+	DECODE_CANCELLED, /**< result no longer required */
+};
+
+/**
+ * Image decode job
+ *
+ * Everything a worker needs is captured when the job is queued so
+ * the worker never touches the cache or the content.
+ */
+struct image_cache_decode_job {
+	/** entry the decode is for or NULL if it has been detached */
+	struct image_cache_entry_s *centry;
+	enum image_cache_decode_state state; /**< job state */
+
+	image_cache_decode_fn *decode; /**< decoder to run */
+	const uint8_t *source; /**< image source data */
+	size_t source_size; /**< length of source data */
+
+	struct bitmap *bitmap; /**< bitmap being decoded into */
+	uint8_t *pixels; /**< bitmap pixel buffer */
+	size_t rowstride; /**< bitmap row stride */
+	int width; /**< bitmap width */
+	int height; /**< bitmap height */
+	unsigned int scale; /**< log2 of the reduction factor */
+
+	bitmap_fmt_t fmt; /**< format of decoded pixels */
+	bool res; /**< result of decode */
+};
+
+/**
+ * Image decode worker pool
+ *
+ * Jobs are added at tail by the main thread, taken in order by the
+ * workers which advance next and are then retired on the main thread
+ * which advances retire. The indexes increase monotonically and are
+ * reduced modulo the queue length to index the job array.
+ */
+struct image_cache_decode_pool {
+#ifdef WITH_PTHREAD
+	pthread_t thread[DECODE_THREAD_MAX]; /**< worker threads */
+	pthread_mutex_t lock; /**< protects indexes, quit and job state */
+	pthread_cond_t cond; /**< signalled when jobs are added or on quit */
+	pthread_cond_t done; /**< signalled when a job finishes */
+#endif
+	unsigned int thread_count; /**< number of running workers */
+	bool quit; /**< workers should exit once the queue is empty */
+	unsigned int retire; /**< next job to retire */
+	unsigned int next; /**< next job to be taken by a worker */
+	unsigned int tail; /**< next free job */
+	struct image_cache_decode_job job[DECODE_QUEUE_LENGTH]; /**< jobs */
+};
+
 /**
  * Image cache entry
  */
@@ -58,8 +143,16 @@ struct image_cache_entry_s {
 	struct content *content;
 	/** associated bitmap entry */
 	struct bitmap *bitmap;
+	/** reduced size bitmaps, mip[n] is reduced by a factor of 2^(n+1) */
+	struct bitmap *mip[IMAGE_CACHE_MIP_COUNT];
 	/** routine to convert content into bitmap */
 	image_cache_convert_fn *convert;
+	/** routine to decode content into a bitmap buffer */
+	image_cache_decode_fn *decode;
+	/** flags bitmaps for the decoder are created with */
+	unsigned int bitmap_flags;
+	/** decode in progress or NULL */
+	struct image_cache_decode_job *job;
 
 	/* Statistics for replacement algorithm */
 
@@ -89,6 +182,9 @@ struct image_cache_s {
 	/* The objects the cache holds */
 	struct image_cache_entry_s *entries;
 
+	/** decode workers */
+	struct image_cache_decode_pool pool;
+
 
 	/* Statistics for management algorithm */
 
@@ -177,16 +273,13 @@ static struct image_cache_entry_s *image_cache__find(const struct content *c)
 }
 
 /**
- * Update the image cache statistics with an entry.
+ * Update the image cache statistics with a newly resident bitmap.
  *
- * \param centry The image cache entry to update the stats with.
+ * \param size The size of the bitmap.
  */
-static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
+static void image_cache__stats_size_add(size_t size)
 {
-	centry->bitmap_age = image_cache->current_age;
-	centry->conversion_count++;
-
-	image_cache->total_bitmap_size += centry->bitmap_size;
+	image_cache->total_bitmap_size += size;
 	image_cache->bitmap_count++;
 
 	if (image_cache->total_bitmap_size > image_cache->max_bitmap_size) {
@@ -199,6 +292,19 @@ static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
 		image_cache->max_bitmap_count = image_cache->bitmap_count;
 		image_cache->max_bitmap_count_size = image_cache->total_bitmap_size;
 	}
+}
+
+/**
+ * Update the image cache statistics with an entry.
+ *
+ * \param centry The image cache entry to update the stats with.
+ */
+static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
+{
+	centry->bitmap_age = image_cache->current_age;
+	centry->conversion_count++;
+
+	image_cache__stats_size_add(centry->bitmap_size);
 
 	if (centry->conversion_count == 2) {
 		image_cache->total_extra_conversions_count++;
@@ -216,6 +322,101 @@ static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
 	}
 }
 
+/**
+ * Get a dimension reduced by a scale.
+ *
+ * \param dimension The full size dimension.
+ * \param scale log2 of the reduction factor.
+ * \return The reduced dimension rounded up.
+ */
+static inline int image_cache__scaled(int dimension, unsigned int scale)
+{
+	return (dimension + (1 << scale) - 1) >> scale;
+}
+
+/**
+ * Get the bitmap slot of an entry for a scale.
+ *
+ * \param centry The image cache entry.
+ * \param scale log2 of the reduction factor.
+ * \return The bitmap slot.
+ */
+static inline struct bitmap **
+image_cache__slot(struct image_cache_entry_s *centry, unsigned int scale)
+{
+	if (scale == 0) {
+		return &centry->bitmap;
+	}
+	return &centry->mip[scale - 1];
+}
+
+/**
+ * Get the size of the bitmap of an entry at a scale.
+ *
+ * \param centry The image cache entry.
+ * \param scale log2 of the reduction factor.
+ * \return The size of the bitmap in bytes.
+ */
+static size_t
+image_cache__scaled_size(struct image_cache_entry_s *centry, unsigned int scale)
+{
+	if (scale == 0) {
+		return centry->bitmap_size;
+	}
+	return image_cache__scaled(centry->content->width, scale) *
+		image_cache__scaled(centry->content->height, scale) * 4;
+}
+
+/**
+ * Get the total size of the bitmaps resident for an entry.
+ *
+ * \param centry The image cache entry.
+ * \return The size of the bitmaps in bytes.
+ */
+static size_t image_cache__entry_size(struct image_cache_entry_s *centry)
+{
+	size_t size = 0;
+	unsigned int scale;
+
+	for (scale = 0; scale <= IMAGE_CACHE_MIP_COUNT; scale++) {
+		if (*image_cache__slot(centry, scale) != NULL) {
+			size += image_cache__scaled_size(centry, scale);
+		}
+	}
+	return size;
+}
+
+/**
+ * Install a converted bitmap into an entry.
+ *
+ * \param centry The image cache entry.
+ * \param scale log2 of the reduction factor of the bitmap.
+ * \param bitmap The bitmap to install.
+ * \return true if the bitmap was installed or false if the entry already
+ *          had a bitmap at that scale and \a bitmap has been destroyed.
+ */
+static bool
+image_cache__install(struct image_cache_entry_s *centry,
+		     unsigned int scale,
+		     struct bitmap *bitmap)
+{
+	struct bitmap **slot = image_cache__slot(centry, scale);
+
+	if (*slot != NULL) {
+		guit->bitmap->destroy(bitmap);
+		return false;
+	}
+
+	*slot = bitmap;
+	if (scale == 0) {
+		image_cache_stats_bitmap_add(centry);
+	} else {
+		image_cache__stats_size_add(
+			image_cache__scaled_size(centry, scale));
+	}
+	return true;
+}
+
 static void image_cache__link(struct image_cache_entry_s *centry)
 {
 	centry->next = image_cache->entries;
@@ -248,12 +449,15 @@ static void image_cache__unlink(struct image_cache_entry_s *centry)
 }
 
 /**
- * free bitmap from an image cache entry
+ * free bitmaps from an image cache entry
  *
  * \param centry The image cache entry to free bitmap from.
  */
 static void image_cache__free_bitmap(struct image_cache_entry_s *centry)
 {
+	struct bitmap **slot;
+	unsigned int scale;
+
 	if (centry->bitmap != NULL) {
 #ifdef IMAGE_CACHE_VERBOSE
 		NSLOG(netsurf, INFO,
@@ -272,6 +476,520 @@ static void image_cache__free_bitmap(struct image_cache_entry_s *centry)
 		}
 	}
 
+	for (scale = 1; scale <= IMAGE_CACHE_MIP_COUNT; scale++) {
+		slot = image_cache__slot(centry, scale);
+		if (*slot != NULL) {
+			guit->bitmap->destroy(*slot);
+			*slot = NULL;
+			image_cache->total_bitmap_size -=
+				image_cache__scaled_size(centry, scale);
+			image_cache->bitmap_count--;
+		}
+	}
+}
+
+/**
+ * Create a bitmap for an entry ready to be decoded into.
+ *
+ * \param centry The image cache entry to create the bitmap for.
+ * \param scale log2 of the reduction factor of the bitmap.
+ * \param pixels Updated with the bitmap pixel buffer.
+ * \param rowstride Updated with the bitmap row stride.
+ * \return The new bitmap or NULL on error.
+ */
+static struct bitmap *
+image_cache__create_bitmap(struct image_cache_entry_s *centry,
+			   unsigned int scale,
+			   uint8_t **pixels,
+			   size_t *rowstride)
+{
+	struct bitmap *bitmap;
+
+	bitmap = guit->bitmap->create(
+			image_cache__scaled(centry->content->width, scale),
+			image_cache__scaled(centry->content->height, scale),
+			centry->bitmap_flags);
+	if (bitmap == NULL) {
+		return NULL;
+	}
+
+	/* The buffer allocation may occur when the buffer is acquired
+	 * and therefore may fail.
+	 */
+	*pixels = guit->bitmap->get_buffer(bitmap);
+	if (*pixels == NULL) {
+		guit->bitmap->destroy(bitmap);
+		return NULL;
+	}
+
+	*rowstride = guit->bitmap->get_rowstride(bitmap);
+
+	return bitmap;
+}
+
+/**
+ * Complete a decoded bitmap.
+ *
+ * Establishes if the bitmap is opaque and converts the pixels into
+ * the client format.
+ *
+ * \param bitmap The bitmap which has been decoded into.
+ * \param flags The flags the bitmap was created with.
+ * \param fmt The format of the decoded pixels.
+ */
+static void
+image_cache__finish_bitmap(struct bitmap *bitmap,
+			   unsigned int flags,
+			   bitmap_fmt_t fmt)
+{
+	if ((flags & BITMAP_OPAQUE) == 0) {
+		bool opaque = bitmap_test_opaque(bitmap);
+		guit->bitmap->set_opaque(bitmap, opaque);
+		if (opaque) {
+			/* premultiplication makes no difference */
+			fmt.pma = bitmap_fmt.pma;
+		}
+	}
+	bitmap_format_to_client(bitmap, &fmt);
+	guit->bitmap->modified(bitmap);
+}
+
+#ifdef WITH_PTHREAD
+/**
+ * Decode worker thread.
+ *
+ * Runs queued decodes until asked to quit and the queue is empty.
+ *
+ * \param ctx The decode pool.
+ * \return NULL
+ */
+static void *image_cache__decode_thread(void *ctx)
+{
+	struct image_cache_decode_pool *pool = ctx;
+	struct image_cache_decode_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while ((pool->next == pool->tail) && (pool->quit == false)) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if (pool->next == pool->tail) {
+			/* queue is empty and quit requested */
+			break;
+		}
+		job = &pool->job[pool->next % DECODE_QUEUE_LENGTH];
+		pool->next++;
+		if (job->state != DECODE_QUEUED) {
+			/* cancelled before it was started */
+			continue;
+		}
+		job->state = DECODE_RUNNING;
+		pthread_mutex_unlock(&pool->lock);
+
+		job->res = job->decode(job->source,
+				       job->source_size,
+				       job->pixels,
+				       job->rowstride,
+				       job->width,
+				       job->height,
+				       job->scale,
+				       &job->fmt);
+
+		pthread_mutex_lock(&pool->lock);
+		job->state = DECODE_DONE;
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/**
+ * Retire a finished decode job.
+ *
+ * A successful result is installed into the entry if it is still
+ * attached and does not already have a bitmap at that scale, and the
+ * content is redrawn. Any result not installed is destroyed.
+ *
+ * \param job The job to retire.
+ */
+static void image_cache__decode_complete(struct image_cache_decode_job *job)
+{
+	struct image_cache_entry_s *centry = job->centry;
+	union content_msg_data data;
+
+	if (centry != NULL) {
+		centry->job = NULL;
+
+		if ((job->state == DECODE_DONE) && (job->res == false)) {
+			image_cache->fail_count++;
+			image_cache->fail_size += centry->bitmap_size;
+		} else if ((job->state == DECODE_DONE) &&
+			   (*image_cache__slot(centry, job->scale) == NULL)) {
+			image_cache__finish_bitmap(job->bitmap,
+						   centry->bitmap_flags,
+						   job->fmt);
+			image_cache__install(centry, job->scale, job->bitmap);
+			job->bitmap = NULL;
+
+			/* whole content now available to plot */
+			data.redraw.x = 0;
+			data.redraw.y = 0;
+			data.redraw.width = centry->content->width;
+			data.redraw.height = centry->content->height;
+			content_broadcast(centry->content,
+					  CONTENT_MSG_REDRAW,
+					  &data);
+		}
+	}
+
+	if (job->bitmap != NULL) {
+		guit->bitmap->destroy(job->bitmap);
+		job->bitmap = NULL;
+	}
+	job->centry = NULL;
+}
+
+/**
+ * Retire finished decodes.
+ *
+ * Scheduled on the main thread while decodes are outstanding.
+ *
+ * \param p The decode pool.
+ */
+static void image_cache__decode_retire(void *p)
+{
+	struct image_cache_decode_pool *pool = p;
+	struct image_cache_decode_job *job;
+	bool outstanding;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->retire != pool->next) {
+		job = &pool->job[pool->retire % DECODE_QUEUE_LENGTH];
+		if (job->state == DECODE_RUNNING) {
+			/* retire in order */
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		image_cache__decode_complete(job);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->retire++;
+	}
+	outstanding = (pool->retire != pool->tail);
+	pthread_mutex_unlock(&pool->lock);
+
+	if (outstanding) {
+		guit->misc->schedule(DECODE_RETIRE_TIME,
+				     image_cache__decode_retire,
+				     pool);
+	}
+}
+
+/**
+ * Queue a decode of an entry on the worker pool.
+ *
+ * \param centry The image cache entry to decode.
+ * \param scale log2 of the reduction factor to decode at.
+ * \return true if a decode is in progress for the entry else false.
+ */
+static bool
+image_cache__decode_queue(struct image_cache_entry_s *centry,
+			  unsigned int scale)
+{
+	struct image_cache_decode_pool *pool = &image_cache->pool;
+	struct image_cache_decode_job *job;
+	const uint8_t *source;
+	size_t source_size;
+
+	if (centry->job != NULL) {
+		/* already in progress */
+		return true;
+	}
+
+	if ((pool->thread_count == 0) ||
+	    (centry->decode == NULL) ||
+	    ((pool->tail - pool->retire) >= DECODE_QUEUE_LENGTH)) {
+		return false;
+	}
+
+	source = content__get_source_data(centry->content, &source_size);
+	if (source == NULL) {
+		return false;
+	}
+
+	job = &pool->job[pool->tail % DECODE_QUEUE_LENGTH];
+	job->bitmap = image_cache__create_bitmap(centry,
+						 scale,
+						 &job->pixels,
+						 &job->rowstride);
+	if (job->bitmap == NULL) {
+		return false;
+	}
+	job->centry = centry;
+	job->decode = centry->decode;
+	job->source = source;
+	job->source_size = source_size;
+	job->width = image_cache__scaled(centry->content->width, scale);
+	job->height = image_cache__scaled(centry->content->height, scale);
+	job->scale = scale;
+	job->fmt = bitmap_fmt;
+	job->res = false;
+	job->state = DECODE_QUEUED;
+
+	centry->job = job;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->retire == pool->tail) {
+		/* queue was empty */
+		guit->misc->schedule(DECODE_RETIRE_TIME,
+				     image_cache__decode_retire,
+				     pool);
+	}
+	pool->tail++;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return true;
+}
+
+/**
+ * Detach an entry from its outstanding decode.
+ *
+ * A decode which has not started is cancelled, one which is running
+ * is waited for as the source data it is reading is owned by the
+ * content. The result of a finished decode is installed into the
+ * entry immediately instead of when the job is retired.
+ *
+ * \param centry The image cache entry to detach.
+ * \param discard Destroy any result instead of installing it.
+ */
+static void
+image_cache__decode_claim(struct image_cache_entry_s *centry, bool discard)
+{
+	struct image_cache_decode_pool *pool = &image_cache->pool;
+	struct image_cache_decode_job *job = centry->job;
+
+	if (job == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (job->state == DECODE_RUNNING) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	if (job->state == DECODE_QUEUED) {
+		job->state = DECODE_CANCELLED;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if ((discard == false) &&
+	    (job->state == DECODE_DONE) &&
+	    (job->res == true)) {
+		image_cache__finish_bitmap(job->bitmap,
+					   centry->bitmap_flags,
+					   job->fmt);
+		image_cache__install(centry, job->scale, job->bitmap);
+		job->bitmap = NULL;
+	}
+
+	/* any remaining result is destroyed when the job is retired */
+	job->centry = NULL;
+	centry->job = NULL;
+}
+
+/**
+ * Start the decode worker threads.
+ *
+ * One fewer worker than there are processors is started, leaving one
+ * for the main thread, with at least one and at most DECODE_THREAD_MAX.
+ * Failing to start any workers is not an error as decodes are then
+ * performed on the main thread.
+ *
+ * \param pool The decode pool.
+ */
+static void image_cache__decode_start(struct image_cache_decode_pool *pool)
+{
+	long ncpu;
+	unsigned int count;
+	unsigned int idx;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu > DECODE_THREAD_MAX) {
+		count = DECODE_THREAD_MAX;
+	} else if (ncpu > 1) {
+		count = ncpu - 1;
+	} else {
+		count = 1;
+	}
+
+	if ((pthread_mutex_init(&pool->lock, NULL) != 0) ||
+	    (pthread_cond_init(&pool->cond, NULL) != 0) ||
+	    (pthread_cond_init(&pool->done, NULL) != 0)) {
+		NSLOG(netsurf, ERROR, "Unable to initialise decode pool");
+		return;
+	}
+
+	for (idx = 0; idx < count; idx++) {
+		if (pthread_create(&pool->thread[idx],
+				   NULL,
+				   image_cache__decode_thread,
+				   pool) != 0) {
+			NSLOG(netsurf, ERROR,
+			      "Unable to start decode worker %u", idx);
+			break;
+		}
+	}
+	pool->thread_count = idx;
+
+	if (pool->thread_count == 0) {
+		pthread_cond_destroy(&pool->done);
+		pthread_cond_destroy(&pool->cond);
+		pthread_mutex_destroy(&pool->lock);
+		return;
+	}
+
+	NSLOG(netsurf, INFO, "Image decode using %u worker threads",
+	      pool->thread_count);
+}
+
+/**
+ * Stop the decode worker threads.
+ *
+ * Decodes which have not started are cancelled and all jobs retired.
+ *
+ * \param pool The decode pool.
+ */
+static void image_cache__decode_stop(struct image_cache_decode_pool *pool)
+{
+	unsigned int idx;
+
+	if (pool->thread_count == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	for (idx = pool->next; idx != pool->tail; idx++) {
+		pool->job[idx % DECODE_QUEUE_LENGTH].state = DECODE_CANCELLED;
+	}
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (idx = 0; idx < pool->thread_count; idx++) {
+		pthread_join(pool->thread[idx], NULL);
+	}
+	pool->thread_count = 0;
+
+	guit->misc->schedule(-1, image_cache__decode_retire, pool);
+	image_cache__decode_retire(pool);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+}
+#else
+static inline bool
+image_cache__decode_queue(struct image_cache_entry_s *centry,
+			  unsigned int scale)
+{
+	return false;
+}
+
+static inline void
+image_cache__decode_claim(struct image_cache_entry_s *centry, bool discard)
+{
+}
+
+static inline void
+image_cache__decode_start(struct image_cache_decode_pool *pool)
+{
+}
+
+static inline void
+image_cache__decode_stop(struct image_cache_decode_pool *pool)
+{
+}
+#endif
+
+/**
+ * Convert an entry into a bitmap on the calling thread.
+ *
+ * \param centry The image cache entry to convert.
+ * \param scale log2 of the reduction factor to convert at.
+ * \return The bitmap or NULL on error.
+ */
+static struct bitmap *
+image_cache__convert(struct image_cache_entry_s *centry, unsigned int scale)
+{
+	const uint8_t *source;
+	size_t source_size;
+	struct bitmap *bitmap;
+	uint8_t *pixels;
+	size_t rowstride;
+	bitmap_fmt_t fmt = bitmap_fmt;
+
+	if (centry->convert != NULL) {
+		/* convert functions only produce full size bitmaps */
+		assert(scale == 0);
+		return centry->convert(centry->content);
+	}
+
+	if (centry->decode == NULL) {
+		return NULL;
+	}
+
+	source = content__get_source_data(centry->content, &source_size);
+	if (source == NULL) {
+		return NULL;
+	}
+
+	bitmap = image_cache__create_bitmap(centry, scale, &pixels, &rowstride);
+	if (bitmap == NULL) {
+		return NULL;
+	}
+
+	if (centry->decode(source, source_size, pixels, rowstride,
+			   image_cache__scaled(centry->content->width, scale),
+			   image_cache__scaled(centry->content->height, scale),
+			   scale,
+			   &fmt) == false) {
+		guit->bitmap->destroy(bitmap);
+		return NULL;
+	}
+
+	image_cache__finish_bitmap(bitmap, centry->bitmap_flags, fmt);
+
+	return bitmap;
+}
+
+/**
+ * Ensure an entry has a bitmap at a scale converting on the calling
+ * thread if necessary.
+ *
+ * If a decode for the entry is outstanding its result is used.
+ *
+ * \param centry The image cache entry to convert.
+ * \param scale log2 of the reduction factor required.
+ * \return The bitmap or NULL on error.
+ */
+static struct bitmap *
+image_cache__ensure(struct image_cache_entry_s *centry, unsigned int scale)
+{
+	struct bitmap **slot = image_cache__slot(centry, scale);
+	struct bitmap *bitmap;
+
+	image_cache__decode_claim(centry, false);
+
+	if (*slot == NULL) {
+		bitmap = image_cache__convert(centry, scale);
+		if (bitmap != NULL) {
+			image_cache__install(centry, scale, bitmap);
+		}
+	}
+
+	return *slot;
 }
 
 /**
@@ -285,6 +1003,8 @@ static void image_cache__free_entry(struct image_cache_entry_s *centry)
 	NSLOG(netsurf, INFO, "freeing %p ", centry);
 #endif
 
+	image_cache__decode_claim(centry, true);
+
 	if (centry->redraw_count == 0) {
 		image_cache->total_unrendered++;
 	}
@@ -353,12 +1073,7 @@ struct bitmap *image_cache_get_bitmap(const struct content *c)
 	}
 
 	if (centry->bitmap == NULL) {
-		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
-		}
-
-		if (centry->bitmap != NULL) {
-			image_cache_stats_bitmap_add(centry);
+		if (image_cache__ensure(centry, 0) != NULL) {
 			image_cache->miss_count++;
 			image_cache->miss_size += centry->bitmap_size;
 		} else {
@@ -422,6 +1137,8 @@ image_cache_init(const struct image_cache_parameters *image_cache_parameters)
 
 	image_cache->params = *image_cache_parameters;
 
+	image_cache__decode_start(&image_cache->pool);
+
 	guit->misc->schedule(image_cache->params.bg_clean_time,
 				image_cache__background_update,
 				image_cache);
@@ -444,6 +1161,8 @@ nserror image_cache_fini(void)
 	NSLOG(netsurf, INFO, "Size at finish %"PRIsizet" (in %d)",
 	      image_cache->total_bitmap_size, image_cache->bitmap_count);
 
+	image_cache__decode_stop(&image_cache->pool);
+
 	while (image_cache->entries != NULL) {
 		image_cache__free_entry(image_cache->entries);
 	}
@@ -506,10 +1225,21 @@ nserror image_cache_fini(void)
 	return NSERROR_OK;
 }
 
-/* exported interface documented in image_cache.h */
-nserror image_cache_add(struct content *content,
-			struct bitmap *bitmap,
-			image_cache_convert_fn *convert)
+/**
+ * Add an image content to the cache.
+ *
+ * \param content The content handle used as a key
+ * \param bitmap The already converted content or NULL.
+ * \param convert The function to convert the content or NULL.
+ * \param decode The function to decode the content or NULL.
+ * \param bitmap_flags The flags to create bitmaps for the decoder with.
+ * \return NSERROR_OK on success or error code on failure.
+ */
+static nserror image_cache__add(struct content *content,
+				struct bitmap *bitmap,
+				image_cache_convert_fn *convert,
+				image_cache_decode_fn *decode,
+				unsigned int bitmap_flags)
 {
 	struct image_cache_entry_s *centry;
 
@@ -535,6 +1265,8 @@ nserror image_cache_add(struct content *content,
 	      content, bitmap);
 
 	centry->convert = convert;
+	centry->decode = decode;
+	centry->bitmap_flags = bitmap_flags;
 
 	/* set bitmap entry if one is passed, free extant one if present */
 	if (bitmap != NULL) {
@@ -546,13 +1278,11 @@ nserror image_cache_add(struct content *content,
 		centry->bitmap = bitmap;
 	} else {
 		/* no bitmap, check to see if we should speculatively convert */
-		if ((centry->convert != NULL) &&
-		    (image_cache_speculate(content) == true)) {
-			centry->bitmap = centry->convert(centry->content);
-
-			if (centry->bitmap != NULL) {
-				image_cache_stats_bitmap_add(centry);
-			} else {
+		if (((centry->convert != NULL) || (centry->decode != NULL)) &&
+		    (centry->bitmap == NULL) &&
+		    (image_cache_speculate(content) == true) &&
+		    (image_cache__decode_queue(centry, 0) == false)) {
+			if (image_cache__ensure(centry, 0) == NULL) {
 				image_cache->fail_count++;
 			}
 		}
@@ -563,6 +1293,23 @@ nserror image_cache_add(struct content *content,
 	return NSERROR_OK;
 }
 
+/* exported interface documented in image_cache.h */
+nserror image_cache_add(struct content *content,
+			struct bitmap *bitmap,
+			image_cache_convert_fn *convert)
+{
+	return image_cache__add(content, bitmap, convert, NULL, BITMAP_NONE);
+}
+
+/* exported interface documented in image_cache.h */
+nserror image_cache_add_decoder(struct content *content,
+				struct bitmap *bitmap,
+				image_cache_decode_fn *decode,
+				unsigned int bitmap_flags)
+{
+	return image_cache__add(content, bitmap, NULL, decode, bitmap_flags);
+}
+
 /* exported interface documented in image_cache.h */
 nserror image_cache_remove(struct content *content)
 {
@@ -767,16 +1514,10 @@ image_cache_snentryf(char *string,
 				break;
 
 			case 's':
-				if (centry->bitmap != NULL) {
-					slen += snprintf(string + slen,
-							 size - slen,
-							 "%" PRIssizet,
-							 centry->bitmap_size);
-				} else {
-					slen += snprintf(string + slen,
-							 size - slen,
-							 "0");
-				}
+				slen += snprintf(string + slen,
+						 size - slen,
+						 "%" PRIssizet,
+						 image_cache__entry_size(centry));
 				break;
 			}
 			fmtc++;
@@ -794,6 +1535,103 @@ image_cache_snentryf(char *string,
 }
 
 
+/**
+ * Select the scale to plot an entry at.
+ *
+ * The smallest reduction which is still at least as large as the area
+ * being plotted is chosen. Only contents with a decoder can be reduced
+ * and non-interactive redraws such as printing always use the full
+ * size bitmap.
+ *
+ * \param centry The image cache entry being plotted.
+ * \param data The redraw data.
+ * \param ctx The redraw context.
+ * \return log2 of the reduction factor.
+ */
+static unsigned int
+image_cache__redraw_scale(struct image_cache_entry_s *centry,
+			  const struct content_redraw_data *data,
+			  const struct redraw_context *ctx)
+{
+	unsigned int scale = 0;
+
+	if ((centry->decode == NULL) || (ctx->interactive == false)) {
+		return 0;
+	}
+
+	while ((scale < IMAGE_CACHE_MIP_COUNT) &&
+	       (image_cache__scaled(centry->content->width,
+				    scale + 1) >= data->width) &&
+	       (image_cache__scaled(centry->content->height,
+				    scale + 1) >= data->height)) {
+		scale++;
+	}
+
+	return scale;
+}
+
+/**
+ * Find a resident bitmap suitable for plotting at a scale.
+ *
+ * \param centry The image cache entry being plotted.
+ * \param scale log2 of the reduction factor wanted.
+ * \return The bitmap or NULL if none is resident.
+ */
+static struct bitmap *
+image_cache__find_scaled(struct image_cache_entry_s *centry,
+			 unsigned int scale)
+{
+	unsigned int idx;
+
+	/* closest at or above the wanted size */
+	for (idx = scale + 1; idx > 0; idx--) {
+		if (*image_cache__slot(centry, idx - 1) != NULL) {
+			return *image_cache__slot(centry, idx - 1);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Plot the area of an image whose decode is still pending.
+ *
+ * The area the image will cover is filled with the background colour
+ * it is plotted over, a placeholder of the image's size until the
+ * decoded bitmap replaces it.
+ *
+ * \param data The redraw data for the image.
+ * \param clip The current clip rectangle.
+ * \param ctx The redraw context.
+ * \return true on success else false.
+ */
+static bool
+image_cache__plot_pending(struct content_redraw_data *data,
+			  const struct rect *clip,
+			  const struct redraw_context *ctx)
+{
+	plot_style_t fill_style;
+	struct rect area;
+
+	area = *clip;
+
+	if (data->repeat_x != true) {
+		area.x0 = data->x;
+		area.x1 = data->x + data->width;
+	}
+
+	if (data->repeat_y != true) {
+		area.y0 = data->y;
+		area.y1 = data->y + data->height;
+	}
+
+	fill_style.stroke_type = PLOT_OP_TYPE_NONE;
+	fill_style.fill_type = PLOT_OP_TYPE_SOLID;
+	fill_style.fill_colour = data->background_colour;
+
+	return (ctx->plot->rectangle(ctx, &fill_style, &area) == NSERROR_OK);
+}
+
 /* exported interface documented in image_cache.h */
 bool image_cache_redraw(struct content *c,
 			struct content_redraw_data *data,
@@ -801,6 +1639,8 @@ bool image_cache_redraw(struct content *c,
 			const struct redraw_context *ctx)
 {
 	struct image_cache_entry_s *centry;
+	struct bitmap *bitmap;
+	unsigned int scale;
 
 	/* get the cache entry */
 	centry = image_cache__find(c);
@@ -810,23 +1650,43 @@ bool image_cache_redraw(struct content *c,
 		return false;
 	}
 
-	if (centry->bitmap == NULL) {
-		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
+	scale = image_cache__redraw_scale(centry, data, ctx);
+
+	bitmap = image_cache__find_scaled(centry, scale);
+	if (bitmap == NULL) {
+		bool pending = (centry->job != NULL);
+
+		if ((ctx->interactive == true) &&
+		    (image_cache__decode_queue(centry, scale) == true)) {
+			/* plot the background until the decode
+			 * completes and the content is redrawn
+			 */
+			if (pending == false) {
+				image_cache->miss_count++;
+				image_cache->miss_size +=
+					image_cache__scaled_size(centry, scale);
+			}
+			centry->redraw_count++;
+			centry->redraw_age = image_cache->current_age;
+
+			return image_cache__plot_pending(data, clip, ctx);
 		}
 
-		if (centry->bitmap != NULL) {
-			image_cache_stats_bitmap_add(centry);
+		bitmap = image_cache__ensure(centry, scale);
+
+		if (bitmap != NULL) {
 			image_cache->miss_count++;
-			image_cache->miss_size += centry->bitmap_size;
+			image_cache->miss_size +=
+				image_cache__scaled_size(centry, scale);
 		} else {
 			image_cache->fail_count++;
-			image_cache->fail_size += centry->bitmap_size;
+			image_cache->fail_size +=
+				image_cache__scaled_size(centry, scale);
 			return false;
 		}
 	} else {
 		image_cache->hit_count++;
-		image_cache->hit_size += centry->bitmap_size;
+		image_cache->hit_size += image_cache__scaled_size(centry, scale);
 	}
 
 
@@ -834,7 +1694,7 @@ bool image_cache_redraw(struct content *c,
 	centry->redraw_count++;
 	centry->redraw_age = image_cache->current_age;
 
-	return image_bitmap_plot(centry->bitmap, data, clip, ctx);
+	return image_bitmap_plot(bitmap, data, clip, ctx);
 }
 
 /* exported interface documented in image_cache.h */
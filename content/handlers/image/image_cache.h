@@ -39,6 +39,7 @@
 
 #include "utils/errors.h"
 #include "netsurf/content_type.h"
+#include "netsurf/bitmap.h"
 
 struct content;
 struct content_redraw_data;
@@ -46,6 +47,38 @@ struct redraw_context;
 
 typedef struct bitmap * (image_cache_convert_fn) (struct content *content);
 
+/**
+ * Decode image source data into a pixel buffer.
+ *
+ * Decoders may be run on a worker thread so they must only touch the
+ *  parameters they are passed; in particular they must not call any
+ *  frontend or content interfaces.
+ *
+ * The cache may ask for the image to be reduced by a power of two in
+ *  each dimension when it is being plotted at a smaller size. The
+ *  reduced dimensions are the content dimensions divided by the
+ *  reduction factor and rounded up.
+ *
+ * \param source The image source data.
+ * \param source_size The length of the source data.
+ * \param pixels The buffer to decode into.
+ * \param rowstride The length of a row in the pixel buffer in bytes.
+ * \param width The width of the pixel buffer.
+ * \param height The height of the pixel buffer.
+ * \param scale log2 of the reduction factor, from 0 to 3.
+ * \param fmt Updated with the format of the decoded pixels.
+ *
+ * \return true if the pixel buffer was populated else false.
+ */
+typedef bool (image_cache_decode_fn) (const uint8_t *source,
+				      size_t source_size,
+				      uint8_t *pixels,
+				      size_t rowstride,
+				      int width,
+				      int height,
+				      unsigned int scale,
+				      bitmap_fmt_t *fmt);
+
 struct image_cache_parameters {
 	/** How frequently the background cache clean process is run (ms) */
 	unsigned int bg_clean_time;
@@ -78,6 +111,26 @@ nserror image_cache_add(struct content *content,
 			struct bitmap *bitmap, 
 			image_cache_convert_fn *convert);
 
+/**
+ * adds an image content to be cached with a pixel decoder.
+ *
+ * Unlike the convert function a decoder does not create the bitmap
+ *  itself which allows the cache to perform the decode away from the
+ *  main thread. While a decode is outstanding redraws fill the image
+ *  area with the background colour and the content is redrawn once
+ *  the bitmap is available.
+ *
+ * @param content The content handle used as a key
+ * @param bitmap A bitmap representing the already converted content or NULL.
+ * @param decode The function to decode the content source data.
+ * @param bitmap_flags The flags to create the bitmap with.
+ * @return A netsurf error code.
+ */
+nserror image_cache_add_decoder(struct content *content,
+				struct bitmap *bitmap,
+				image_cache_decode_fn *decode,
+				unsigned int bitmap_flags);
+
 nserror image_cache_remove(struct content *content);
 
 
@@ -108,7 +161,7 @@ bool image_cache_speculate(struct content *c);
  * %k - The content key
  * %r - The number of redraws of this bitmap
  * %c - The number of times this bitmap has been converted
- * %s - The size of the current bitmap allocation
+ * %s - The size of the current bitmap allocations including reduced sizes
  *
  * \param string  The buffer in which to place the results.
  * \param size    The size of the string buffer.
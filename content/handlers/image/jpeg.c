@@ -36,7 +36,6 @@
 #include "content/content.h"
 #include "content/content_protected.h"
 #include "content/content_factory.h"
-#include "desktop/gui_internal.h"
 #include "desktop/bitmap.h"
 
 #include "image/image_cache.h"
@@ -140,8 +139,10 @@ static void nsjpeg_term_source(j_decompress_ptr cinfo)
  */
 static void nsjpeg_error_log(j_common_ptr cinfo)
 {
-	cinfo->err->format_message(cinfo, nsjpeg_error_buffer);
-	NSLOG(netsurf, INFO, "%s", nsjpeg_error_buffer);
+	char buffer[JMSG_LENGTH_MAX];
+
+	cinfo->err->format_message(cinfo, buffer);
+	NSLOG(netsurf, INFO, "%s", buffer);
 }
 
 
@@ -160,6 +161,23 @@ static void nsjpeg_error_exit(j_common_ptr cinfo)
 	longjmp(*setjmp_buffer, 1);
 }
 
+/**
+ * Fatal error handler for JPEG library when decoding a bitmap.
+ *
+ * As the decode may be on a worker thread the message is formatted
+ * into a local buffer instead of the shared one.
+ */
+static void nsjpeg_decode_error_exit(j_common_ptr cinfo)
+{
+	jmp_buf *setjmp_buffer = (jmp_buf *) cinfo->client_data;
+	char buffer[JMSG_LENGTH_MAX];
+
+	cinfo->err->format_message(cinfo, buffer);
+	NSLOG(netsurf, INFO, "%s", buffer);
+
+	longjmp(*setjmp_buffer, 1);
+}
+
 /**
  * Convert scan lines from CMYK to core client bitmap layout.
  */
@@ -249,19 +267,24 @@ static inline void nsjpeg__decode_client_fmt(
 }
 
 /**
- * create a bitmap from jpeg content.
+ * Decode jpeg source data into a bitmap buffer.
+ *
+ * May be called on an image cache worker thread.
  */
-static struct bitmap *
-jpeg_cache_convert(struct content *c)
+static bool
+jpeg_cache_decode(const uint8_t *source_data,
+		  size_t source_size,
+		  uint8_t *pixels,
+		  size_t rowstride,
+		  int width,
+		  int height,
+		  unsigned int scale,
+		  bitmap_fmt_t *fmt)
 {
-	const uint8_t *source_data; /* Jpeg source data */
-	size_t source_size; /* length of Jpeg source data */
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
 	jmp_buf setjmp_buffer;
-	struct bitmap * volatile bitmap = NULL;
-	uint8_t * volatile pixels = NULL;
-	size_t rowstride;
+	volatile bool started = false;
 	struct jpeg_source_mgr source_mgr = {
 		0,
 		0,
@@ -271,23 +294,23 @@ jpeg_cache_convert(struct content *c)
 		jpeg_resync_to_restart,
 		nsjpeg_term_source };
 
-	/* obtain jpeg source data and perfom minimal sanity checks */
-	source_data = content__get_source_data(c, &source_size);
-
+	/* perfom minimal sanity checks on jpeg source data */
 	if ((source_data == NULL) ||
 	    (source_size < MIN_JPEG_SIZE)) {
-		return NULL;
+		return false;
 	}
 
 	/* setup a JPEG library error handler */
 	cinfo.err = jpeg_std_error(&jerr);
-	jerr.error_exit = nsjpeg_error_exit;
+	jerr.error_exit = nsjpeg_decode_error_exit;
 	jerr.output_message = nsjpeg_error_log;
 
-	/* handler for fatal errors during decompression */
+	/* handler for fatal errors during decompression, any
+	 * scanlines already decoded are kept
+	 */
 	if (setjmp(setjmp_buffer)) {
 		jpeg_destroy_decompress(&cinfo);
-		return bitmap;
+		return started;
 	}
 
 	cinfo.client_data = &setjmp_buffer;
@@ -324,7 +347,7 @@ jpeg_cache_convert(struct content *c)
 			NSLOG(netsurf, ERROR, "Unexpected bitmap format: %u",
 					bitmap_fmt.layout);
 			jpeg_destroy_decompress(&cinfo);
-			return NULL;
+			return false;
 		}
 #else
 		cinfo.out_color_space = JCS_RGB;
@@ -332,29 +355,22 @@ jpeg_cache_convert(struct content *c)
 	}
 	cinfo.dct_method = JDCT_ISLOW;
 
+	/* reduce the image during the inverse DCT */
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = 1 << scale;
+
 	/* commence the decompression, output parameters now valid */
 	jpeg_start_decompress(&cinfo);
 
-	/* create opaque bitmap (jpegs cannot be transparent) */
-	bitmap = guit->bitmap->create(
-			cinfo.output_width,
-			cinfo.output_height, BITMAP_OPAQUE);
-	if (bitmap == NULL) {
-		/* empty bitmap could not be created */
-		jpeg_destroy_decompress(&cinfo);
-		return NULL;
-	}
-
-	pixels = guit->bitmap->get_buffer(bitmap);
-	if (pixels == NULL) {
-		/* bitmap with no buffer available */
-		guit->bitmap->destroy(bitmap);
+	if ((cinfo.output_width != (JDIMENSION)width) ||
+	    (cinfo.output_height != (JDIMENSION)height)) {
+		/* output does not match the bitmap */
 		jpeg_destroy_decompress(&cinfo);
-		return NULL;
+		return false;
 	}
 
 	/* Convert scanlines from jpeg into bitmap */
-	rowstride = guit->bitmap->get_rowstride(bitmap);
+	started = true;
 
 	switch (cinfo.out_color_space) {
 	case JCS_CMYK:
@@ -370,12 +386,13 @@ jpeg_cache_convert(struct content *c)
 		break;
 	}
 
-	guit->bitmap->modified(bitmap);
-
 	jpeg_finish_decompress(&cinfo);
 	jpeg_destroy_decompress(&cinfo);
 
-	return bitmap;
+	/* scanlines were written in the client format */
+	*fmt = bitmap_fmt;
+
+	return true;
 }
 
 /**
@@ -428,7 +445,8 @@ static bool nsjpeg_convert(struct content *c)
 
 	jpeg_destroy_decompress(&cinfo);
 
-	image_cache_add(c, NULL, jpeg_cache_convert);
+	/* jpegs cannot be transparent */
+	image_cache_add_decoder(c, NULL, jpeg_cache_decode, BITMAP_OPAQUE);
 
 	/* set title text */
 	title = messages_get_buff("JPEGTitle",
@@ -427,21 +427,12 @@ png_cache_read_fn(png_structp png_ptr, png_bytep data, png_size_t length)
 
 /** calculate an array of row pointers into a bitmap data area
  */
-static png_bytep *calc_row_pointers(struct bitmap *bitmap)
+static png_bytep *
+calc_row_pointers(uint8_t *buffer, size_t rowstride, int height)
 {
-	int height = guit->bitmap->get_height(bitmap);
-	unsigned char *buffer= guit->bitmap->get_buffer(bitmap);
-	size_t rowstride = guit->bitmap->get_rowstride(bitmap);
 	png_bytep *row_ptrs;
 	int hloop;
 
-	/* The buffer allocation may occour when the buffer is aquired
-	 * and therefore may fail.
-	 */
-	if (buffer == NULL) {
-		return NULL;
-	}
-
 	row_ptrs = malloc(sizeof(png_bytep) * height);
 
 	if (row_ptrs != NULL) {
@@ -453,51 +444,137 @@ static png_bytep *calc_row_pointers(struct bitmap *bitmap)
 	return row_ptrs;
 }
 
-/** PNG content to bitmap conversion.
+/** Decode a PNG image reduced by a power of two.
  *
- * This routine generates a bitmap object from a PNG image content
+ * Rows are read one at a time keeping every 2^scale pixel of every
+ * 2^scale row so only a single full size row is ever held. Interlaced
+ * images are read a pass at a time and reading stops at the first
+ * pass which contributes no pixels, so an image reduced by eight only
+ * needs the first Adam7 pass.
  */
-static struct bitmap *
-png_cache_convert(struct content *c)
+static void
+png_cache_decode_reduced(png_structp png_ptr,
+			 png_infop info_ptr,
+			 png_bytep row,
+			 uint8_t *pixels,
+			 size_t rowstride,
+			 unsigned int scale)
+{
+	png_uint_32 width = png_get_image_width(png_ptr, info_ptr);
+	png_uint_32 height = png_get_image_height(png_ptr, info_ptr);
+	png_uint_32 mask = (1 << scale) - 1;
+	png_uint_32 rows, cols, start_row, start_col, row_step, col_step;
+	png_uint_32 r, c, x, y;
+	uint8_t *dst;
+	int passes = 1;
+	int pass;
+
+	if (png_get_interlace_type(png_ptr, info_ptr) == PNG_INTERLACE_ADAM7) {
+		passes = PNG_INTERLACE_ADAM7_PASSES;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		if (passes == 1) {
+			rows = height;
+			cols = width;
+			start_row = start_col = 0;
+			row_step = col_step = 1;
+		} else {
+			rows = PNG_PASS_ROWS(height, pass);
+			cols = PNG_PASS_COLS(width, pass);
+			start_row = PNG_PASS_START_ROW(pass);
+			start_col = PNG_PASS_START_COL(pass);
+			row_step = 1 << PNG_PASS_ROW_SHIFT(pass);
+			col_step = 1 << PNG_PASS_COL_SHIFT(pass);
+
+			if (((start_row | start_col) & mask) != 0) {
+				/* this and all later passes are between
+				 * the pixels being kept
+				 */
+				break;
+			}
+
+			if ((rows == 0) || (cols == 0)) {
+				/* empty passes are skipped by libpng */
+				continue;
+			}
+		}
+
+		for (r = 0; r < rows; r++) {
+			png_read_row(png_ptr, row, NULL);
+
+			y = start_row + r * row_step;
+			if ((y & mask) != 0) {
+				continue;
+			}
+
+			dst = pixels + (y >> scale) * rowstride;
+			for (c = 0; c < cols; c++) {
+				x = start_col + c * col_step;
+				if ((x & mask) == 0) {
+					memcpy(dst + (x >> scale) * 4,
+					       row + c * 4,
+					       4);
+				}
+			}
+		}
+	}
+}
+
+/** PNG source data to bitmap buffer decode.
+ *
+ * This routine decodes a PNG image into a bitmap buffer and may be
+ * called on an image cache worker thread.
+ */
+static bool
+png_cache_decode(const uint8_t *source,
+		 size_t source_size,
+		 uint8_t *pixels,
+		 size_t rowstride,
+		 int bitmap_width,
+		 int bitmap_height,
+		 unsigned int scale,
+		 bitmap_fmt_t *fmt)
 {
 	png_structp png_ptr;
 	png_infop info_ptr;
 	png_infop end_info_ptr;
-	volatile struct bitmap * volatile bitmap = NULL;
+	volatile bool res = false;
 	struct png_cache_read_data_s png_cache_read_data;
 	png_uint_32 width, height;
 	volatile png_bytep * volatile row_pointers = NULL;
+	png_bytep volatile row = NULL;
 
-	png_cache_read_data.data = 
-		content__get_source_data(c, &png_cache_read_data.size);
+	png_cache_read_data.data = source;
+	png_cache_read_data.size = source_size;
 
 	if ((png_cache_read_data.data == NULL) || 
 	    (png_cache_read_data.size <= 8)) {
-		return NULL;
+		return false;
 	}
 
 	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
 			nspng_error, nspng_warning);
 	if (png_ptr == NULL) {
-		return NULL;
+		return false;
 	}
 
 	info_ptr = png_create_info_struct(png_ptr);
 	if (info_ptr == NULL) {
 		png_destroy_read_struct(&png_ptr, NULL, NULL);
-		return NULL;
+		return false;
 	}
 
 	end_info_ptr = png_create_info_struct(png_ptr);
 	if (end_info_ptr == NULL) {
 		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		return NULL;
+		return false;
 	}
 
 	/* setup error exit path */
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		/* cleanup and bail */
-		goto png_cache_convert_error;
+		goto png_cache_decode_error;
 	}
 
 	/* read from a buffer instead of stdio */
@@ -512,23 +589,37 @@ png_cache_convert(struct content *c)
 	width = png_get_image_width(png_ptr, info_ptr);
 	height = png_get_image_height(png_ptr, info_ptr);
 
-	/* Claim the required memory for the converted PNG */
-	bitmap = guit->bitmap->create(width, height, BITMAP_NONE);
-	if (bitmap == NULL) {
+	/* The bitmap must be the size of the reduced PNG */
+	if ((((width + (1 << scale) - 1) >> scale) !=
+	     (png_uint_32)bitmap_width) ||
+	    (((height + (1 << scale) - 1) >> scale) !=
+	     (png_uint_32)bitmap_height)) {
 		/* cleanup and bail */
-		goto png_cache_convert_error;
+		goto png_cache_decode_error;
 	}
 
-	row_pointers = calc_row_pointers((struct bitmap *) bitmap);
+	/* The result is set before any rows are read so that should
+	 * libpng bail out part way through a damaged image the rows
+	 * already decoded are kept.
+	 */
+	if (scale == 0) {
+		row_pointers = calc_row_pointers(pixels, rowstride, height);
 
-	if (row_pointers != NULL) {
-		png_read_image(png_ptr, (png_bytep *) row_pointers);
+		if (row_pointers != NULL) {
+			res = true;
+			png_read_image(png_ptr, (png_bytep *) row_pointers);
+		}
 	} else {
-		guit->bitmap->destroy((struct bitmap *)bitmap);
-		bitmap = NULL;
+		row = malloc(png_get_rowbytes(png_ptr, info_ptr));
+
+		if (row != NULL) {
+			res = true;
+			png_cache_decode_reduced(png_ptr, info_ptr, row,
+						 pixels, rowstride, scale);
+		}
 	}
 
-png_cache_convert_error:
+png_cache_decode_error:
 
 	/* cleanup png read */
 	png_destroy_read_struct(&png_ptr, &info_ptr, &end_info_ptr);
@@ -537,17 +628,13 @@ png_cache_convert_error:
 		free((png_bytep *) row_pointers);
 	}
 
-	if (bitmap != NULL) {
-		bool opaque = bitmap_test_opaque((void *)bitmap);
-		guit->bitmap->set_opaque((void *)bitmap, opaque);
-		bitmap_format_to_client((void *)bitmap, &(bitmap_fmt_t) {
-			.layout = bitmap_fmt.layout,
-			.pma = opaque ? bitmap_fmt.pma : false,
-		});
-		guit->bitmap->modified((void *)bitmap);
-	}
+	free(row);
+
+	/* transforms give the client layout without premultiplication */
+	fmt->layout = bitmap_fmt.layout;
+	fmt->pma = false;
 
-	return (struct bitmap *)bitmap;
+	return res;
 }
 
 static bool nspng_convert(struct content *c)
@@ -580,7 +667,8 @@ static bool nspng_convert(struct content *c)
 		guit->bitmap->modified(png_c->bitmap);
 	}
 
-	image_cache_add(c, png_c->bitmap, png_cache_convert);
+	image_cache_add_decoder(c, png_c->bitmap,
+				png_cache_decode, BITMAP_NONE);
 
 	content_set_ready(c);
 	content_set_done(c);
@@ -37,7 +37,6 @@
 #include "content/llcache.h"
 #include "content/content_protected.h"
 #include "content/content_factory.h"
-#include "desktop/gui_internal.h"
 #include "desktop/bitmap.h"
 
 #include "image/image_cache.h"
@@ -84,90 +83,86 @@ webp_create(const content_handler *handler,
 }
 
 /**
- * create a bitmap from webp content.
+ * Decode webp source data into a bitmap buffer.
+ *
+ * May be called on an image cache worker thread.
  */
-static struct bitmap *
-webp_cache_convert(struct content *c)
+static bool
+webp_cache_decode(const uint8_t *source_data,
+		  size_t source_size,
+		  uint8_t *pixels,
+		  size_t rowstride,
+		  int width,
+		  int height,
+		  unsigned int scale,
+		  bitmap_fmt_t *fmt)
 {
-	const uint8_t *source_data; /* webp source data */
-	size_t source_size; /* length of webp source data */
-	VP8StatusCode webpres;
-	WebPBitstreamFeatures webpfeatures;
-	unsigned int bmap_flags;
-	uint8_t *pixels = NULL;
-	uint8_t *decoded;
-	size_t rowstride;
-	struct bitmap *bitmap = NULL;
+	WebPDecoderConfig config;
 	bitmap_fmt_t webp_fmt = {
 		.layout = bitmap_fmt.layout,
 	};
 
-	source_data = content__get_source_data(c, &source_size);
+	if (WebPInitDecoderConfig(&config) == 0) {
+		return false;
+	}
 
-	webpres = WebPGetFeatures(source_data, source_size, &webpfeatures);
+	if (WebPGetFeatures(source_data,
+			    source_size,
+			    &config.input) != VP8_STATUS_OK) {
+		return false;
+	}
 
-	if (webpres != VP8_STATUS_OK) {
-		return NULL;
+	if ((((config.input.width + (1 << scale) - 1) >> scale) != width) ||
+	    (((config.input.height + (1 << scale) - 1) >> scale) != height)) {
+		return false;
 	}
 
-	if (webpfeatures.has_alpha == 0) {
-		bmap_flags = BITMAP_OPAQUE;
+	if (config.input.has_alpha == 0) {
 		/* Image has no alpha. Premultiplied alpha makes no difference.
 		 * Optimisation: Avoid unnecessary conversion by copying format.
 		 */
 		webp_fmt.pma = bitmap_fmt.pma;
-	} else {
-		bmap_flags = BITMAP_NONE;
-	}
-
-	/* create bitmap */
-	bitmap = guit->bitmap->create(webpfeatures.width,
-				      webpfeatures.height,
-				      bmap_flags);
-	if (bitmap == NULL) {
-		/* empty bitmap could not be created */
-		return NULL;
-	}
-
-	pixels = guit->bitmap->get_buffer(bitmap);
-	if (pixels == NULL) {
-		/* bitmap with no buffer available */
-		guit->bitmap->destroy(bitmap);
-		return NULL;
 	}
 
-	rowstride = guit->bitmap->get_rowstride(bitmap);
-
 	switch (webp_fmt.layout) {
 	default:
 		/* WebP has no ABGR function, fall back to default. */
 		webp_fmt.layout = BITMAP_LAYOUT_R8G8B8A8;
 		/* Fall through. */
 	case BITMAP_LAYOUT_R8G8B8A8:
-		decoded = WebPDecodeRGBAInto(source_data, source_size, pixels,
-				rowstride * webpfeatures.height, rowstride);
+		config.output.colorspace = MODE_RGBA;
 		break;
 
 	case BITMAP_LAYOUT_B8G8R8A8:
-		decoded = WebPDecodeBGRAInto(source_data, source_size, pixels,
-				rowstride * webpfeatures.height, rowstride);
+		config.output.colorspace = MODE_BGRA;
 		break;
 
 	case BITMAP_LAYOUT_A8R8G8B8:
-		decoded = WebPDecodeARGBInto(source_data, source_size, pixels,
-				rowstride * webpfeatures.height, rowstride);
+		config.output.colorspace = MODE_ARGB;
 		break;
 	}
-	if (decoded == NULL) {
+
+	if (scale != 0) {
+		/* resample while decoding */
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
+	}
+
+	/* decode directly into the bitmap */
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = pixels;
+	config.output.u.RGBA.stride = rowstride;
+	config.output.u.RGBA.size = rowstride * height;
+
+	if (WebPDecode(source_data, source_size, &config) != VP8_STATUS_OK) {
 		/* decode failed */
-		guit->bitmap->destroy(bitmap);
-		return NULL;
+		return false;
 	}
 
-	bitmap_format_to_client(bitmap, &webp_fmt);
-	guit->bitmap->modified(bitmap);
+	*fmt = webp_fmt;
 
-	return bitmap;
+	return true;
 }
 
 /**
@@ -182,25 +177,29 @@ webp_cache_convert(struct content *c)
  */
 static bool webp_convert(struct content *c)
 {
-	int res;
 	const uint8_t* data;
 	size_t data_size;
-	int width;
-	int height;
+	WebPBitstreamFeatures webpfeatures;
+	unsigned int bmap_flags;
 
 	data = content__get_source_data(c, &data_size);
 
-	res = WebPGetInfo(data, data_size, &width, &height);
-	if (res == 0) {
-		NSLOG(netsurf, INFO, "WebPGetInfo failed:%p", c);
+	if (WebPGetFeatures(data, data_size, &webpfeatures) != VP8_STATUS_OK) {
+		NSLOG(netsurf, INFO, "WebPGetFeatures failed:%p", c);
 		return false;
 	}
 
-	c->width = width;
-	c->height = height;
+	c->width = webpfeatures.width;
+	c->height = webpfeatures.height;
 	c->size = c->width * c->height * 4;
 
-	image_cache_add(c, NULL, webp_cache_convert);
+	if (webpfeatures.has_alpha == 0) {
+		bmap_flags = BITMAP_OPAQUE;
+	} else {
+		bmap_flags = BITMAP_NONE;
+	}
+
+	image_cache_add_decoder(c, NULL, webp_cache_decode, bmap_flags);
 
 	content_set_ready(c);
 	content_set_done(c);
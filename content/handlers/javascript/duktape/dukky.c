@@ -25,6 +25,8 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <nsutils/time.h>
 
 #include "netsurf/inttypes.h"
@@ -32,6 +34,9 @@
 #include "utils/nsoption.h"
 #include "utils/log.h"
 #include "utils/corestrings.h"
+#include "utils/sha256.h"
+#include "netsurf/misc.h"
+#include "desktop/gui_internal.h"
 #include "content/content.h"
 
 #include "javascript/js.h"
@@ -53,6 +58,61 @@
 #define GENERICS_MAGIC MAGIC(GENERICS_TABLE)
 #define THREAD_MAP MAGIC(THREAD_MAP)
 
+/** Total bytecode size the compiled script cache may hold */
+#define SCRIPT_CACHE_SIZE (4 * 1024 * 1024)
+
+/** Number of hash buckets in the compiled script cache */
+#define SCRIPT_CACHE_BUCKETS 256
+
+/** Delay before building a spare heap to replace one handed out */
+#define SPARE_HEAP_DELAY_MS 250
+
+/** Number of pooled allocation size classes */
+#define POOL_CLASSES 8
+
+/** Size of the blocks pooled allocations are carved from */
+#define POOL_CHUNK_SIZE (32 * 1024)
+
+/**
+ * Header on every allocation made for duktape
+ *
+ * Duktape does not pass the size to its free function so it is
+ * recorded here, the union keeps the payload suitably aligned.
+ */
+union dukky_alloc_header {
+	size_t size; /**< size of the allocation */
+	double align_d;
+	void *align_p;
+	uint64_t align_u;
+};
+
+/**
+ * Pooled allocation which is not in use
+ */
+struct dukky_pool_free {
+	struct dukky_pool_free *next; /**< next free allocation of class */
+};
+
+/**
+ * Block pooled allocations are carved from
+ */
+struct dukky_pool_chunk {
+	struct dukky_pool_chunk *next; /**< next chunk of the heap */
+	union dukky_alloc_header pad; /**< keep allocations aligned */
+};
+
+/**
+ * Memory statistics for a javascript heap
+ */
+struct dukky_heap_stats {
+	size_t live; /**< bytes allocated and not yet freed */
+	size_t peak; /**< greatest value of live */
+	size_t pooled; /**< bytes held in pool chunks */
+	unsigned int allocs; /**< number of allocations */
+	unsigned int large; /**< number of allocations too large to pool */
+	unsigned int refused; /**< allocations refused by the limit */
+};
+
 /**
  * dukky javascript heap
  */
@@ -62,6 +122,14 @@ struct jsheap {
 	bool pending_destroy; /**< Whether this heap is pending destruction */
 	unsigned int live_threads; /**< number of live threads */
 	uint64_t exec_start_time;
+
+	size_t limit; /**< memory limit in bytes or zero for none */
+	bool over_limit; /**< an allocation was refused by the limit */
+	size_t refused_size; /**< size of the refused allocation */
+	unsigned int protected_calls; /**< depth of limited protected calls */
+	struct dukky_pool_free *pool[POOL_CLASSES]; /**< free lists */
+	struct dukky_pool_chunk *chunks; /**< chunks owned by the pool */
+	struct dukky_heap_stats stats; /**< memory statistics */
 };
 
 /**
@@ -543,34 +611,534 @@ dukky_inject_not_ctr(duk_context *ctx, int idx, const char *name)
 /* We need to override the defaults because not all platforms are fully ANSI
  * compatible.  E.g. RISC OS gets upset if we malloc or realloc a zero byte
  * block, as do debugging tools such as Electric Fence by Bruce Perens.
+ *
+ * Duktape makes a great many small allocations for strings and
+ * objects so those are served from per heap pools of fixed size
+ * classes, which avoids allocator overhead and keeps a heap's
+ * small blocks together. Each heap's usage is accounted for so a
+ * document's scripts can be held to a memory limit.
+ */
+
+/** Payload size of each pool class, the header is in addition */
+static const size_t dukky_pool_class_size[POOL_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256
+};
+
+/**
+ * Find the pool class for an allocation size
+ *
+ * \param size The size of allocation
+ * \return The class index or POOL_CLASSES if too large to pool
+ */
+static unsigned int dukky_pool_class(size_t size)
+{
+	unsigned int cls;
+
+	for (cls = 0; cls < POOL_CLASSES; cls++) {
+		if (size <= dukky_pool_class_size[cls])
+			break;
+	}
+
+	return cls;
+}
+
+/**
+ * Refill a pool class free list with a new chunk
+ *
+ * \param heap The heap whose pool to refill
+ * \param cls The class to refill
+ * \return true on success else false
+ */
+static bool dukky_pool_refill(jsheap *heap, unsigned int cls)
+{
+	struct dukky_pool_chunk *chunk;
+	size_t slot = sizeof(union dukky_alloc_header) +
+		dukky_pool_class_size[cls];
+	uint8_t *base;
+	uint8_t *end;
+
+	chunk = malloc(POOL_CHUNK_SIZE);
+	if (chunk == NULL)
+		return false;
+
+	chunk->next = heap->chunks;
+	heap->chunks = chunk;
+	heap->stats.pooled += POOL_CHUNK_SIZE;
+
+	base = (uint8_t *)(chunk + 1);
+	end = (uint8_t *)chunk + POOL_CHUNK_SIZE;
+	for (; base + slot <= end; base += slot) {
+		struct dukky_pool_free *entry = (struct dukky_pool_free *)base;
+		entry->next = heap->pool[cls];
+		heap->pool[cls] = entry;
+	}
+
+	return true;
+}
+
+/**
+ * Account for an allocation against a heap's limit
+ *
+ * \param heap The heap allocating
+ * \param size The size of allocation
+ * \return true if the allocation may proceed
  */
+static bool dukky_heap_charge(jsheap *heap, size_t size)
+{
+	/* Duktape aborts on allocation failure outside a protected
+	 * call, so the limit is only enforced within one.
+	 */
+	if (heap->limit != 0 && heap->protected_calls > 0 &&
+	    heap->stats.live + size > heap->limit) {
+		/* Duktape will collect garbage and retry, if that
+		 * fails the running script is stopped by the
+		 * timeout check.
+		 */
+		heap->over_limit = true;
+		heap->refused_size = size;
+		heap->stats.refused++;
+		return false;
+	}
+
+	if (heap->over_limit && size >= heap->refused_size) {
+		/* the retry after garbage collection succeeded */
+		heap->over_limit = false;
+	}
+
+	heap->stats.live += size;
+	if (heap->stats.live > heap->stats.peak)
+		heap->stats.peak = heap->stats.live;
+	heap->stats.allocs++;
+
+	return true;
+}
 
 static void *dukky_alloc_function(void *udata, duk_size_t size)
 {
+	jsheap *heap = udata;
+	union dukky_alloc_header *hdr;
+	unsigned int cls;
+
 	if (size == 0)
 		return NULL;
 
-	return malloc(size);
+	if (dukky_heap_charge(heap, size) == false)
+		return NULL;
+
+	cls = dukky_pool_class(size);
+	if (cls < POOL_CLASSES) {
+		if (heap->pool[cls] == NULL &&
+		    dukky_pool_refill(heap, cls) == false) {
+			heap->stats.live -= size;
+			return NULL;
+		}
+		hdr = (union dukky_alloc_header *)heap->pool[cls];
+		heap->pool[cls] = heap->pool[cls]->next;
+	} else {
+		hdr = malloc(sizeof(*hdr) + size);
+		if (hdr == NULL) {
+			heap->stats.live -= size;
+			return NULL;
+		}
+		heap->stats.large++;
+	}
+
+	hdr->size = size;
+
+	return hdr + 1;
+}
+
+static void dukky_free_function(void *udata, void *ptr)
+{
+	jsheap *heap = udata;
+	union dukky_alloc_header *hdr;
+	unsigned int cls;
+
+	if (ptr == NULL)
+		return;
+
+	hdr = (union dukky_alloc_header *)ptr - 1;
+	heap->stats.live -= hdr->size;
+
+	cls = dukky_pool_class(hdr->size);
+	if (cls < POOL_CLASSES) {
+		struct dukky_pool_free *entry = (struct dukky_pool_free *)hdr;
+		entry->next = heap->pool[cls];
+		heap->pool[cls] = entry;
+	} else {
+		free(hdr);
+	}
 }
 
 static void *dukky_realloc_function(void *udata, void *ptr, duk_size_t size)
 {
-	if (ptr == NULL && size == 0)
-		return NULL;
+	jsheap *heap = udata;
+	union dukky_alloc_header *hdr;
+	void *nptr;
+
+	if (ptr == NULL)
+		return dukky_alloc_function(udata, size);
 
 	if (size == 0) {
-		free(ptr);
+		dukky_free_function(udata, ptr);
 		return NULL;
 	}
 
-	return realloc(ptr, size);
+	hdr = (union dukky_alloc_header *)ptr - 1;
+
+	if (dukky_pool_class(hdr->size) == dukky_pool_class(size) &&
+	    dukky_pool_class(size) < POOL_CLASSES) {
+		/* still fits the same pool slot */
+		if (size > hdr->size &&
+		    dukky_heap_charge(heap, size - hdr->size) == false)
+			return NULL;
+		if (size < hdr->size)
+			heap->stats.live -= hdr->size - size;
+		hdr->size = size;
+		return ptr;
+	}
+
+	if (dukky_pool_class(hdr->size) == POOL_CLASSES &&
+	    dukky_pool_class(size) == POOL_CLASSES) {
+		/* both too large to pool, let the system resize */
+		union dukky_alloc_header *nhdr;
+
+		if (size > hdr->size &&
+		    dukky_heap_charge(heap, size - hdr->size) == false)
+			return NULL;
+
+		nhdr = realloc(hdr, sizeof(*nhdr) + size);
+		if (nhdr == NULL) {
+			if (size > hdr->size)
+				heap->stats.live -= size - hdr->size;
+			return NULL;
+		}
+		if (size < nhdr->size)
+			heap->stats.live -= nhdr->size - size;
+		nhdr->size = size;
+		return nhdr + 1;
+	}
+
+	/* moving between pool classes or in or out of the pool */
+	nptr = dukky_alloc_function(udata, size);
+	if (nptr == NULL)
+		return NULL;
+
+	memcpy(nptr, ptr, (size < hdr->size) ? size : hdr->size);
+	dukky_free_function(udata, ptr);
+
+	return nptr;
 }
 
+/* Compiled script caching
+ *
+ * Compiling is a large part of the cost of running a script, and the
+ * same scripts are run over and over: the built in polyfill and
+ * generics for every new thread, and the scripts shared by the pages
+ * of a site on every visit. Compiled functions are dumped to bytecode
+ * once and loaded from that thereafter.
+ *
+ * Duktape does not validate bytecode it is asked to load, so only
+ * bytecode produced by this process is ever loaded, which also
+ * guarantees it matches the engine version.
+ */
 
-static void dukky_free_function(void *udata, void *ptr)
+/**
+ * Built in script whose bytecode is kept for the life of the process
+ */
+struct dukky_builtin {
+	const char *name; /**< script name */
+	const uint8_t *source; /**< script source */
+	size_t source_len; /**< length of source */
+	uint8_t *bytecode; /**< compiled script or NULL if not yet compiled */
+	size_t bytecode_len; /**< length of bytecode */
+};
+
+static struct dukky_builtin dukky_polyfill = {
+	"polyfill.js", polyfill_js, sizeof(polyfill_js), NULL, 0
+};
+
+static struct dukky_builtin dukky_generics = {
+	"generics.js", generics_js, sizeof(generics_js), NULL, 0
+};
+
+/**
+ * Compiled script cache entry
+ */
+struct dukky_script {
+	struct dukky_script *next; /**< next less recently used entry */
+	struct dukky_script *prev; /**< next more recently used entry */
+	struct dukky_script *chain; /**< next entry in the same bucket */
+	char *name; /**< script name, usually the URL it came from */
+	uint8_t digest[SHA256_DIGEST_SIZE]; /**< digest of script source */
+	size_t source_len; /**< length of script source */
+	uint8_t *bytecode; /**< compiled script */
+	size_t bytecode_len; /**< length of bytecode */
+};
+
+/**
+ * Compiled script cache
+ *
+ * Entries are found by the SHA-256 digest of their source, so a script
+ * can only be given the bytecode of an identical source.
+ */
+static struct {
+	struct dukky_script *buckets[SCRIPT_CACHE_BUCKETS]; /**< hash chains */
+	struct dukky_script *scripts; /**< entries, most recently used first */
+	struct dukky_script *oldest; /**< least recently used entry */
+	size_t size; /**< total bytecode held */
+	unsigned int hits; /**< scripts loaded from bytecode */
+	unsigned int misses; /**< scripts compiled from source */
+} dukky_script_cache;
+
+/**
+ * Find the hash bucket for a script source digest
+ */
+static struct dukky_script **
+dukky_script_bucket(const uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	return &dukky_script_cache.buckets[digest[0] % SCRIPT_CACHE_BUCKETS];
+}
+
+/**
+ * Add a script to the most recently used end of the cache order
+ */
+static void dukky_script_link(struct dukky_script *script)
 {
-	if (ptr != NULL)
-		free(ptr);
+	script->prev = NULL;
+	script->next = dukky_script_cache.scripts;
+	if (script->next != NULL) {
+		script->next->prev = script;
+	} else {
+		dukky_script_cache.oldest = script;
+	}
+	dukky_script_cache.scripts = script;
+}
+
+/**
+ * Remove a script from the cache order
+ */
+static void dukky_script_unlink(struct dukky_script *script)
+{
+	if (script->prev != NULL) {
+		script->prev->next = script->next;
+	} else {
+		dukky_script_cache.scripts = script->next;
+	}
+	if (script->next != NULL) {
+		script->next->prev = script->prev;
+	} else {
+		dukky_script_cache.oldest = script->prev;
+	}
+}
+
+/**
+ * Push a function loaded from bytecode
+ *
+ * \param ctx The duktape context to push onto
+ * \param bytecode The bytecode from duk_dump_function()
+ * \param len The length of the bytecode
+ */
+static void
+dukky_push_bytecode(duk_context *ctx, const uint8_t *bytecode, size_t len)
+{
+	void *buf;
+
+	/* ... */
+	buf = duk_push_fixed_buffer(ctx, len);
+	memcpy(buf, bytecode, len);
+	/* ..., bytecode */
+	duk_load_function(ctx);
+	/* ..., function */
+}
+
+/**
+ * Compile source and keep a copy of the resulting bytecode
+ *
+ * \param ctx The duktape context to compile in
+ * \param name The script name
+ * \param source The script source
+ * \param source_len The length of the source
+ * \param bytecode Updated with the bytecode or NULL if it cannot be kept
+ * \param bytecode_len Updated with the length of the bytecode
+ * \return zero with the compiled function pushed or non zero with the
+ *          error pushed.
+ */
+static duk_int_t
+dukky_compile_and_dump(duk_context *ctx,
+		       const char *name,
+		       const uint8_t *source,
+		       size_t source_len,
+		       uint8_t **bytecode,
+		       size_t *bytecode_len)
+{
+	void *buf;
+	duk_size_t len;
+
+	*bytecode = NULL;
+	*bytecode_len = 0;
+
+	/* ... */
+	duk_push_string(ctx, name);
+	/* ..., name */
+	if (duk_pcompile_lstring_filename(ctx,
+					  DUK_COMPILE_EVAL,
+					  (const char *)source,
+					  source_len) != 0) {
+		/* ..., error */
+		return DUK_EXEC_ERROR;
+	}
+	/* ..., function */
+	duk_dup_top(ctx);
+	/* ..., function, function */
+	duk_dump_function(ctx);
+	/* ..., function, bytecode */
+	buf = duk_get_buffer(ctx, -1, &len);
+	if (len > 0) {
+		*bytecode = malloc(len);
+		if (*bytecode != NULL) {
+			memcpy(*bytecode, buf, len);
+			*bytecode_len = len;
+		}
+	}
+	duk_pop(ctx);
+	/* ..., function */
+
+	return DUK_EXEC_SUCCESS;
+}
+
+/**
+ * Push a built in script, compiling it on first use
+ *
+ * \param ctx The duktape context to push onto
+ * \param builtin The built in script
+ * \return zero with the function pushed or non zero with the error pushed
+ */
+static duk_int_t
+dukky_push_builtin(duk_context *ctx, struct dukky_builtin *builtin)
+{
+	if (builtin->bytecode != NULL) {
+		dukky_push_bytecode(ctx,
+				    builtin->bytecode,
+				    builtin->bytecode_len);
+		return DUK_EXEC_SUCCESS;
+	}
+
+	return dukky_compile_and_dump(ctx,
+				      builtin->name,
+				      builtin->source,
+				      builtin->source_len,
+				      &builtin->bytecode,
+				      &builtin->bytecode_len);
+}
+
+/**
+ * Discard least recently used scripts until the cache is under a limit
+ *
+ * \param limit The size to reduce the cache to
+ */
+static void dukky_script_cache_trim(size_t limit)
+{
+	while (dukky_script_cache.oldest != NULL &&
+	       dukky_script_cache.size > limit) {
+		struct dukky_script *script = dukky_script_cache.oldest;
+		struct dukky_script **link = dukky_script_bucket(script->digest);
+
+		while (*link != script) {
+			link = &(*link)->chain;
+		}
+		*link = script->chain;
+
+		dukky_script_unlink(script);
+		dukky_script_cache.size -= script->bytecode_len;
+
+		free(script->name);
+		free(script->bytecode);
+		free(script);
+	}
+}
+
+/**
+ * Push a script, from the compiled script cache if possible
+ *
+ * \param ctx The duktape context to push onto
+ * \param name The script name
+ * \param source The script source
+ * \param source_len The length of the source
+ * \return zero with the function pushed or non zero with the error pushed
+ */
+static duk_int_t
+dukky_push_script(duk_context *ctx,
+		  const char *name,
+		  const uint8_t *source,
+		  size_t source_len)
+{
+	struct dukky_script **bucket;
+	struct dukky_script *script;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	uint8_t *bytecode;
+	size_t bytecode_len;
+	duk_int_t res;
+
+	sha256(source, source_len, digest);
+	bucket = dukky_script_bucket(digest);
+
+	for (script = *bucket; script != NULL; script = script->chain) {
+		if (script->source_len == source_len &&
+		    memcmp(script->digest, digest, sizeof(digest)) == 0 &&
+		    strcmp(script->name, name) == 0) {
+			/* move to front */
+			dukky_script_unlink(script);
+			dukky_script_link(script);
+
+			dukky_script_cache.hits++;
+			dukky_push_bytecode(ctx,
+					    script->bytecode,
+					    script->bytecode_len);
+			return DUK_EXEC_SUCCESS;
+		}
+	}
+
+	dukky_script_cache.misses++;
+
+	res = dukky_compile_and_dump(ctx, name, source, source_len,
+				     &bytecode, &bytecode_len);
+	if (res != DUK_EXEC_SUCCESS || bytecode == NULL) {
+		return res;
+	}
+
+	if (bytecode_len > SCRIPT_CACHE_SIZE / 4) {
+		/* too large to be worth displacing everything else */
+		free(bytecode);
+		return res;
+	}
+
+	script = malloc(sizeof(*script));
+	if (script == NULL) {
+		free(bytecode);
+		return res;
+	}
+	script->name = strdup(name);
+	if (script->name == NULL) {
+		free(script);
+		free(bytecode);
+		return res;
+	}
+	memcpy(script->digest, digest, sizeof(digest));
+	script->source_len = source_len;
+	script->bytecode = bytecode;
+	script->bytecode_len = bytecode_len;
+
+	script->chain = *bucket;
+	*bucket = script;
+	dukky_script_link(script);
+
+	dukky_script_cache.size += bytecode_len;
+	if (dukky_script_cache.size > SCRIPT_CACHE_SIZE) {
+		dukky_script_cache_trim(SCRIPT_CACHE_SIZE);
+	}
+
+	return res;
 }
 
 /* exported interface documented in js.h */
@@ -586,22 +1154,44 @@ void js_initialise(void)
 }
 
 
-/* exported interface documented in js.h */
-void js_finalise(void)
-{
-	/* NADA for now */
-}
+/**
+ * Heap built ahead of need
+ *
+ * Creating a heap builds every binding prototype, which is the bulk of
+ * the cost of a new browser window or frame. The prototypes are
+ * ordinary objects in the heap which scripts may modify, so they
+ * cannot be shared between heaps or a heap reused. Instead a fresh
+ * heap is kept ready, built from the scheduler after the previous one
+ * was taken, which moves the cost off the path of opening a window.
+ */
+static struct {
+	jsheap *heap; /**< spare heap or NULL */
+	unsigned int built; /**< number of heaps created */
+	unsigned int used; /**< number of spare heaps handed out */
+	uint64_t build_ms; /**< total time spent creating heaps */
+} dukky_spare;
 
+static void dukky_destroyheap(jsheap *heap);
 
-/* exported interface documented in js.h */
-nserror
-js_newheap(int timeout, jsheap **heap)
+/**
+ * Create a new heap with the binding prototypes
+ *
+ * \param heap Updated with the new heap
+ * \return NSERROR_OK on success else appropriate error code
+ */
+static nserror dukky_create_heap(jsheap **heap)
 {
 	duk_context *ctx;
-	jsheap *ret = calloc(1, sizeof(*ret));
+	uint64_t start, end;
+	jsheap *ret;
+
+	(void) nsu_getmonotonic_ms(&start);
+
+	ret = calloc(1, sizeof(*ret));
 	*heap = NULL;
 	NSLOG(dukky, DEBUG, "Creating new duktape javascript heap");
 	if (ret == NULL) return NSERROR_NOMEM;
+	ret->limit = nsoption_uint(script_heap_limit);
 	ctx = ret->ctx = duk_create_heap(
 		dukky_alloc_function,
 		dukky_realloc_function,
@@ -620,17 +1210,119 @@ js_newheap(int timeout, jsheap **heap)
 	duk_push_object(ctx);
 	duk_put_global_string(ctx, THREAD_MAP);
 
+	(void) nsu_getmonotonic_ms(&end);
+	dukky_spare.built++;
+	dukky_spare.build_ms += end - start;
+	NSLOG(dukky, DEBUG, "Heap %p created in %"PRIu64"ms with %"PRIsizet" bytes",
+	      ret, end - start, ret->stats.live);
+
 	*heap = ret;
 	return NSERROR_OK;
 }
 
+/**
+ * Scheduled callback to build a spare heap
+ *
+ * \param p unused
+ */
+static void dukky_spare_build(void *p)
+{
+	if (dukky_spare.heap == NULL) {
+		/* failure is harmless, the next js_newheap builds one */
+		(void) dukky_create_heap(&dukky_spare.heap);
+	}
+}
+
+/* exported interface documented in js.h */
+void js_finalise(void)
+{
+	guit->misc->schedule(-1, dukky_spare_build, NULL);
+	if (dukky_spare.heap != NULL) {
+		dukky_spare.heap->pending_destroy = true;
+		dukky_destroyheap(dukky_spare.heap);
+		dukky_spare.heap = NULL;
+	}
+
+	if (dukky_spare.built > 0) {
+		NSLOG(dukky, INFO,
+		      "Created %u heaps averaging %"PRIu64"ms, %u from spares",
+		      dukky_spare.built,
+		      dukky_spare.build_ms / dukky_spare.built,
+		      dukky_spare.used);
+	}
+
+	NSLOG(dukky, INFO,
+	      "Compiled script cache hit/miss %u/%u, %"PRIsizet" bytes",
+	      dukky_script_cache.hits,
+	      dukky_script_cache.misses,
+	      dukky_script_cache.size);
+
+	dukky_script_cache_trim(0);
+
+	free(dukky_polyfill.bytecode);
+	dukky_polyfill.bytecode = NULL;
+	free(dukky_generics.bytecode);
+	dukky_generics.bytecode = NULL;
+}
+
+
+/* exported interface documented in js.h */
+nserror
+js_newheap(int timeout, jsheap **heap)
+{
+	nserror res;
+
+	if (dukky_spare.heap != NULL) {
+		*heap = dukky_spare.heap;
+		dukky_spare.heap = NULL;
+		dukky_spare.used++;
+		/* the option may have changed since it was built */
+		(*heap)->limit = nsoption_uint(script_heap_limit);
+		NSLOG(dukky, DEBUG, "Using spare duktape javascript heap %p",
+		      *heap);
+		res = NSERROR_OK;
+	} else {
+		res = dukky_create_heap(heap);
+	}
+
+	/* Every window and frame has a heap so only keep a spare
+	 * ready when scripts will actually use it.
+	 */
+	if (res == NSERROR_OK && nsoption_bool(enable_javascript)) {
+		guit->misc->schedule(SPARE_HEAP_DELAY_MS,
+				     dukky_spare_build,
+				     NULL);
+	}
+
+	return res;
+}
+
 
 static void dukky_destroyheap(jsheap *heap)
 {
+	struct dukky_pool_chunk *chunk;
+
 	assert(heap->pending_destroy == true);
 	assert(heap->live_threads == 0);
 	NSLOG(dukky, DEBUG, "Destroying duktape javascript context");
 	duk_destroy_heap(heap->ctx);
+
+	NSLOG(dukky, DEBUG,
+	      "Heap %p peak %"PRIsizet" pooled %"PRIsizet" allocations %u large %u refused %u",
+	      heap,
+	      heap->stats.peak,
+	      heap->stats.pooled,
+	      heap->stats.allocs,
+	      heap->stats.large,
+	      heap->stats.refused);
+
+	/* Everything pooled goes at once */
+	while (heap->chunks != NULL) {
+		chunk = heap->chunks;
+		heap->chunks = chunk->next;
+		free(chunk);
+	}
+
 	free(heap);
 }
 
@@ -697,10 +1389,7 @@ nserror js_newthread(jsheap *heap, void *win_priv, void *doc_priv, jsthread **th
 
 	/* Now load the polyfills */
 	/* ... */
-	duk_push_string(CTX, "polyfill.js");
-	/* ..., polyfill.js */
-	if (duk_pcompile_lstring_filename(CTX, DUK_COMPILE_EVAL,
-					  (const char *)polyfill_js, polyfill_js_len) != 0) {
+	if (dukky_push_builtin(CTX, &dukky_polyfill) != 0) {
 		NSLOG(dukky, CRITICAL, "%s", duk_safe_to_string(CTX, -1));
 		NSLOG(dukky, CRITICAL, "Unable to compile polyfill.js, thread aborted");
 		js_destroythread(ret);
@@ -718,10 +1407,7 @@ nserror js_newthread(jsheap *heap, void *win_priv, void *doc_priv, jsthread **th
 
 	/* Now load the NetSurf table in */
 	/* ... */
-	duk_push_string(CTX, "generics.js");
-	/* ..., generics.js */
-	if (duk_pcompile_lstring_filename(CTX, DUK_COMPILE_EVAL,
-					  (const char *)generics_js, generics_js_len) != 0) {
+	if (dukky_push_builtin(CTX, &dukky_generics) != 0) {
 		NSLOG(dukky, CRITICAL, "%s", duk_safe_to_string(CTX, -1));
 		NSLOG(dukky, CRITICAL, "Unable to compile generics.js, thread aborted");
 		js_destroythread(ret);
@@ -845,6 +1531,16 @@ duk_bool_t dukky_check_timeout(void *udata)
 
 	(void) nsu_getmonotonic_ms(&now);
 
+	/* A script which has run the heap into its memory limit is
+	 * stopped the same way as one which has run for too long.
+	 */
+	if (heap->over_limit) {
+		NSLOG(dukky, WARNING,
+		      "Heap %p exceeded limit of %"PRIsizet" bytes, stopping script",
+		      heap, heap->limit);
+		return true;
+	}
+
 	/* This function may be called during duk heap construction,
 	 * so only test for execution timeout if we've recorded a
 	 * start time.
@@ -871,6 +1567,37 @@ static void dukky_reset_start_time(duk_context *ctx)
 	duk_get_memory_functions(ctx, &funcs);
 	heap = funcs.udata;
 	(void) nsu_getmonotonic_ms(&heap->exec_start_time);
+	heap->over_limit = false;
+}
+
+/**
+ * Run a protected call with the heap limit enforced
+ *
+ * \param ctx The duktape context
+ * \param argc The number of arguments on the stack
+ * \param method true to call as a method, with the this binding
+ *                below the arguments
+ * \return the result of the protected call
+ */
+static duk_int_t
+dukky_limited_pcall(duk_context *ctx, duk_idx_t argc, bool method)
+{
+	duk_memory_functions funcs;
+	jsheap *heap;
+	duk_int_t ret;
+
+	duk_get_memory_functions(ctx, &funcs);
+	heap = funcs.udata;
+
+	heap->protected_calls++;
+	if (method) {
+		ret = duk_pcall_method(ctx, argc);
+	} else {
+		ret = duk_pcall(ctx, argc);
+	}
+	heap->protected_calls--;
+
+	return ret;
 }
 
 duk_int_t dukky_pcall(duk_context *ctx, duk_size_t argc, bool reset_timeout)
@@ -879,7 +1606,7 @@ duk_int_t dukky_pcall(duk_context *ctx, duk_size_t argc, bool reset_timeout)
 		dukky_reset_start_time(ctx);
 	}
 
-	duk_int_t ret = duk_pcall(ctx, argc);
+	duk_int_t ret = dukky_limited_pcall(ctx, argc, false);
 	if (ret) {
 		/* Something went wrong calling this... */
 		dukky_dump_error(ctx);
@@ -940,20 +1667,15 @@ js_exec(jsthread *thread, const uint8_t *txt, size_t txtlen, const char *name)
 	/* NSLOG(dukky, DEEPDEBUG, "\n%s\n", txt); */
 
 	dukky_reset_start_time(CTX);
-	if (name != NULL) {
-		duk_push_string(CTX, name);
-	} else {
-		duk_push_string(CTX, "?unknown source?");
+	if (name == NULL) {
+		name = "?unknown source?";
 	}
-	if (duk_pcompile_lstring_filename(CTX,
-					  DUK_COMPILE_EVAL,
-					  (const char *)txt,
-					  txtlen) != 0) {
+	if (dukky_push_script(CTX, name, txt, txtlen) != 0) {
 		NSLOG(dukky, DEBUG, "Failed to compile JavaScript input");
 		goto handle_error;
 	}
 
-	if (duk_pcall(CTX, 0/*nargs*/) == DUK_EXEC_ERROR) {
+	if (dukky_limited_pcall(CTX, 0/*nargs*/, false) == DUK_EXEC_ERROR) {
 		NSLOG(dukky, DEBUG, "Failed to execute JavaScript");
 		goto handle_error;
 	}
@@ -1198,7 +1920,7 @@ static void dukky_generic_event_handler(dom_event *evt, void *pw)
 	dukky_push_event(ctx, evt);
 	/* ... handler node event */
 	dukky_reset_start_time(ctx);
-	if (duk_pcall_method(ctx, 1) != 0) {
+	if (dukky_limited_pcall(ctx, 1, true) != 0) {
 		/* Failed to run the method */
 		/* ... err */
 		NSLOG(dukky, DEBUG,
@@ -1297,7 +2019,7 @@ handle_extras:
 		dukky_push_event(ctx, evt);
 		/* ... copy handler callback node event */
 		dukky_reset_start_time(ctx);
-		if (duk_pcall_method(ctx, 1) != 0) {
+		if (dukky_limited_pcall(ctx, 1, true) != 0) {
 			/* Failed to run the method */
 			/* ... copy handler err */
 			NSLOG(dukky, DEBUG,
@@ -1646,7 +2368,7 @@ bool js_fire_event(jsthread *thread, const char *type, struct dom_document *doc,
 	dukky_push_event(CTX, evt);
 	/* ... handler Window event */
 	dukky_reset_start_time(CTX);
-	if (duk_pcall_method(CTX, 1) != 0) {
+	if (dukky_limited_pcall(CTX, 1, true) != 0) {
 		/* Failed to run the handler */
 		/* ... err */
 		NSLOG(dukky, DEBUG,
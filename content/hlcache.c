@@ -30,6 +30,8 @@
 #include "utils/messages.h"
 #include "utils/ring.h"
 #include "utils/utils.h"
+#include "utils/nsurl.h"
+#include "utils/hashmap.h"
 #include "netsurf/misc.h"
 #include "netsurf/content.h"
 #include "desktop/gui_internal.h"
@@ -75,8 +77,20 @@ struct hlcache_entry {
 
 	hlcache_entry *next;		/**< Next sibling */
 	hlcache_entry *prev;		/**< Previous sibling */
+
+	nsurl *url;			/**< Index key, or NULL if unindexed */
+	hlcache_entry *url_next;	/**< Next entry with the same URL */
+
+	bool idle;			/**< Entry is on the idle list */
+	hlcache_entry *idle_next;	/**< Next newer idle entry */
+	hlcache_entry *idle_prev;	/**< Previous older idle entry */
 };
 
+/** Entry in the URL index of cached contents */
+typedef struct hlcache_url_entries {
+	hlcache_entry *entries;		/**< Entries for the URL */
+} hlcache_url_entries;
+
 /** Current state of the cache.
  *
  * Global state of the cache.
@@ -87,6 +101,21 @@ struct hlcache_s {
 	/** List of cached content objects */
 	hlcache_entry *content_list;
 
+	/**
+	 * Cached contents by low-level object URL.
+	 *
+	 * Contents can only share a low-level object if they share
+	 * its URL, so this narrows the search for a reusable content
+	 * to a handful of entries.
+	 */
+	hashmap_t *content_index;
+
+	/** Oldest entry with no users, the first candidate for cleaning */
+	hlcache_entry *idle_head;
+
+	/** Entry which most recently lost its last user */
+	hlcache_entry *idle_tail;
+
 	/** Ring of retrieval contexts */
 	hlcache_retrieval_ctx *retrieval_ctx_ring;
 
@@ -104,22 +133,189 @@ static struct hlcache_s *hlcache = NULL;
  ******************************************************************************/
 
 
+/* content index hashmap callbacks */
+static void *hlcache_index_key_clone(void *key)
+{
+	return nsurl_ref((nsurl *)key);
+}
+
+static void hlcache_index_key_destroy(void *key)
+{
+	nsurl_unref((nsurl *)key);
+}
+
+static uint32_t hlcache_index_key_hash(void *key)
+{
+	return nsurl_hash((nsurl *)key);
+}
+
+static bool hlcache_index_key_eq(void *key1, void *key2)
+{
+	return nsurl_compare((nsurl *)key1, (nsurl *)key2, NSURL_COMPLETE);
+}
+
+static void *hlcache_index_value_alloc(void *key)
+{
+	return calloc(1, sizeof(hlcache_url_entries));
+}
+
+static void hlcache_index_value_destroy(void *value)
+{
+	free(value);
+}
+
+static hashmap_parameters_t hlcache_index_params = {
+	.key_clone = hlcache_index_key_clone,
+	.key_hash = hlcache_index_key_hash,
+	.key_eq = hlcache_index_key_eq,
+	.key_destroy = hlcache_index_key_destroy,
+	.value_alloc = hlcache_index_value_alloc,
+	.value_destroy = hlcache_index_value_destroy,
+};
+
+/**
+ * Add an entry to the idle list as its newest member
+ *
+ * \param entry  Entry whose content has no users
+ */
+static void hlcache_entry_idle(hlcache_entry *entry)
+{
+	if (entry->idle)
+		return;
+
+	entry->idle_next = NULL;
+	entry->idle_prev = hlcache->idle_tail;
+	if (hlcache->idle_tail != NULL)
+		hlcache->idle_tail->idle_next = entry;
+	else
+		hlcache->idle_head = entry;
+	hlcache->idle_tail = entry;
+
+	entry->idle = true;
+}
+
+/**
+ * Remove an entry from the idle list
+ *
+ * \param entry  Entry which has gained a user or is being destroyed
+ */
+static void hlcache_entry_busy(hlcache_entry *entry)
+{
+	if (entry->idle == false)
+		return;
+
+	if (entry->idle_prev != NULL)
+		entry->idle_prev->idle_next = entry->idle_next;
+	else
+		hlcache->idle_head = entry->idle_next;
+
+	if (entry->idle_next != NULL)
+		entry->idle_next->idle_prev = entry->idle_prev;
+	else
+		hlcache->idle_tail = entry->idle_prev;
+
+	entry->idle_next = NULL;
+	entry->idle_prev = NULL;
+	entry->idle = false;
+}
+
+/**
+ * Insert a new entry into the cache
+ *
+ * The entry is indexed by the URL of its content's low-level object.
+ * Should that fail the entry is still cached but will not be offered
+ * for sharing.
+ *
+ * \param entry  Entry to insert, its content must be set
+ */
+static void hlcache_entry_insert(hlcache_entry *entry)
+{
+	hlcache_url_entries *index_entry;
+	nsurl *url;
+
+	entry->prev = NULL;
+	entry->next = hlcache->content_list;
+	if (hlcache->content_list != NULL)
+		hlcache->content_list->prev = entry;
+	hlcache->content_list = entry;
+
+	entry->url = NULL;
+	entry->url_next = NULL;
+	entry->idle = false;
+	entry->idle_next = NULL;
+	entry->idle_prev = NULL;
+
+	url = content_get_url(entry->content);
+	if (url == NULL)
+		return;
+
+	index_entry = hashmap_lookup(hlcache->content_index, url);
+	if (index_entry == NULL)
+		index_entry = hashmap_insert(hlcache->content_index, url);
+	if (index_entry == NULL)
+		return;
+
+	entry->url = nsurl_ref(url);
+	entry->url_next = index_entry->entries;
+	index_entry->entries = entry;
+}
+
+/**
+ * Remove an entry from the cache
+ *
+ * \param entry  Entry to remove, the caller destroys it
+ */
+static void hlcache_entry_remove(hlcache_entry *entry)
+{
+	if (entry->url != NULL) {
+		hlcache_url_entries *index_entry;
+		hlcache_entry **link;
+
+		index_entry = hashmap_lookup(hlcache->content_index,
+					     entry->url);
+		assert(index_entry != NULL);
+
+		for (link = &index_entry->entries; *link != entry;
+				link = &(*link)->url_next)
+			assert(*link != NULL);
+		*link = entry->url_next;
+
+		if (index_entry->entries == NULL)
+			hashmap_remove(hlcache->content_index, entry->url);
+
+		nsurl_unref(entry->url);
+		entry->url = NULL;
+	}
+
+	hlcache_entry_busy(entry);
+
+	if (entry->prev == NULL)
+		hlcache->content_list = entry->next;
+	else
+		entry->prev->next = entry->next;
+
+	if (entry->next != NULL)
+		entry->next->prev = entry->prev;
+}
+
 /**
  * Attempt to clean the cache
+ *
+ * Only entries on the idle list, oldest first, are considered as any
+ * other entry has users.
  */
 static void hlcache_clean(void *force_clean_flag)
 {
 	hlcache_entry *entry, *next;
 	bool force_clean = (force_clean_flag != NULL);
 
-	for (entry = hlcache->content_list; entry != NULL; entry = next) {
-		next = entry->next;
+	for (entry = hlcache->idle_head; entry != NULL; entry = next) {
+		next = entry->idle_next;
 
 		if (entry->content == NULL)
 			continue;
 
-		if (content_count_users(entry->content) != 0)
-			continue;
+		assert(content_count_users(entry->content) == 0);
 
 		if (content__get_status(entry->content) == CONTENT_STATUS_LOADING) {
 			if (force_clean == false)
@@ -137,13 +333,7 @@ static void hlcache_clean(void *force_clean_flag)
 		 */
 
 		/* Remove entry from cache */
-		if (entry->prev == NULL)
-			hlcache->content_list = entry->next;
-		else
-			entry->prev->next = entry->next;
-
-		if (entry->next != NULL)
-			entry->next->prev = entry->prev;
+		hlcache_entry_remove(entry);
 
 		/* Destroy content */
 		content_destroy(entry->content);
@@ -225,11 +415,19 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 		lwc_string *effective_type)
 {
 	hlcache_entry *entry;
+	hlcache_url_entries *index_entry;
 	hlcache_event event;
+	nsurl *url;
 	nserror error = NSERROR_OK;
 
-	/* Search list of cached contents for a suitable one */
-	for (entry = hlcache->content_list; entry != NULL; entry = entry->next) {
+	/* Search cached contents with the same URL for a suitable one */
+	url = llcache_handle_get_url(ctx->llcache);
+	index_entry = NULL;
+	if (url != NULL)
+		index_entry = hashmap_lookup(hlcache->content_index, url);
+	for (entry = (index_entry != NULL) ? index_entry->entries : NULL;
+	     entry != NULL;
+	     entry = entry->url_next) {
 		hlcache_handle entry_handle = { entry, NULL, NULL };
 		const llcache_handle *entry_llcache;
 
@@ -274,11 +472,7 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 		}
 
 		/* Insert into cache */
-		entry->prev = NULL;
-		entry->next = hlcache->content_list;
-		if (hlcache->content_list != NULL)
-			hlcache->content_list->prev = entry;
-		hlcache->content_list = entry;
+		hlcache_entry_insert(entry);
 
 		/* Signal to caller that we created a content */
 		error = NSERROR_NEED_DATA;
@@ -292,8 +486,13 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 
 	/* Associate handle with content */
 	if (content_add_user(entry->content,
-			hlcache_content_callback, ctx->handle) == false)
+			hlcache_content_callback, ctx->handle) == false) {
+		/* Leave an unused content for the cleaner */
+		if (content_count_users(entry->content) == 0)
+			hlcache_entry_idle(entry);
 		return NSERROR_NOMEM;
+	}
+	hlcache_entry_busy(entry);
 
 	/* Associate cache entry with handle */
 	ctx->handle->entry = entry;
@@ -557,8 +756,16 @@ hlcache_initialise(const struct hlcache_parameters *hlcache_parameters)
 		return NSERROR_NOMEM;
 	}
 
+	hlcache->content_index = hashmap_create(&hlcache_index_params);
+	if (hlcache->content_index == NULL) {
+		free(hlcache);
+		hlcache = NULL;
+		return NSERROR_NOMEM;
+	}
+
 	ret = llcache_initialise(&hlcache_parameters->llcache);
 	if (ret != NSERROR_OK) {
+		hashmap_destroy(hlcache->content_index);
 		free(hlcache);
 		hlcache = NULL;
 		return ret;
@@ -665,6 +872,8 @@ void hlcache_finalise(void)
 	/* De-schedule ourselves */
 	guit->misc->schedule(-1, hlcache_clean, NULL);
 
+	hashmap_destroy(hlcache->content_index);
+
 	free(hlcache);
 	hlcache = NULL;
 
@@ -740,6 +949,8 @@ nserror hlcache_handle_release(hlcache_handle *handle)
 	if (handle->entry != NULL) {
 		content_remove_user(handle->entry->content,
 				hlcache_content_callback, handle);
+		if (content_count_users(handle->entry->content) == 0)
+			hlcache_entry_idle(handle->entry);
 	} else {
 		RING_ITERATE_START(struct hlcache_retrieval_ctx,
 				   hlcache->retrieval_ctx_ring,
@@ -842,11 +1053,7 @@ nserror hlcache_handle_abort(hlcache_handle *handle)
 
 		entry->content = clone;
 		handle->entry = entry;
-		entry->prev = NULL;
-		entry->next = hlcache->content_list;
-		if (hlcache->content_list != NULL)
-			hlcache->content_list->prev = entry;
-		hlcache->content_list = entry;
+		hlcache_entry_insert(entry);
 
 		c = clone;
 	}
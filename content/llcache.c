@@ -46,6 +46,7 @@
 #include "utils/nsurl.h"
 #include "utils/utils.h"
 #include "utils/time.h"
+#include "utils/hashmap.h"
 #include "utils/http.h"
 #include "utils/nsoption.h"
 #include "netsurf/misc.h"
@@ -164,12 +165,16 @@ typedef enum {
 /**
  * Low-level cache object
  *
- * \todo Consider whether a list is a sane container.
+ * Cached objects are also indexed by URL in llcache_s::cached_index.
  */
 struct llcache_object {
 	llcache_object *prev;	     /**< Previous in list */
 	llcache_object *next;	     /**< Next in list */
 
+	llcache_object *url_next;    /**< Next cached object with same URL */
+	bool cached;		     /**< Object is on the cached list */
+	bool indexed;		     /**< Object is in the URL index */
+
 	nsurl *url;		     /**< Post-redirect URL for object */
 
 	/** \todo We need a generic dynamic buffer object */
@@ -208,9 +213,19 @@ struct llcache_object {
  * Core llcache control context.
  */
 struct llcache_s {
-	/** Head of the low-level cached object list */
+	/**
+	 * Head of the low-level cached object list.
+	 *
+	 * The list is kept in order of use, most recently used first.
+	 */
 	llcache_object *cached_objects;
 
+	/** Tail of the low-level cached object list, least recently used */
+	llcache_object *cached_tail;
+
+	/** Cached objects by URL, each entry a chain of llcache_url_objects */
+	hashmap_t *cached_index;
+
 	/** Head of the low-level uncached object list */
 	llcache_object *uncached_objects;
 
@@ -239,9 +254,8 @@ struct llcache_s {
 	unsigned long time_quantum;
 
 	/**
-	 * The minimum bandwidth to allow the backing store to use in
-	 * bytes/second. Below this the backing store will be
-	 * disabled.
+	 * The minimum bandwidth to expect the backing store to use in
+	 * bytes/second. Below this a warning is logged.
 	 */
 	size_t minimum_bandwidth;
 
@@ -263,6 +277,13 @@ struct llcache_s {
 
 };
 
+/**
+ * Entry in the URL index of cached objects
+ */
+typedef struct llcache_url_objects {
+	llcache_object *objects; /**< Cached objects with the URL */
+} llcache_url_objects;
+
 /** low level cache state */
 static struct llcache_s *llcache = NULL;
 
@@ -277,6 +298,70 @@ static void llcache_users_not_caught_up(void);
  * Low-level cache internals						      *
  ******************************************************************************/
 
+/* cached object index hashmap callbacks */
+static void *llcache_index_key_clone(void *key)
+{
+	return nsurl_ref((nsurl *)key);
+}
+
+static void llcache_index_key_destroy(void *key)
+{
+	nsurl_unref((nsurl *)key);
+}
+
+static uint32_t llcache_index_key_hash(void *key)
+{
+	return nsurl_hash((nsurl *)key);
+}
+
+static bool llcache_index_key_eq(void *key1, void *key2)
+{
+	return nsurl_compare((nsurl *)key1, (nsurl *)key2, NSURL_COMPLETE);
+}
+
+static void *llcache_index_value_alloc(void *key)
+{
+	return calloc(1, sizeof(llcache_url_objects));
+}
+
+static void llcache_index_value_destroy(void *value)
+{
+	free(value);
+}
+
+static hashmap_parameters_t llcache_index_params = {
+	.key_clone = llcache_index_key_clone,
+	.key_hash = llcache_index_key_hash,
+	.key_eq = llcache_index_key_eq,
+	.key_destroy = llcache_index_key_destroy,
+	.value_alloc = llcache_index_value_alloc,
+	.value_destroy = llcache_index_value_destroy,
+};
+
+/**
+ * Mark a cached object as the most recently used.
+ *
+ * \param object  Object to move to the head of the cached list
+ */
+static void llcache_object_touch(llcache_object *object)
+{
+	if (!object->cached || object == llcache->cached_objects)
+		return;
+
+	/* Unlink; object is not the head so has a predecessor */
+	object->prev->next = object->next;
+	if (object->next != NULL)
+		object->next->prev = object->prev;
+	else
+		llcache->cached_tail = object->prev;
+
+	/* Relink at head */
+	object->prev = NULL;
+	object->next = llcache->cached_objects;
+	llcache->cached_objects->prev = object;
+	llcache->cached_objects = object;
+}
+
 /**
  * Create a new object user.
  *
@@ -367,6 +452,7 @@ static nserror llcache_object_remove_user(llcache_object *object,
 	/* record the time the last user was removed from the object */
 	if (object->users == NULL) {
 		object->last_used = time(NULL);
+		llcache_object_touch(object);
 	}
 
 	NSLOG(llcache, DEBUG, "Removing user %p from %p", user, object);
@@ -1277,6 +1363,73 @@ llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
 	return NSERROR_OK;
 }
 
+/**
+ * Add a low-level cache object to the cached object list and URL index
+ *
+ * The object becomes the most recently used. If the index can't be
+ * extended the object is still cached but can't be found by URL.
+ *
+ * \param object  Object to add
+ * \return NSERROR_OK
+ */
+static nserror llcache_object_add_to_cache(llcache_object *object)
+{
+	llcache_url_objects *entry;
+
+	llcache_object_add_to_list(object, &llcache->cached_objects);
+	if (llcache->cached_tail == NULL)
+		llcache->cached_tail = object;
+	object->cached = true;
+
+	entry = hashmap_lookup(llcache->cached_index, object->url);
+	if (entry == NULL)
+		entry = hashmap_insert(llcache->cached_index, object->url);
+
+	if (entry != NULL) {
+		object->url_next = entry->objects;
+		entry->objects = object;
+		object->indexed = true;
+	}
+
+	return NSERROR_OK;
+}
+
+/**
+ * Remove a low-level cache object from the cached object list and URL index
+ *
+ * \param object  Object to remove
+ * \return NSERROR_OK
+ */
+static nserror llcache_object_remove_from_cache(llcache_object *object)
+{
+	if (object->indexed) {
+		llcache_url_objects *entry;
+		llcache_object **link;
+
+		entry = hashmap_lookup(llcache->cached_index, object->url);
+		assert(entry != NULL);
+
+		for (link = &entry->objects; *link != object;
+				link = &(*link)->url_next)
+			assert(*link != NULL);
+		*link = object->url_next;
+
+		if (entry->objects == NULL)
+			hashmap_remove(llcache->cached_index, object->url);
+
+		object->url_next = NULL;
+		object->indexed = false;
+	}
+
+	if (llcache->cached_tail == object)
+		llcache->cached_tail = object->prev;
+
+	llcache_object_remove_from_list(object, &llcache->cached_objects);
+	object->cached = false;
+
+	return NSERROR_OK;
+}
+
 /**
  * Retrieve source data for an object from persistent store if necessary.
  *
@@ -1921,6 +2074,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 {
 	nserror error;
 	llcache_object *obj, *newest = NULL;
+	llcache_url_objects *entry;
 
 	NSLOG(llcache, DEBUG,
 	      "Searching cache for %s flags:%x referer:%s post:%p",
@@ -1929,12 +2083,12 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	      post);
 
 	/* Search for the most recently fetched matching object */
-	for (obj = llcache->cached_objects; obj != NULL; obj = obj->next) {
-
-		if ((newest == NULL ||
-		     obj->cache.req_time > newest->cache.req_time) &&
-		    nsurl_compare(obj->url, url,
-				  NSURL_COMPLETE) == true) {
+	entry = hashmap_lookup(llcache->cached_index, url);
+	for (obj = (entry != NULL) ? entry->objects : NULL;
+	     obj != NULL;
+	     obj = obj->url_next) {
+		if (newest == NULL ||
+		    obj->cache.req_time > newest->cache.req_time) {
 			newest = obj;
 		}
 	}
@@ -1960,7 +2114,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			newest = obj;
 
 			/* Add new object to cached object list */
-			llcache_object_add_to_list(obj, &llcache->cached_objects);
+			llcache_object_add_to_cache(obj);
 
 		}
 		/* else no object found and irretrievable from cache,
@@ -1993,7 +2147,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 		 */
 		NSLOG(llcache, DEBUG, "Persistent retrieval failed for %p", newest);
 
-		llcache_object_remove_from_list(newest,	&llcache->cached_objects);
+		llcache_object_remove_from_cache(newest);
 		llcache_object_destroy(newest);
 
 		error = llcache_object_new(url, &obj);
@@ -2035,7 +2189,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			}
 
 			/* Add new object to cache */
-			llcache_object_add_to_list(obj, &llcache->cached_objects);
+			llcache_object_add_to_cache(obj);
 
 			*result = obj;
 
@@ -2048,8 +2202,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 		 * failed, destroy cache object and fall though to
 		 * cache miss to re-retch
 		 */
-		llcache_object_remove_from_list(newest,
-						&llcache->cached_objects);
+		llcache_object_remove_from_cache(newest);
 		llcache_object_destroy(newest);
 
 		error = llcache_object_new(url, &obj);
@@ -2067,7 +2220,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	}
 
 	/* Add new object to cache */
-	llcache_object_add_to_list(obj, &llcache->cached_objects);
+	llcache_object_add_to_cache(obj);
 
 	*result = obj;
 
@@ -2820,6 +2973,47 @@ build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 	return NSERROR_OK;
 }
 
+/**
+ * Determine if the source data of an object is likely to compress well.
+ *
+ * Textual media types typically compress to a fraction of their size
+ * whereas most other types are already compressed.
+ *
+ * \param object The object to examine.
+ * \return true if the object has a textual media type else false.
+ */
+static bool llcache_object_compressible(const llcache_object *object)
+{
+	static const char *textual[] = {
+		"text/",
+		"application/javascript",
+		"application/x-javascript",
+		"application/ecmascript",
+		"application/json",
+		"application/xml",
+		"application/xhtml+xml",
+		"image/svg+xml",
+	};
+	size_t hidx;
+	size_t tidx;
+
+	for (hidx = 0; hidx < object->num_headers; hidx++) {
+		if (strcasecmp(object->headers[hidx].name, "Content-Type") != 0) {
+			continue;
+		}
+		for (tidx = 0; tidx < sizeof(textual) / sizeof(textual[0]); tidx++) {
+			if (strncasecmp(object->headers[hidx].value,
+					textual[tidx],
+					strlen(textual[tidx])) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return false;
+}
+
 /**
  * Write an object to the backing store.
  *
@@ -2843,7 +3037,8 @@ write_backing_store(struct llcache_object *object,
 
 	/* put object data in backing store */
 	ret = guit->llcache->store(object->url,
-				   BACKING_STORE_NONE,
+				   llcache_object_compressible(object) ?
+				   BACKING_STORE_COMPRESSIBLE : BACKING_STORE_NONE,
 				   object->source_data,
 				   object->source_len);
 	if (ret != NSERROR_OK) {
@@ -2896,8 +3091,10 @@ write_backing_store(struct llcache_object *object,
 /**
  * Check for overall write performance.
  *
- * If the overall write bandwidth has fallen below a useful level for
- * the backing store to be effective disable it.
+ * Reports if the overall write bandwidth has fallen below a useful
+ * level for the backing store to be effective. The backing store may
+ * perform its writes off the main thread so this is instrumentation
+ * only and the backing store remains in use.
  *
  * It is important to ensure a useful amount of data has been written
  * before calculating bandwidths otherwise tiny files taking a
@@ -2914,11 +3111,10 @@ static void llcache_persist_slowcheck(void *p)
 		total_bandwidth = (llcache->total_written * 1000) / llcache->total_elapsed;
 
 		if (total_bandwidth < llcache->minimum_bandwidth) {
-			NSLOG(llcache, INFO,
+			NSLOG(llcache, WARNING,
 			      "Current bandwidth %"PRIu64" less than minimum %"PRIsizet,
 			      total_bandwidth,
 			      llcache->minimum_bandwidth);
-			guit->llcache->finalise();
 		}
 	}
 }
@@ -3771,8 +3967,7 @@ void llcache_clean(bool purge)
 					"users or pending fetches (%p) %s",
 					object, nsurl_access(object->url));
 
-				llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
+				llcache_object_remove_from_cache(object);
 
 				if (object->store_state == LLCACHE_STATE_DISC) {
 					guit->llcache->invalidate(object->url);
@@ -3798,10 +3993,10 @@ void llcache_clean(bool purge)
 	 * pending fetches and pushed to persistent store while the
 	 * cache exceeds the configured size.
 	 */
-	for (object = llcache->cached_objects;
+	for (object = llcache->cached_tail;
 	     ((limit < llcache_size) && (object != NULL));
 	     object = next) {
-		next = object->next;
+		next = object->prev;
 		if ((object->users == NULL) &&
 		    (object->candidate_count == 0) &&
 		    (object->fetch.fetch == NULL) &&
@@ -3822,10 +4017,10 @@ void llcache_clean(bool purge)
 	 * and pushed to persistent store while the cache exceeds
 	 * the configured size. Effectively just the llcache object metadata.
 	 */
-	for (object = llcache->cached_objects;
+	for (object = llcache->cached_tail;
 	     ((limit < llcache_size) && (object != NULL));
 	     object = next) {
-		next = object->next;
+		next = object->prev;
 		if ((object->users == NULL) &&
 		    (object->candidate_count == 0) &&
 		    (object->fetch.fetch == NULL) &&
@@ -3840,8 +4035,7 @@ void llcache_clean(bool purge)
 
 			llcache_size -=	total_object_size(object);
 
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
+			llcache_object_remove_from_cache(object);
 			llcache_object_destroy(object);
 
 		}
@@ -3852,10 +4046,10 @@ void llcache_clean(bool purge)
 	 * most valuable objects as replacing them is a full network
 	 * fetch
 	 */
-	for (object = llcache->cached_objects;
+	for (object = llcache->cached_tail;
 	     ((limit < llcache_size) && (object != NULL));
 	     object = next) {
-		next = object->next;
+		next = object->prev;
 
 		if ((object->users == NULL) &&
 		    (object->candidate_count == 0) &&
@@ -3870,8 +4064,7 @@ void llcache_clean(bool purge)
 
 			llcache_size -=	object->source_len + sizeof(*object);
 
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
+			llcache_object_remove_from_cache(object);
 			llcache_object_destroy(object);
 		}
 	}
@@ -3888,6 +4081,13 @@ llcache_initialise(const struct llcache_parameters *prm)
 		return NSERROR_NOMEM;
 	}
 
+	llcache->cached_index = hashmap_create(&llcache_index_params);
+	if (llcache->cached_index == NULL) {
+		free(llcache);
+		llcache = NULL;
+		return NSERROR_NOMEM;
+	}
+
 	llcache->limit = prm->limit;
 	llcache->minimum_lifetime = prm->minimum_lifetime;
 	llcache->minimum_bandwidth = prm->minimum_bandwidth;
@@ -3972,6 +4172,9 @@ void llcache_finalise(void)
 	      llcache->total_elapsed,
 	      total_bandwidth);
 
+	/* The cached objects are gone; drop the index entries naming them */
+	hashmap_destroy(llcache->cached_index);
+
 	free(llcache);
 	llcache = NULL;
 }
@@ -4160,9 +4363,8 @@ nserror llcache_handle_force_stream(llcache_handle *handle)
 		return NSERROR_OK;
 
 	/* Forcibly uncache this object */
-	if (llcache_object_in_list(object, llcache->cached_objects)) {
-		llcache_object_remove_from_list(object,
-				&llcache->cached_objects);
+	if (object->cached) {
+		llcache_object_remove_from_cache(object);
 		llcache_object_add_to_list(object, &llcache->uncached_objects);
 	}
 
@@ -121,6 +121,8 @@ struct llcache_store_parameters {
 
 	size_t limit; /**< The backing store upper bound target size */
 	size_t hysteresis; /**< The hysteresis around the target size */
+
+	bool dedup; /**< Share identical object data between entries */
 };
 
 /**
@@ -133,8 +135,8 @@ struct llcache_parameters {
 	/** The minimum lifetime to consider sending objects to backing store.*/
 	int minimum_lifetime;
 
-	/** The minimum bandwidth to allow the backing store to
-	 * use in bytes/second
+	/** The minimum bandwidth expected of the backing store in
+	 * bytes/second, a lower bandwidth is reported.
 	 */
 	size_t minimum_bandwidth;
 
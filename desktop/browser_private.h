@@ -25,9 +25,16 @@
 #ifndef NETSURF_DESKTOP_BROWSER_PRIVATE_H_
 #define NETSURF_DESKTOP_BROWSER_PRIVATE_H_
 
+#include "netsurf/types.h"
 #include "content/fetch.h"
 #include "desktop/frame_types.h"
 
+/**
+ * Number of separate damaged areas kept for a window before areas are
+ * merged regardless of how much undamaged area that adds.
+ */
+#define BROWSER_WINDOW_DAMAGE_MAX 8
+
 struct box;
 struct hlcache_handle;
 struct gui_window;
@@ -272,6 +279,14 @@ struct browser_window {
 		int match; /**< Number of times an idempotent status-set operation was performed. */
 		int miss; /**< Number of times status was really updated. */
 	} status;
+
+	/** redraw damage not yet passed to the front end window. */
+	struct {
+		struct rect rect[BROWSER_WINDOW_DAMAGE_MAX]; /**< Damaged areas in window coordinates. */
+		unsigned int count; /**< Number of entries in rect. */
+		unsigned int requested; /**< Number of rectangles invalidated by the core. */
+		unsigned int sent; /**< Number of rectangles passed to the front end. */
+	} damage;
 };
 
 
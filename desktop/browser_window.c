@@ -26,6 +26,7 @@
 
 #include "utils/config.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -36,6 +37,7 @@
 #include "utils/corestrings.h"
 #include "utils/messages.h"
 #include "utils/nsoption.h"
+#include "utils/utils.h"
 #include "netsurf/types.h"
 #include "netsurf/browser_window.h"
 #include "netsurf/window.h"
@@ -762,6 +764,8 @@ static void browser_window_update(struct browser_window *bw, bool scroll_to_top)
 			}
 		}
 
+		/* Whole window redraw covers any pending damage */
+		bw->damage.count = 0;
 		guit->window->invalidate(bw->window, NULL);
 
 		break;
@@ -1807,6 +1811,138 @@ browser_window_callback(hlcache_handle *c, const hlcache_event *event, void *pw)
 }
 
 
+/**
+ * Area of a rectangle.
+ *
+ * \param rect The rectangle
+ * \return the area in square pixels
+ */
+static inline int64_t browser_window_rect_area(const struct rect *rect)
+{
+	return (int64_t)(rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+}
+
+
+/**
+ * Smallest rectangle containing two rectangles.
+ *
+ * \param a The first rectangle
+ * \param b The second rectangle
+ * \param u Updated to the union of a and b
+ */
+static inline void
+browser_window_rect_union(const struct rect *a,
+			  const struct rect *b,
+			  struct rect *u)
+{
+	u->x0 = min(a->x0, b->x0);
+	u->y0 = min(a->y0, b->y0);
+	u->x1 = max(a->x1, b->x1);
+	u->y1 = max(a->y1, b->y1);
+}
+
+
+/**
+ * Pass the damage collected for a window to the front end.
+ *
+ * Scheduled on the first invalidation after the previous flush, so all
+ * the invalidations made during one pass of the scheduler are sent
+ * together.
+ *
+ * \param p The root browser window.
+ */
+static void browser_window_damage_flush(void *p)
+{
+	struct browser_window *bw = p;
+	unsigned int idx;
+	unsigned int count = bw->damage.count;
+
+	/* The front end may redraw, and so invalidate, synchronously */
+	bw->damage.count = 0;
+
+	for (idx = 0; idx < count; idx++) {
+		struct rect rect = bw->damage.rect[idx];
+
+		guit->window->invalidate(bw->window, &rect);
+		bw->damage.sent++;
+	}
+}
+
+
+/**
+ * Add an area to the damage collected for a window.
+ *
+ * Areas are merged with an existing area when the union is no larger
+ * than the two areas together, so overlapping and adjacent areas
+ * collapse. Once the damage list is full, the new area is merged into
+ * the entry whose area grows least.
+ *
+ * \param bw The root browser window.
+ * \param rect The damaged area in window coordinates.
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+browser_window_damage_add(struct browser_window *bw, const struct rect *rect)
+{
+	struct rect add = *rect;
+	unsigned int best = 0;
+	int64_t best_growth = INT64_MAX;
+	unsigned int idx;
+
+	bw->damage.requested++;
+
+	if (add.x1 <= add.x0 || add.y1 <= add.y0) {
+		return NSERROR_OK;
+	}
+
+	idx = 0;
+	while (idx < bw->damage.count) {
+		struct rect *d = &bw->damage.rect[idx];
+		struct rect u;
+
+		browser_window_rect_union(d, &add, &u);
+		if (browser_window_rect_area(&u) <=
+		    browser_window_rect_area(d) +
+		    browser_window_rect_area(&add)) {
+			/* Take the entry out and add the union instead,
+			 * as the union may now touch other entries */
+			add = u;
+			*d = bw->damage.rect[--bw->damage.count];
+			idx = 0;
+			continue;
+		}
+		idx++;
+	}
+
+	if (bw->damage.count == BROWSER_WINDOW_DAMAGE_MAX) {
+		for (idx = 0; idx < bw->damage.count; idx++) {
+			struct rect *d = &bw->damage.rect[idx];
+			struct rect u;
+			int64_t growth;
+
+			browser_window_rect_union(d, &add, &u);
+			growth = browser_window_rect_area(&u) -
+				browser_window_rect_area(d);
+			if (growth < best_growth) {
+				best_growth = growth;
+				best = idx;
+			}
+		}
+		/* Removing the entry leaves room for the union */
+		browser_window_rect_union(&bw->damage.rect[best], &add, &add);
+		bw->damage.rect[best] = bw->damage.rect[--bw->damage.count];
+	}
+
+	bw->damage.rect[bw->damage.count++] = add;
+
+	if (bw->damage.count == 1) {
+		return guit->misc->schedule(0, browser_window_damage_flush, bw);
+	}
+
+	return NSERROR_OK;
+}
+
+
 /**
  * internal scheduled reformat callback.
  *
@@ -1849,6 +1985,7 @@ nserror browser_window_destroy_internal(struct browser_window *bw)
 	NSLOG(netsurf, INFO,
 	      "Clearing reformat schedule for browser window %p", bw);
 	guit->misc->schedule(-1, scheduled_reformat, bw);
+	guit->misc->schedule(-1, browser_window_damage_flush, bw);
 
 	/* If this brower window is not the root window, and has focus, unset
 	 * the root browser window's focus pointer. */
@@ -1922,6 +2059,8 @@ nserror browser_window_destroy_internal(struct browser_window *bw)
 	browser_window__free_fetch_parameters(&bw->loading_parameters);
 	NSLOG(netsurf, INFO, "Status text cache match:miss %d:%d",
 	      bw->status.match, bw->status.miss);
+	NSLOG(netsurf, INFO, "Redraw rectangles requested:sent %u:%u",
+	      bw->damage.requested, bw->damage.sent);
 
 	return NSERROR_OK;
 }
@@ -4078,7 +4217,7 @@ browser_window_invalidate_rect(struct browser_window *bw, struct rect *rect)
 	rect->x1 *= top->scale;
 	rect->y1 *= top->scale;
 
-	return guit->window->invalidate(top->window, rect);
+	return browser_window_damage_add(top, rect);
 }
 
 
@@ -4609,6 +4748,7 @@ browser_window_console_log(struct browser_window *bw,
 	      ((src == BW_CS_INPUT) ? "user input" :
 	       (src == BW_CS_SCRIPT_ERROR) ? "script error" :
 	       (src == BW_CS_SCRIPT_CONSOLE) ? "script console" :
+	       (src == BW_CS_LAYOUT) ? "layout" :
 	       "unknown input location"));
 
 	switch (log_level) {
@@ -169,6 +169,9 @@ nserror netsurf_init(const char *store_path)
 	/* set backing store hysterissi to 20% */
 	hlcache_parameters.llcache.store.hysteresis = hlcache_parameters.llcache.store.limit / 5;
 
+	/* share identical object data in the backing store */
+	hlcache_parameters.llcache.store.dedup = nsoption_bool(disc_cache_dedup);
+
 	/* set the path to the backing store */
 	hlcache_parameters.llcache.store.path =
 		nsoption_charp(disc_cache_path) ?
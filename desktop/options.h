@@ -101,6 +101,9 @@ NSOPTION_UINT(disc_cache_size, 1024 * 1024 * 1024)
 /** Preferred expiry age of disc cache / days. */
 NSOPTION_INTEGER(disc_cache_age, 28)
 
+/** Whether identical objects share storage in the disc cache */
+NSOPTION_BOOL(disc_cache_dedup, true)
+
 /** Whether to block advertisements */
 NSOPTION_BOOL(block_advertisements, false)
 
@@ -126,6 +129,9 @@ NSOPTION_BOOL(enable_javascript, false)
 /** Maximum time (in seconds) to wait for a script to run */
 NSOPTION_INTEGER(script_timeout, 10)
 
+/** Maximum memory (in bytes) a document's scripts may use, 0 for no limit */
+NSOPTION_UINT(script_heap_limit, 64 * 1024 * 1024)
+
 /** How many days to retain URL data for */
 NSOPTION_INTEGER(expire_url, 28)
 
@@ -183,6 +189,15 @@ NSOPTION_UINT(min_reflow_period, DEFAULT_REFLOW_PERIOD)
 /* use core selection menu */
 NSOPTION_BOOL(core_select_menu, false)
 
+/* check incremental reflows against a full reflow (slow, for testing) */
+NSOPTION_BOOL(layout_verify, false)
+
+/* redraw HTML from a display list retained after layout */
+NSOPTION_BOOL(redraw_display_list, false)
+
+/* lay out and display HTML documents while their box tree is built */
+NSOPTION_BOOL(progressive_render, false)
+
 /* display decoded international domain names */
 NSOPTION_BOOL(display_decoded_idn, false)
 
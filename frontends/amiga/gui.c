@@ -2376,6 +2376,9 @@ gui_window_console_log(struct gui_window *g,
 	case BW_CS_SCRIPT_CONSOLE:
 		src_text = "scripting-console";
 		break;
+	case BW_CS_LAYOUT:
+		src_text = "layout";
+		break;
 	default:
 		assert(0 && "Unknown scripting source");
 		src_text = "unknown";
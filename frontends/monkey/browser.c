@@ -371,6 +371,9 @@ gui_window_console_log(struct gui_window *g,
 	case BW_CS_SCRIPT_CONSOLE:
 		src_text = "scripting-console";
 		break;
+	case BW_CS_LAYOUT:
+		src_text = "layout";
+		break;
 	default:
 		assert(0 && "Unknown scripting source");
 		src_text = "unknown";
@@ -655,6 +658,35 @@ monkey_window_handle_exec(int argc, char **argv)
 }
 
 
+static void
+monkey_window_handle_resize(int argc, char **argv)
+{
+	/* `WINDOW RESIZE WIN` _%id%_ `WIDTH` _%num%_ `HEIGHT` _%num%_ */
+	/*  0      1      2    3       4       5        6        7      */
+	struct gui_window *gw;
+	if (argc != 8) {
+		moutf(MOUT_ERROR, "WINDOW RESIZE ARGS BAD\n");
+		return;
+	}
+
+	gw = monkey_find_window_by_num(atoi(argv[3]));
+
+	if (gw == NULL) {
+		moutf(MOUT_ERROR, "WINDOW NUM BAD");
+	} else {
+		int width = atoi(argv[5]);
+		int height = atoi(argv[7]);
+		if (width <= 0 || height <= 0) {
+			moutf(MOUT_ERROR, "WINDOW SIZE BAD");
+			return;
+		}
+		gw->width = width;
+		gw->height = height;
+		browser_window_schedule_reformat(gw->bw);
+	}
+}
+
+
 static void
 monkey_window_handle_click(int argc, char **argv)
 {
@@ -719,6 +751,8 @@ monkey_window_handle_command(int argc, char **argv)
 		monkey_window_handle_exec(argc, argv);
 	} else if (strcmp(argv[1], "CLICK") == 0) {
 		monkey_window_handle_click(argc, argv);
+	} else if (strcmp(argv[1], "RESIZE") == 0) {
+		monkey_window_handle_resize(argc, argv);
 	} else {
 		moutf(MOUT_ERROR, "WINDOW COMMAND UNKNOWN %s\n", argv[1]);
 	}
@@ -112,6 +112,7 @@ static struct gui_layout_table layout_table = {
 	.width = nsfont_width,
 	.position = nsfont_position_in_string,
 	.split = nsfont_split,
+	.thread_safe = true,
 };
 
 struct gui_layout_table *monkey_layout_table = &layout_table;
@@ -31,6 +31,7 @@ typedef enum {
 	BW_CS_INPUT, /**< Input from the client */
 	BW_CS_SCRIPT_ERROR, /**< Error from some running script */
 	BW_CS_SCRIPT_CONSOLE, /**< Logging from some running script */
+	BW_CS_LAYOUT, /**< Diagnostics from laying out a document */
 } browser_window_console_source;
 
 /**
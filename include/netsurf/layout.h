@@ -32,6 +32,8 @@
 #ifndef _NETSURF_LAYOUT_H_
 #define _NETSURF_LAYOUT_H_
 
+#include <stdbool.h>
+
 struct plot_font_style;
 
 struct gui_layout_table
@@ -86,6 +88,17 @@ struct gui_layout_table
 	 * Returning char_offset == length means no split possible
 	 */
 	nserror (*split)(const struct plot_font_style *fstyle, const char *string, size_t length, int x, size_t *char_offset, int *actual_x);
+
+
+	/**
+	 * Whether the functions above may be called from threads
+	 * other than the main thread, several at a time.
+	 *
+	 * Core only measures text on other threads when this is set.
+	 * Leave it unset if the functions use toolkit state which is
+	 * only valid on the main thread.
+	 */
+	bool thread_safe;
 };
 
 #endif
@@ -35,6 +35,7 @@
 #include <limits.h>
 
 #include <libwapcaplet/libwapcaplet.h>
+#include <nsutils/time.h>
 
 #include "utils/nsurl.h"
 #include "utils/corestrings.h"
@@ -541,6 +542,146 @@ static TCase *chain_case_create(void)
 	return tc;
 }
 
+/* Lookup scaling test suite */
+
+/** Number of URLs in the scaling test, as in a large low level cache */
+#define SCALE_TEST_COUNT 100000
+
+/**
+ * Most key comparisons allowed per lookup.
+ *
+ * Keys are only compared when their hashes match, so a lookup should
+ * need about one comparison; a linear scan would average 50000.
+ */
+#define SCALE_COMPARE_LIMIT 64
+
+/**
+ * Largest average chain length allowed once all URLs are inserted.
+ *
+ * The bucket table grows as the map fills; a table which stayed at
+ * its initial size would average about 25 entries per chain here.
+ */
+#define SCALE_CHAIN_LIMIT 2
+
+static nsurl *scale_urls[SCALE_TEST_COUNT];
+
+static unsigned long scale_compares;
+
+static uint32_t
+scale_key_hash(void *key)
+{
+	return nsurl_hash((nsurl *)key);
+}
+
+static bool
+scale_key_eq(void *key1, void *key2)
+{
+	scale_compares++;
+	return key_eq(key1, key2);
+}
+
+static hashmap_parameters_t scale_params = {
+	.key_clone = key_clone,
+	.key_hash = scale_key_hash,
+	.key_eq = scale_key_eq,
+	.key_destroy = key_destroy,
+	.value_alloc = value_alloc,
+	.value_destroy = value_destroy,
+};
+
+static void
+scale_fixture_create(void)
+{
+	char url[64];
+	int idx;
+
+	corestring_create();
+
+	test_hashmap = hashmap_create(&scale_params);
+	ck_assert(test_hashmap != NULL);
+
+	for (idx = 0; idx < SCALE_TEST_COUNT; idx++) {
+		snprintf(url, sizeof(url),
+			 "http://host%d.example.com/page/%d.html",
+			 idx % 64, idx);
+		ck_assert(nsurl_create(url, &scale_urls[idx]) == NSERROR_OK);
+	}
+}
+
+static void
+scale_fixture_teardown(void)
+{
+	int idx;
+
+	for (idx = 0; idx < SCALE_TEST_COUNT; idx++) {
+		nsurl_unref(scale_urls[idx]);
+		scale_urls[idx] = NULL;
+	}
+
+	basic_fixture_teardown();
+}
+
+/**
+ * Check keyed lookup of many URLs stays far below a linear scan.
+ *
+ * The low level cache indexes its objects with a map keyed like this
+ * one. Key comparisons and the average chain length are asserted
+ * rather than the time taken so the test does not depend on the
+ * machine it runs on; the lookup time is only reported.
+ */
+START_TEST(scale_lookup_compares)
+{
+	uint64_t start_ms;
+	uint64_t end_ms;
+	int idx;
+
+	for (idx = 0; idx < SCALE_TEST_COUNT; idx++) {
+		ck_assert(hashmap_insert(test_hashmap, scale_urls[idx]) != NULL);
+	}
+	ck_assert_int_eq(hashmap_count(test_hashmap), SCALE_TEST_COUNT);
+	ck_assert(hashmap_count(test_hashmap) <=
+		  (size_t)hashmap_bucket_count(test_hashmap) * SCALE_CHAIN_LIMIT);
+
+	scale_compares = 0;
+	nsu_getmonotonic_ms(&start_ms);
+	for (idx = 0; idx < SCALE_TEST_COUNT; idx++) {
+		hashmap_test_value_t *val;
+		val = hashmap_lookup(test_hashmap, scale_urls[idx]);
+		ck_assert(val != NULL);
+		ck_assert(val->key == scale_urls[idx]);
+	}
+	nsu_getmonotonic_ms(&end_ms);
+	ck_assert(scale_compares <=
+		  (unsigned long)SCALE_TEST_COUNT * SCALE_COMPARE_LIMIT);
+
+	printf("%d lookups in %u buckets took %llums\n",
+	       SCALE_TEST_COUNT,
+	       hashmap_bucket_count(test_hashmap),
+	       (unsigned long long)(end_ms - start_ms));
+
+	for (idx = 0; idx < SCALE_TEST_COUNT; idx++) {
+		ck_assert(hashmap_remove(test_hashmap, scale_urls[idx]) == true);
+	}
+
+	ck_assert_int_eq(keys, 0);
+	ck_assert_int_eq(values, 0);
+}
+END_TEST
+
+static TCase *scale_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Lookup scaling");
+
+	tcase_add_unchecked_fixture(tc,
+				    scale_fixture_create,
+				    scale_fixture_teardown);
+
+	tcase_add_test(tc, scale_lookup_compares);
+
+	return tc;
+}
+
 /*
  * hashmap test suite creation
  */
@@ -551,6 +692,7 @@ static Suite *hashmap_suite_create(void)
 
 	suite_add_tcase(s, basic_api_case_create());
 	suite_add_tcase(s, chain_case_create());
+	suite_add_tcase(s, scale_case_create());
 
 	return s;
 }
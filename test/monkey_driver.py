@@ -292,6 +292,15 @@ def run_test_step_action_reload(ctx, step):
     win.reload()
 
 
+def run_test_step_action_window_resize(ctx, step):
+    print(get_indent(ctx) + "Action: " + step["action"])
+    assert_browser(ctx)
+    tag = step['window']
+    win = ctx['windows'].get(tag)
+    assert win is not None
+    win.resize(step['width'], step['height'])
+
+
 def run_test_step_action_sleep_ms(ctx, step):
     print(get_indent(ctx) + "Action: " + step["action"])
     conds = step.get('conditions', {})
@@ -454,12 +463,19 @@ def run_test_step_action_plot_check(ctx, step):
         checks = {}
 
     all_text_list = []
+    text_plots = []
     bitmaps = []
+    bitmap_clips = []
+    clip = None
     for plot in win.redraw(coords=area):
+        if plot[0] == 'CLIP':
+            clip = [int(plot[i]) for i in (2, 4, 6, 8)]
         if plot[0] == 'TEXT':
             all_text_list.extend(plot[6:])
+            text_plots.append((int(plot[2]), " ".join(plot[6:])))
         if plot[0] == 'BITMAP':
             bitmaps.append(plot[1:])
+            bitmap_clips.append(clip)
     all_text = " ".join(all_text_list)
     for check in checks:
         if 'text-contains' in check.keys():
@@ -471,6 +487,22 @@ def run_test_step_action_plot_check(ctx, step):
         elif 'bitmap-count' in check.keys():
             print("        Check bitmap count is {}".format(int(check['bitmap-count'])))
             assert len(bitmaps) == int(check['bitmap-count'])
+        elif 'text-x-range' in check.keys():
+            rng = check['text-x-range']
+            xs = [x for (x, text) in text_plots if rng['text'] in text]
+            print("        Check {} plotted with x in [{}, {}] at {}".format(
+                repr(rng['text']), rng['min'], rng['max'], repr(xs)))
+            assert len(xs) > 0
+            assert all(int(rng['min']) <= x <= int(rng['max']) for x in xs)
+        elif 'bitmap-clip-within' in check.keys():
+            rng = check['bitmap-clip-within']
+            print("        Check bitmaps are clipped within {} at {}".format(
+                repr(rng), repr(bitmap_clips)))
+            assert len(bitmap_clips) > 0
+            for c in bitmap_clips:
+                assert c is not None
+                assert c[0] >= int(rng['x0']) and c[1] >= int(rng['y0'])
+                assert c[2] <= int(rng['x1']) and c[3] <= int(rng['y1'])
         else:
             raise AssertionError("Unknown check: {}".format(repr(check)))
 
@@ -574,6 +606,23 @@ def run_test_step_action_wait_log(ctx, step):
     win.wait_for_log(source=source, foldable=foldable, level=level, substr=substr)
 
 
+def run_test_step_action_log_check(ctx, step):
+    print(get_indent(ctx) + "Action: " + step["action"])
+    assert_browser(ctx)
+    tag = step['window']
+    source = step.get('source')
+    foldable = step.get('foldable')
+    level = step.get('level')
+    substr = step.get('substring')
+    present = step.get('present', True)
+    print(get_indent(ctx) + "        " + tag + " Check logging is " +
+          ("present" if present else "absent"))
+    win = ctx['windows'].get(tag)
+    assert win is not None
+    assert win.log_contains(source=source, foldable=foldable, level=level,
+                            substr=substr) == present
+
+
 def run_test_step_action_js_exec(ctx, step):
     print(get_indent(ctx) + "Action: " + step["action"])
     assert_browser(ctx)
@@ -608,6 +657,7 @@ STEP_HANDLERS = {
     "launch":        run_test_step_action_launch,
     "window-new":    run_test_step_action_window_new,
     "window-close":  run_test_step_action_window_close,
+    "window-resize": run_test_step_action_window_resize,
     "navigate":      run_test_step_action_navigate,
     "reload":        run_test_step_action_reload,
     "stop":          run_test_step_action_stop,
@@ -625,6 +675,7 @@ STEP_HANDLERS = {
     "remove-auth":   run_test_step_action_remove_auth,
     "clear-log":     run_test_step_action_clear_log,
     "wait-log":      run_test_step_action_wait_log,
+    "log-check":     run_test_step_action_log_check,
     "js-exec":       run_test_step_action_js_exec,
     "page-info-state":
                      run_test_step_action_page_info_state,
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2026 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Test SHA-256 digest computation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "utils/sha256.h"
+
+#define NELEMS(x)  (sizeof(x) / sizeof((x)[0]))
+
+struct test_digest {
+	const char *data;
+	size_t repeat;
+	const char *expected;
+};
+
+/* FIPS 180-4 example messages */
+static const struct test_digest digest_tests[] = {
+	{
+		"",
+		1,
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+	},
+	{
+		"abc",
+		1,
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+	},
+	{
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		1,
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+	},
+	{
+		"a",
+		1000000,
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"
+	},
+};
+
+/**
+ * Convert a digest to a hex string for comparison.
+ */
+static void digest_hex(const uint8_t *digest, char *hex)
+{
+	int i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; i++) {
+		sprintf(hex + (i * 2), "%02x", digest[i]);
+	}
+}
+
+/**
+ * Digest computed incrementally
+ */
+START_TEST(sha256_digest_test)
+{
+	const struct test_digest *t = &digest_tests[_i];
+	struct sha256_ctx ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	char hex[(SHA256_DIGEST_SIZE * 2) + 1];
+	size_t r;
+
+	sha256_init(&ctx);
+	for (r = 0; r < t->repeat; r++) {
+		sha256_update(&ctx, (const uint8_t *)t->data, strlen(t->data));
+	}
+	sha256_final(&ctx, digest);
+
+	digest_hex(digest, hex);
+	ck_assert_str_eq(hex, t->expected);
+}
+END_TEST
+
+/**
+ * Digest of a whole buffer matches the digest of the same data
+ * presented in every possible pair of pieces.
+ */
+START_TEST(sha256_split_test)
+{
+	uint8_t data[200];
+	uint8_t whole[SHA256_DIGEST_SIZE];
+	uint8_t split[SHA256_DIGEST_SIZE];
+	struct sha256_ctx ctx;
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = i * 7;
+	}
+
+	sha256(data, sizeof(data), whole);
+
+	for (i = 0; i <= sizeof(data); i++) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, data, i);
+		sha256_update(&ctx, data + i, sizeof(data) - i);
+		sha256_final(&ctx, split);
+
+		ck_assert(memcmp(whole, split, SHA256_DIGEST_SIZE) == 0);
+	}
+}
+END_TEST
+
+
+/* suite generation */
+static Suite *sha256_suite(void)
+{
+	Suite *s;
+	TCase *tc_digest;
+	TCase *tc_split;
+
+	s = suite_create("sha256");
+
+	tc_digest = tcase_create("Known digests");
+	tcase_add_loop_test(tc_digest,
+			    sha256_digest_test,
+			    0, NELEMS(digest_tests));
+	suite_add_tcase(s, tc_digest);
+
+	tc_split = tcase_create("Incremental update");
+	tcase_add_test(tc_split, sha256_split_test);
+	suite_add_tcase(s, tc_split);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = sha256_suite();
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -140,6 +140,11 @@ char *realpath(const char *path, char *resolved_path);
 #undef HAVE_MMAP
 #endif
 
+/* epoll for event driven fetching */
+#if defined(__linux__)
+#define HAVE_EPOLL
+#endif
+
 #define HAVE_SCANDIR
 #if (defined(_WIN32) ||				\
      defined(__serenity__))
@@ -244,6 +244,7 @@ CORESTRING_DOM_STRING(error);
 CORESTRING_DOM_STRING(Escape);
 CORESTRING_DOM_STRING(focus);
 CORESTRING_DOM_STRING(frameborder);
+CORESTRING_DOM_STRING(frameset);
 CORESTRING_DOM_STRING(hashchange);
 CORESTRING_DOM_STRING(height);
 CORESTRING_DOM_STRING(Home);
@@ -252,6 +253,7 @@ CORESTRING_DOM_STRING(hreflang);
 CORESTRING_DOM_STRING(hspace);
 /* http-equiv: see below */
 CORESTRING_DOM_STRING(id);
+CORESTRING_DOM_STRING(iframe);
 CORESTRING_DOM_STRING(input);
 CORESTRING_DOM_STRING(invalid);
 CORESTRING_DOM_STRING(keydown);
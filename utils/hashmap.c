@@ -22,10 +22,16 @@
 #include "utils/hashmap.h"
 
 /**
- * The default number of buckets in the hashmaps we create.
+ * The number of buckets in the hashmaps we create, grown as they fill.
  */
 #define DEFAULT_HASHMAP_BUCKETS (4091)
 
+/**
+ * The average number of entries per bucket above which the bucket
+ * table is grown.
+ */
+#define HASHMAP_MAX_LOAD (2)
+
 /**
  * Hashmaps have chains of entries in buckets.
  */
@@ -126,6 +132,50 @@ hashmap_lookup(hashmap_t *hashmap, void *key)
 	return NULL;
 }
 
+/**
+ * Grow the bucket table of a hashmap
+ *
+ * The entries are redistributed using their stored hashes so no keys
+ * are rehashed.  If the new table cannot be allocated the map is left
+ * as it was, which only costs lookup time.
+ *
+ * \param hashmap The hashmap to grow
+ */
+static void
+hashmap_grow(hashmap_t *hashmap)
+{
+	uint32_t bucket_count = (hashmap->bucket_count * 2) + 1;
+	hashmap_entry_t **buckets;
+	uint32_t bucket;
+
+	buckets = calloc(bucket_count, sizeof(hashmap_entry_t *));
+	if (buckets == NULL) {
+		return;
+	}
+
+	for (bucket = 0; bucket < hashmap->bucket_count; bucket++) {
+		hashmap_entry_t *entry = hashmap->buckets[bucket];
+		while (entry != NULL) {
+			hashmap_entry_t *next = entry->next;
+			hashmap_entry_t **head;
+
+			head = &buckets[entry->key_hash % bucket_count];
+			entry->prevptr = head;
+			entry->next = *head;
+			if (entry->next != NULL) {
+				entry->next->prevptr = &entry->next;
+			}
+			*head = entry;
+
+			entry = next;
+		}
+	}
+
+	free(hashmap->buckets);
+	hashmap->buckets = buckets;
+	hashmap->bucket_count = bucket_count;
+}
+
 /* Exported function, documented in hashmap.h */
 void *
 hashmap_insert(hashmap_t *hashmap, void *key)
@@ -189,6 +239,11 @@ hashmap_insert(hashmap_t *hashmap, void *key)
 
 	hashmap->entry_count++;
 
+	if (hashmap->entry_count >
+	    ((size_t)hashmap->bucket_count * HASHMAP_MAX_LOAD)) {
+		hashmap_grow(hashmap);
+	}
+
 	return entry->value;
 
 err:
@@ -253,3 +308,10 @@ hashmap_count(hashmap_t *hashmap)
 {
 	return hashmap->entry_count;
 }
+
+/* Exported function, documented in hashmap.h */
+uint32_t
+hashmap_bucket_count(hashmap_t *hashmap)
+{
+	return hashmap->bucket_count;
+}
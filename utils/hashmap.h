@@ -194,4 +194,15 @@ bool hashmap_iterate(hashmap_t *hashmap, hashmap_iteration_cb_t cb, void *ctx);
  */
 size_t hashmap_count(hashmap_t *hashmap);
 
+/**
+ * Get the number of buckets in this map
+ *
+ * The bucket table grows as entries are inserted so the average
+ * chain length, the entry count over the bucket count, stays small.
+ *
+ * \param hashmap The hashmap to retrieve the bucket count from
+ * \return The number of buckets in the hashmap
+ */
+uint32_t hashmap_bucket_count(hashmap_t *hashmap);
+
 #endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2026 The NetSurf Browser Project
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * SHA-256 message digest (FIPS 180-4).
+ */
+
+#ifndef NETSURF_UTILS_SHA256_H_
+#define NETSURF_UTILS_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Length of a SHA-256 digest in bytes */
+#define SHA256_DIGEST_SIZE 32
+
+/** Length of a SHA-256 message block in bytes */
+#define SHA256_BLOCK_SIZE 64
+
+/**
+ * SHA-256 digest computation context.
+ */
+struct sha256_ctx {
+	uint32_t state[8]; /**< intermediate hash value */
+	uint64_t length; /**< total message length in bytes */
+	size_t used; /**< bytes held in block */
+	uint8_t block[SHA256_BLOCK_SIZE]; /**< partial message block */
+};
+
+/**
+ * Initialise a digest context.
+ *
+ * \param ctx The context to initialise.
+ */
+void sha256_init(struct sha256_ctx *ctx);
+
+/**
+ * Add data to a digest computation.
+ *
+ * \param ctx The context to update.
+ * \param data The data to add.
+ * \param len The length of \a data.
+ */
+void sha256_update(struct sha256_ctx *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Complete a digest computation.
+ *
+ * The context must be initialised again before reuse.
+ *
+ * \param ctx The context to complete.
+ * \param digest Buffer to receive the digest.
+ */
+void sha256_final(struct sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * Compute the digest of a buffer.
+ *
+ * \param data The data to digest.
+ * \param len The length of \a data.
+ * \param digest Buffer to receive the digest.
+ */
+void sha256(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif